@@ -40,6 +40,7 @@ class KeyDatabase final
 public:
     using position_type = unsigned int;
     struct Rect { position_type x0, y0, x1, y1; };
+    struct Point { float x, y; };
 
     struct Key final
     {
@@ -61,6 +62,7 @@ private:
 
     using key_list = std::vector<Key>;
     using relation_list = std::vector<Relation>;
+    using point_list = std::vector<Point>;
 public:
     using value_type = key_list::value_type;
     using const_reference = key_list::const_reference;
@@ -82,6 +84,9 @@ public:
     const_reference operator[](size_type idx) const { return m_keys[idx]; }
 
     Rect            bounds() const noexcept { return m_bounds; }
+    /// Center of key, scaled so bounds map to [0, 1] on both axes. As in layouts,
+    /// the y axis points downwards.
+    Point           center(const Key & key) const noexcept { return m_centers[key.index]; }
     position_type   distance(const Key &, const Key &) const noexcept;
     double          angle(const Key &, const Key &) const noexcept;
 
@@ -92,10 +97,12 @@ public:
 
 private:
     static relation_list computeRelations(const key_list &);
+    static point_list computeCenters(const key_list &, const Rect & bounds);
 
 private:
     key_list        m_keys;         ///< Vector of all keys known for a device
     Rect            m_bounds;       ///< Bounds of m_keys' positions
+    point_list      m_centers;      ///< Normalized center of each key, by index
     relation_list   m_relations;    ///< Pre-computed relation array
 };
 
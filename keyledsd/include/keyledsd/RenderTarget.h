@@ -36,6 +36,11 @@ namespace keyleds {
  * a 2-tuple containing the block index and key index within block. No ordering
  * is enforce on blocks or keys, but the for_device static method uses the same
  * order that is detected on the device by the keyleds::Device object.
+ *
+ * A high precision target also holds a wide copy of its colors, with 16 bits
+ * per channel. Blending and multiplying into it happen on wide colors, so
+ * deep layer stacks do not accumulate rounding errors. Regular colors remain
+ * available and writable, and are kept in sync with wide colors.
  */
 class RenderTarget final
 {
@@ -47,9 +52,12 @@ public:
     using const_reference = const value_type &;
     using iterator = value_type *;
     using const_iterator = const value_type *;
+    using wide_value_type = RGBA64Color;
+    enum class Precision { Normal, High };
 public:
                         RenderTarget() = default;
     explicit            RenderTarget(size_type);
+                        RenderTarget(size_type, Precision);
                         RenderTarget(RenderTarget && other) noexcept
                          { swap(*this, other); }
     RenderTarget &      operator=(RenderTarget && other) noexcept
@@ -74,18 +82,28 @@ public:
     reference           operator[](size_type idx) { return m_colors[idx]; }
     const_reference     operator[](size_type idx) const { return m_colors[idx]; }
 
+    bool                highPrecision() const noexcept { return m_wideColors != nullptr; }
+    wide_value_type *   wideData() { return m_wideColors; }
+    const wide_value_type * wideData() const { return m_wideColors; }
+    /// Updates wide colors whose regular counterpart was written to directly
+    void                syncWide() noexcept;
+
 private:
     void                clear() noexcept;
 private:
     size_type           m_size = 0;         ///< Number of color entries
     size_type           m_capacity = 0;     ///< Number of allocated color entries
     RGBAColor *         m_colors = nullptr; ///< Color buffer. RGBAColor is a POD type
+    RGBA64Color *       m_wideColors = nullptr; ///< Wide color buffer, only in high precision mode
 
     friend void swap(RenderTarget &, RenderTarget &) noexcept;
 };
 
 void swap(RenderTarget &, RenderTarget &) noexcept;
 void blend(RenderTarget &, const RenderTarget &) noexcept;
+void blend(RenderTarget &, RGBAColor) noexcept;
+void blend(RenderTarget &, const RGBAColor *, const uint32_t * indices, std::size_t) noexcept;
+void blend(RenderTarget &, const RenderTarget &, const uint32_t * indices, std::size_t) noexcept;
 void multiply(RenderTarget &, const RenderTarget &) noexcept;
 
 /****************************************************************************/
@@ -102,6 +120,9 @@ protected:
 public:
     /// Modifies the target to reflect effect's display once the specified time has elapsed
     virtual void    render(milliseconds, RenderTarget & target) = 0;
+    /// Invoked once a frame was sent to the device, with the time next frame is due.
+    /// Lets renderers run deferred work, such as garbage collection, outside of render.
+    virtual void    idle(std::chrono::steady_clock::time_point) {}
 protected:
     // Protect the destructor so we can leave it non-virtual
     ~Renderer() {}
@@ -115,11 +136,18 @@ inline void swap(RenderTarget & lhs, RenderTarget & rhs) noexcept
     swap(lhs.m_size, rhs.m_size);
     swap(lhs.m_capacity, rhs.m_capacity);
     swap(lhs.m_colors, rhs.m_colors);
+    swap(lhs.m_wideColors, rhs.m_wideColors);
 }
 
 inline void blend(RenderTarget & lhs, const RenderTarget & rhs) noexcept
 {
     assert(lhs.capacity() == rhs.capacity());
+    if (lhs.highPrecision()) {
+        tools::blend_wide(reinterpret_cast<uint16_t*>(lhs.wideData()),
+                          reinterpret_cast<uint8_t*>(lhs.data()),
+                          reinterpret_cast<const uint8_t*>(rhs.data()), rhs.capacity());
+        return;
+    }
     tools::blend(reinterpret_cast<uint8_t*>(lhs.data()),
                  reinterpret_cast<const uint8_t*>(rhs.data()), rhs.capacity());
 }
@@ -128,13 +156,73 @@ template <typename A>
 inline void blend(RenderTarget & lhs, const RenderTarget & rhs) noexcept
 {
     assert(lhs.capacity() == rhs.capacity());
+    if (lhs.highPrecision()) {
+        A::blend_wide(reinterpret_cast<uint16_t*>(lhs.wideData()),
+                      reinterpret_cast<uint8_t*>(lhs.data()),
+                      reinterpret_cast<const uint8_t*>(rhs.data()), rhs.capacity());
+        return;
+    }
     A::blend(reinterpret_cast<uint8_t*>(lhs.data()),
              reinterpret_cast<const uint8_t*>(rhs.data()), rhs.capacity());
 }
 
+/// Blends the same color into all entries, without needing a source target
+inline void blend(RenderTarget & lhs, RGBAColor color) noexcept
+{
+    if (lhs.highPrecision()) {
+        tools::blend_color_wide(reinterpret_cast<uint16_t*>(lhs.wideData()),
+                                reinterpret_cast<uint8_t*>(lhs.data()),
+                                reinterpret_cast<const uint8_t*>(&color), lhs.capacity());
+        return;
+    }
+    tools::blend_color(reinterpret_cast<uint8_t*>(lhs.data()),
+                       reinterpret_cast<const uint8_t*>(&color), lhs.capacity());
+}
+
+/// Blends an array of colors into lhs, colors[n] going into lhs[indices[n]]
+inline void blend(RenderTarget & lhs, const RGBAColor * colors,
+                  const uint32_t * indices, std::size_t length) noexcept
+{
+    if (lhs.highPrecision()) {
+        tools::blend_indexed_wide(reinterpret_cast<uint16_t*>(lhs.wideData()),
+                                  reinterpret_cast<uint8_t*>(lhs.data()),
+                                  reinterpret_cast<const uint8_t*>(colors), indices, length);
+        return;
+    }
+    tools::blend_indexed(reinterpret_cast<uint8_t*>(lhs.data()),
+                         reinterpret_cast<const uint8_t*>(colors), indices, length);
+}
+
+/// Blends the first entries of rhs into lhs, entry n going into lhs[indices[n]]
+inline void blend(RenderTarget & lhs, const RenderTarget & rhs,
+                  const uint32_t * indices, std::size_t length) noexcept
+{
+    assert(length <= rhs.size());
+    blend(lhs, rhs.data(), indices, length);
+}
+
+template <typename A>
+inline void blend(RenderTarget & lhs, RGBAColor color) noexcept
+{
+    if (lhs.highPrecision()) {
+        A::blend_color_wide(reinterpret_cast<uint16_t*>(lhs.wideData()),
+                            reinterpret_cast<uint8_t*>(lhs.data()),
+                            reinterpret_cast<const uint8_t*>(&color), lhs.capacity());
+        return;
+    }
+    A::blend_color(reinterpret_cast<uint8_t*>(lhs.data()),
+                   reinterpret_cast<const uint8_t*>(&color), lhs.capacity());
+}
+
 inline void multiply(RenderTarget & lhs, const RenderTarget & rhs) noexcept
 {
     assert(lhs.capacity() == rhs.capacity());
+    if (lhs.highPrecision()) {
+        tools::multiply_wide(reinterpret_cast<uint16_t*>(lhs.wideData()),
+                             reinterpret_cast<uint8_t*>(lhs.data()),
+                             reinterpret_cast<const uint8_t*>(rhs.data()), rhs.capacity());
+        return;
+    }
     tools::multiply(reinterpret_cast<uint8_t*>(lhs.data()),
                     reinterpret_cast<const uint8_t*>(rhs.data()), rhs.capacity());
 }
@@ -143,6 +231,12 @@ template <typename A>
 inline void multiply(RenderTarget & lhs, const RenderTarget & rhs) noexcept
 {
     assert(lhs.capacity() == rhs.capacity());
+    if (lhs.highPrecision()) {
+        A::multiply_wide(reinterpret_cast<uint16_t*>(lhs.wideData()),
+                         reinterpret_cast<uint8_t*>(lhs.data()),
+                         reinterpret_cast<const uint8_t*>(rhs.data()), rhs.capacity());
+        return;
+    }
     A::multiply(reinterpret_cast<uint8_t*>(lhs.data()),
                 reinterpret_cast<const uint8_t*>(rhs.data()), rhs.capacity());
 }
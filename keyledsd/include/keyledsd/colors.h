@@ -100,6 +100,40 @@ inline std::ostream & operator<<(std::ostream & out, RGBAColor obj)
 
 /****************************************************************************/
 
+/** Wide RGBA color POD
+ *
+ * Holds a single R16G16B16A16 value, used to compose colors without losing
+ * precision. Should not generate any padding.
+ */
+struct alignas(8) RGBA64Color final {
+    using channel_type = unsigned short;
+
+    channel_type red;
+    channel_type green;
+    channel_type blue;
+    channel_type alpha;
+
+    RGBA64Color() = default;
+    constexpr RGBA64Color(channel_type r, channel_type g, channel_type b, channel_type a)
+     : red(r), green(g), blue(b), alpha(a) {}
+    constexpr RGBA64Color(RGBAColor c)
+     : red(expand(c.red)), green(expand(c.green)), blue(expand(c.blue)), alpha(expand(c.alpha)) {}
+
+private:
+    static constexpr channel_type expand(RGBAColor::channel_type value)
+     { return static_cast<channel_type>(value * 257); }
+};
+
+inline constexpr bool operator==(RGBA64Color a, RGBA64Color b) {
+    return (a.red == b.red &&
+            a.green == b.green &&
+            a.blue == b.blue &&
+            a.alpha == b.alpha);
+}
+inline constexpr bool operator!=(RGBA64Color a, RGBA64Color b) { return !(a == b); }
+
+/****************************************************************************/
+
 } // namespace keyleds
 
 #endif
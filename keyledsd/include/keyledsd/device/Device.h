@@ -41,6 +41,7 @@ class Device
 public:
     // Transient types
     enum class Type { Keyboard, Remote, NumPad, Mouse, TouchPad, TrackBall, Presenter, Receiver };
+    /// Layout-compatible with libkeyleds' keyleds_key_color, so it can be passed through
     struct ColorDirective {
         uint8_t id, red, green, blue;
     };
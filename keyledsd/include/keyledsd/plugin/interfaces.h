@@ -53,6 +53,10 @@ public:
     /// Invoked whenever the user presses or releases a key while the plugin is active.
     virtual void    handleKeyEvent(const KeyDatabase::Key &, bool press) = 0;
 
+    /// Runtime figures the effect wants to report, such as memory use. Invoked from
+    /// the service thread while the render loop is locked.
+    virtual string_map statistics() const { return {}; }
+
 protected:
     Effect() = default;
     ~Effect() {}
@@ -40,6 +40,7 @@ namespace keyleds::service {
  */
 struct Configuration final
 {
+    struct Correction;
     struct EffectGroup;
     struct Effect;
     struct KeyGroup;
@@ -50,6 +51,7 @@ struct Configuration final
     using path_list = std::vector<std::string>;
     using color_map = std::vector<std::pair<std::string, RGBAColor>>;
     using device_map = std::vector<std::pair<std::string, std::string>>;
+    using correction_list = std::vector<Correction>;
     using key_group_list = std::vector<KeyGroup>;
     using effect_group_list = std::vector<EffectGroup>;
     using profile_list = std::vector<Profile>;
@@ -62,6 +64,7 @@ struct Configuration final
     path_list           pluginPaths;    ///< List of directories to search for plugins
     color_map           customColors;   ///< Map of color names to RGBA values
     device_map          devices;        ///< Map of device serials to device names
+    correction_list     corrections;    ///< List of per-device output corrections
     key_group_list      keyGroups;      ///< Map of key group names to lists of key names
     effect_group_list   effectGroups;   ///< Map of effect group names to configurations
     profile_list        profiles;       ///< List of profile configurations
@@ -71,6 +74,22 @@ std::string getDeviceName(const Configuration & config, const std::string & seri
 
 /****************************************************************************/
 
+/** Output correction configuration
+ *
+ * Describes how colors are adjusted right before being sent to a device,
+ * to compensate for LED response and calibrate blocks against each other.
+ */
+struct Configuration::Correction final
+{
+    std::string device;                     ///< Name or serial of the device it applies to
+    float       gamma = 1.0f;               ///< Exponent applied to normalized intensities
+    float       brightness = 1.0f;          ///< Global intensity factor, from 0 to 1
+    RGBColor    whiteBalance = {255, 255, 255}; ///< Per-channel intensity factors
+    bool        dithering = false;          ///< Use temporal dithering on changing keys
+};
+
+/****************************************************************************/
+
 /** EffectGroup configuration
  */
 struct Configuration::EffectGroup final
@@ -38,11 +38,20 @@ namespace keyleds::service {
 /****************************************************************************/
 
 namespace detail {
+    /// An effect instance, along with what is needed to re-create it
+    struct LoadedEffect final
+    {
+        const Configuration::Effect *           configuration;
+        std::vector<std::string>                files;  ///< files the effect read on creation
+        EffectManager::effect_ptr               effect;
+    };
+
     /// An effect group, fully loaded with effects
     struct EffectGroup final
     {
         std::string                             name;
-        std::vector<EffectManager::effect_ptr>  effects;
+        std::vector<KeyDatabase::KeyGroup>      keyGroups;
+        std::vector<LoadedEffect>               effects;
     };
 }
 
@@ -61,6 +70,14 @@ class DeviceManager final
     using string_map = std::vector<std::pair<std::string, std::string>>;
 public:
     using dev_list = std::vector<std::string>;
+
+    /// Runtime figures reported by a loaded effect
+    struct EffectStatistics final
+    {
+        std::string group;          ///< Name of effect group the effect belongs to
+        std::string effect;         ///< Effect name
+        string_map  values;         ///< Figures, as reported by the effect
+    };
 public:
                             DeviceManager(EffectManager &, FileWatcher &,
                                           const tools::device::Description &,
@@ -86,6 +103,13 @@ public:
     void                    setPaused(bool);
     void                    forceRefresh() { m_renderLoop.forceRefresh(); }
 
+    /// Lists files loaded effects depend on, without duplicates
+    dev_list                effectFiles() const;
+    /// Collects runtime figures from all loaded effects
+    std::vector<EffectStatistics> effectStatistics();
+    /// Re-creates all loaded effects that depend on given file
+    void                    reloadEffects(const std::string & path);
+
 private:
     /// Loads the list of effects to activate for the given context
     std::vector<Effect *>   loadEffects(const string_map & context);
@@ -93,6 +117,10 @@ private:
     /// Instanciates an effect, combining its configuration with this device's info
     const detail::EffectGroup & getEffectGroup(const Configuration::EffectGroup &);
 
+    /// Creates a single effect instance, recording files it reads
+    detail::LoadedEffect    createEffect(const Configuration::Effect &,
+                                         const std::vector<KeyDatabase::KeyGroup> &);
+
 private:
     EffectManager &         m_effectManager;    ///< Manages the lifecycle of effects
     const Configuration *   m_configuration;    ///< Reference to service configuration
@@ -109,6 +137,7 @@ private:
     std::vector<detail::EffectGroup> m_effectGroups;    ///< Loaded effect group instances
     RenderLoop              m_renderLoop;       ///< The RenderLoop in charge of the device
     std::vector<Effect *>   m_activeEffects;    ///< Effects currently active on m_renderLoop
+    string_map              m_context;          ///< Context last given to setContext
 };
 
 /****************************************************************************/
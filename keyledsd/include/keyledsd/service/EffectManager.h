@@ -48,6 +48,7 @@ class EffectManager final
         effect_deleter(EffectManager * manager, PluginTracker * tracker,
                        std::unique_ptr<plugin::EffectService> service);
         effect_deleter(effect_deleter &&) noexcept;
+        effect_deleter & operator=(effect_deleter &&) noexcept;
         ~effect_deleter();
         void operator()(plugin::Effect * ptr) const;
     };
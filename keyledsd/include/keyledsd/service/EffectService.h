@@ -36,6 +36,8 @@ class DeviceManager;
 class EffectService final : public plugin::EffectService
 {
     using KeyGroup = KeyDatabase::KeyGroup;
+public:
+    using path_list = std::vector<std::string>;
 public:
     EffectService(const DeviceManager &, const Configuration &,
                   const Configuration::Effect &, std::vector<KeyGroup>);
@@ -58,6 +60,9 @@ public:
 
     void                log(logging::level_t, const char * msg) override;
 
+    /// Paths of all files successfully read through getFile()
+    const path_list &   files() const { return m_files; }
+
 private:
     const DeviceManager &                       m_manager;
     const Configuration &                       m_configuration;
@@ -65,6 +70,7 @@ private:
     const std::vector<KeyGroup>                 m_keyGroups;
     std::vector<std::unique_ptr<RenderTarget>>  m_renderTargets;
     std::string                                 m_fileData;
+    path_list                                   m_files;
 };
 
 /****************************************************************************/
@@ -21,8 +21,10 @@
 #endif
 
 #include "keyledsd/device/Device.h"
+#include "keyledsd/service/Configuration.h"
 #include "keyledsd/tools/AnimationLoop.h"
 #include "keyledsd/RenderTarget.h"
+#include <array>
 #include <atomic>
 #include <chrono>
 #include <mutex>
@@ -48,6 +50,9 @@ public:
 
     void                forceRefresh() { m_forceRefresh.store(true, std::memory_order_relaxed); }
 
+    /// Sets output correction. Caller must hold the lock.
+    void                setCorrection(const Configuration::Correction &);
+
     /// Returns a lock that bars the render loop from using renderers while it is held
     /// Holding it is mandatory for modifying any renderer or the list itself
     std::unique_lock<std::mutex>    lock();
@@ -60,11 +65,27 @@ public:
 
 private:
     bool                render(milliseconds) override;
+    void                idle(clock::time_point) override;
     void                run() override;
 
     /// Reads current device led state into the render target
     void                getDeviceState(RenderTarget & state);
 
+    /// Rebuilds output tables from correction settings. Caller must hold the lock.
+    void                applyCorrection();
+
+private:
+    /// Per-block translation of rendered channel values into device channel values,
+    /// in 8.8 fixed point so the fractional part can be used for dithering.
+    /// Wide colors are looked up by interpolating between entries.
+    struct OutputTable final
+    {
+        std::array<uint16_t, 257>   red;
+        std::array<uint16_t, 257>   green;
+        std::array<uint16_t, 257>   blue;
+    };
+    using output_table_list = std::vector<OutputTable>;
+
 private:
     device::Device &    m_device;               ///< The device to render to
     renderer_list       m_renderers;            ///< Current list of renderers (unowned)
@@ -73,10 +94,18 @@ private:
     clock::time_point   m_lastErrorTime;        ///< When did last I/O error occur?
     std::chrono::microseconds   m_commitDelay;  ///< Wait that amount between sending and committing
     std::atomic<bool>   m_forceRefresh;         ///< Force one-time full refresh at next render
+    Configuration::Correction m_correction;     ///< Output correction settings
+    bool                m_correctionChanged;    ///< Settings must be applied at next render
+    output_table_list   m_outputTables;         ///< Output correction, one table per block
+    bool                m_dithering;            ///< Whether temporal dithering is enabled
+    unsigned            m_frame;                ///< Frame counter, drives dithering pattern
+    std::vector<RGBColor> m_output;             ///< Last values sent to the device, per key
+    std::vector<uint8_t> m_ditherFrames;        ///< Frames left before key settles, per key
 
-    RenderTarget        m_state;                ///< Current state of the device
+    RenderTarget        m_state;                ///< Current state of the device, high precision
     RenderTarget        m_buffer;               ///< Buffer to render into, avoids re-creating it
-                                                ///  on every render
+                                                ///  on every render. High precision, so layers
+                                                ///  are composited with 16 bits per channel
     std::vector<device::Device::ColorDirective> m_directives;
                                                 ///< Buffer of directives, avoids new/delete on
                                                 ///< every render
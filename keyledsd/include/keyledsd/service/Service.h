@@ -85,8 +85,14 @@ public:
 private:
     // Events from watchers
     void                onConfigurationFileChanged(FileWatcher::Event);
+    void                onEffectFileChanged(const std::string & path, FileWatcher::Event);
     void                onDeviceAdded(const tools::device::Description &);
     void                onDeviceRemoved(const tools::device::Description &);
+
+    /// Watches files loaded effects depend on, dropping watches no longer needed
+    void                updateEffectFileWatches();
+    /// Watches again effect files that were replaced, and reloads effects using them
+    void                renewEffectFileWatches();
 private:
     EffectManager &     m_effectManager;    ///< Controls lifecycle of effects (injected)
     FileWatcher &       m_fileWatcher;      ///< Connection to inotify
@@ -100,6 +106,10 @@ private:
 
     DeviceWatcher       m_deviceWatcher;    ///< Connection to libudev
     FileWatcher::subscription m_fileWatcherSub; ///< Notifications for conf change
+    std::vector<std::pair<std::string, FileWatcher::subscription>>
+                        m_effectFileSubs;   ///< Notifications for effect file change
+    std::vector<std::string> m_replacedEffectFiles; ///< Effect files whose watch must be renewed
+    std::unique_ptr<uv_timer_t> m_renewTimer;   ///< Used to schedule watch renewal
 };
 
 /****************************************************************************/
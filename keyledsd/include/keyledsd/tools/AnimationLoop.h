@@ -58,6 +58,8 @@ public:
 protected:
     virtual void    run();
     virtual bool    render(milliseconds) = 0;
+    /// Invoked after each render, with the time next render is due
+    virtual void    idle(clock::time_point) {}
 
 private:
     /// Simply calls the animation loop's run method
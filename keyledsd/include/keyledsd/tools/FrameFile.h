@@ -0,0 +1,68 @@
+/* Keyleds -- Gaming keyboard tool
+ * Copyright (C) 2017 Julien Hartmann, juli1.hartmann@gmail.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef KEYLEDSD_TOOLS_FRAMEFILE_H_5C1E27B0
+#define KEYLEDSD_TOOLS_FRAMEFILE_H_5C1E27B0
+
+#include <cstddef>
+#include <cstdint>
+
+namespace keyleds::tools::frame_file {
+
+/****************************************************************************/
+
+/** Pre-rendered animation file header
+ *
+ * A frame file holds, in order, all in native (little-endian) byte order:
+ *  - this header;
+ *  - keyCount key names, each terminated by a NUL character, padded with
+ *    NUL characters to namesSize bytes;
+ *  - frameCount frames of stride R8G8B8A8 colors, the first keyCount of which
+ *    give the color of named keys, in the same order as names.
+ *
+ * Keys are named rather than indexed because key indices depend on the device
+ * a layout is plugged into. All sections are aligned, so frames can be used
+ * directly from a memory mapping of the file.
+ */
+struct Header final
+{
+    char            magic[8];       ///< always the magic constant
+    uint32_t        version;        ///< file format version
+    uint32_t        keyCount;       ///< number of keys in each frame
+    uint32_t        frameCount;     ///< number of frames in the file
+    uint32_t        frameDuration;  ///< time each frame is shown, in milliseconds
+    uint32_t        stride;         ///< number of colors from one frame to the next
+    uint32_t        namesSize;      ///< size of name section, in bytes
+};
+
+static constexpr char           magic[8] = {'K', 'L', 'D', 'S', 'A', 'N', 'I', 'M'};
+static constexpr uint32_t       version = 1;
+static constexpr std::size_t    alignment = 32; ///< alignment of sections, in bytes
+
+static_assert(sizeof(Header) == alignment, "frame file header must be one alignment unit");
+
+/// Rounds a size in bytes or in colors up to the next multiple of alignment
+constexpr std::size_t align(std::size_t size, std::size_t unit = 1)
+{
+    const auto count = alignment / unit;
+    return (size + count - 1) / count * count;
+}
+
+/****************************************************************************/
+
+} // namespace keyleds::tools::frame_file
+
+#endif
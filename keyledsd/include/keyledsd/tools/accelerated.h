@@ -62,6 +62,114 @@ void blend(uint8_t * a, const uint8_t * b, size_t length);
  */
 void multiply(uint8_t * a, const uint8_t * b, size_t length);
 
+/** Blend a R8G8B8A8 color stream into a R16G16B16A16 stream
+ *
+ * Same operation as blend(), but accumulated on 16-bit channels so stacking
+ * many layers does not accumulate rounding errors. The 8-bit destination is
+ * a copy of the high byte of each wide channel, updated along the way. Channels
+ * whose 8-bit copy no longer matches were written directly, and are reset to
+ * the 8-bit value before blending.
+ *
+ * @param[in|out] w An array of wide colors used as a destination. Must be 32-byte aligned.
+ * @param[in|out] a The 8-bit copy of w. Must be 32-byte aligned.
+ * @param b An array of colors used as a source. Must be 32-byte aligned.
+ * @param length The number of colors in the arrays. Must be a multiple of 8.
+ * @note Arrays must not overlap.
+ */
+void blend_wide(uint16_t * w, uint8_t * a, const uint8_t * b, size_t length);
+
+/** Multiply a R16G16B16A16 color stream by a R8G8B8A8 stream
+ *
+ * Same operation as multiply(), on 16-bit channels. See blend_wide() for
+ * a description of parameters.
+ */
+void multiply_wide(uint16_t * w, uint8_t * a, const uint8_t * b, size_t length);
+
+/** Blend a single R8G8B8A8 color into a color stream
+ *
+ * Same operation as blend(), as if all colors of b were the given color. Weights
+ * are computed once, and no source stream is read.
+ *
+ * @param[in|out] a An array of colors used as a destination. Must be 16-byte aligned.
+ * @param color The color to blend, as 4 channel values.
+ * @param length The number of colors in the array. Must be a multiple of 4.
+ */
+void blend_color(uint8_t * a, const uint8_t * color, size_t length);
+
+/** Blend a single R8G8B8A8 color into a R16G16B16A16 stream
+ *
+ * Same operation as blend_wide(), as if all colors of b were the given color.
+ * See blend_wide() for a description of parameters.
+ */
+void blend_color_wide(uint16_t * w, uint8_t * a, const uint8_t * color, size_t length);
+
+/** Blend a R8G8B8A8 color stream into scattered entries of another
+ *
+ * Same operation as blend(), but entry n of b is blended into entry indices[n]
+ * of a. Accesses are scattered, so there is no vector variant.
+ *
+ * @param[in|out] a An array of colors used as a destination.
+ * @param b An array of colors used as a source.
+ * @param indices For each entry of b, the index of the entry of a it blends into.
+ * @param length The number of colors in b.
+ */
+void blend_indexed(uint8_t * a, const uint8_t * b, const uint32_t * indices, size_t length);
+
+/** Blend a R8G8B8A8 color stream into scattered entries of a R16G16B16A16 stream
+ *
+ * Same operation as blend_indexed(), on 16-bit channels. See blend_wide() for
+ * a description of how w and a are kept in sync.
+ */
+void blend_indexed_wide(uint16_t * w, uint8_t * a, const uint8_t * b,
+                        const uint32_t * indices, size_t length);
+
+/** Fill a R8G8B8A8 color stream by sampling a color table
+ *
+ * Computes \f$a_n = table[(offset - phases_n) \land mask]\f$, that is, each
+ * entry samples a periodic table, shifted by its own phase.
+ *
+ * The lookup uses AVX2 gathers if available.
+ *
+ * @param[out] a An array of colors used as a destination. Must be 32-byte aligned.
+ * @param table An array of mask + 1 colors.
+ * @param phases An array of phases, one per entry of a.
+ * @param offset Position in table of entries with a null phase.
+ * @param mask Table size minus one. Table size must be a power of two.
+ * @param length The number of colors in a. Must be a multiple of 8.
+ */
+void sample_table(uint8_t * a, const uint8_t * table, const uint32_t * phases,
+                  uint32_t offset, uint32_t mask, size_t length);
+
+/** Add a stream of bytes into 16-bit sums
+ *
+ * Computes \f$s_n = s_n + a_n\f$, wrapping around on overflow. This is the
+ * vertical pass of a box filter: up to 257 rows of bytes can be accumulated
+ * before sums might overflow.
+ *
+ * The accumulation uses SSE2 or AVX2 if available.
+ *
+ * @param[in|out] sums An array of 16-bit sums, one per byte of a. No alignment requirement.
+ * @param a An array of bytes to add. No alignment requirement.
+ * @param length The number of bytes in a.
+ */
+void accumulate(uint16_t * sums, const uint8_t * a, size_t length);
+
+/** Move a stream of points under a constant acceleration
+ *
+ * Computes \f$p_n = p_n + v_n t + \frac{1}{2}at^2\f$, then \f$v_n = v_n + at\f$.
+ * This is one time step of a particle system, along one axis. Positions and
+ * velocities of all particles are stored in separate arrays for that purpose.
+ *
+ * The update uses SSE2 or AVX2 if available.
+ *
+ * @param[in|out] position An array of positions. No alignment requirement.
+ * @param[in|out] velocity An array of velocities, one per position. No alignment requirement.
+ * @param acceleration The acceleration applied to all points.
+ * @param dt The duration of the time step.
+ * @param length The number of points.
+ */
+void integrate(float * position, float * velocity, float acceleration, float dt, size_t length);
+
 #ifdef __cplusplus
     namespace detail {  // exposed for testing purposes
 #endif
@@ -71,6 +179,31 @@ void multiply(uint8_t * a, const uint8_t * b, size_t length);
         void multiply_plain(uint8_t * a, const uint8_t * b, size_t length);
         void multiply_sse2(uint8_t * a, const uint8_t * b, size_t length);
         void multiply_avx2(uint8_t * a, const uint8_t * b, size_t length);
+        void blend_wide_plain(uint16_t * w, uint8_t * a, const uint8_t * b, size_t length);
+        void blend_wide_sse2(uint16_t * w, uint8_t * a, const uint8_t * b, size_t length);
+        void blend_wide_avx2(uint16_t * w, uint8_t * a, const uint8_t * b, size_t length);
+        void multiply_wide_plain(uint16_t * w, uint8_t * a, const uint8_t * b, size_t length);
+        void multiply_wide_sse2(uint16_t * w, uint8_t * a, const uint8_t * b, size_t length);
+        void multiply_wide_avx2(uint16_t * w, uint8_t * a, const uint8_t * b, size_t length);
+        void blend_color_plain(uint8_t * a, const uint8_t * color, size_t length);
+        void blend_color_sse2(uint8_t * a, const uint8_t * color, size_t length);
+        void blend_color_avx2(uint8_t * a, const uint8_t * color, size_t length);
+        void blend_color_wide_plain(uint16_t * w, uint8_t * a, const uint8_t * color, size_t length);
+        void blend_color_wide_sse2(uint16_t * w, uint8_t * a, const uint8_t * color, size_t length);
+        void blend_color_wide_avx2(uint16_t * w, uint8_t * a, const uint8_t * color, size_t length);
+        void sample_table_plain(uint8_t * a, const uint8_t * table, const uint32_t * phases,
+                                uint32_t offset, uint32_t mask, size_t length);
+        void sample_table_avx2(uint8_t * a, const uint8_t * table, const uint32_t * phases,
+                               uint32_t offset, uint32_t mask, size_t length);
+        void accumulate_plain(uint16_t * sums, const uint8_t * a, size_t length);
+        void accumulate_sse2(uint16_t * sums, const uint8_t * a, size_t length);
+        void accumulate_avx2(uint16_t * sums, const uint8_t * a, size_t length);
+        void integrate_plain(float * position, float * velocity, float acceleration, float dt,
+                             size_t length);
+        void integrate_sse2(float * position, float * velocity, float acceleration, float dt,
+                            size_t length);
+        void integrate_avx2(float * position, float * velocity, float acceleration, float dt,
+                            size_t length);
 #ifdef __cplusplus
     } // namespace detail
 
@@ -80,18 +213,66 @@ void multiply(uint8_t * a, const uint8_t * b, size_t length);
                 { detail::blend_plain(a, b, length); }
             static inline void multiply(uint8_t * a, const uint8_t * b, size_t length)
                 { detail::multiply_plain(a, b, length); }
+            static inline void blend_wide(uint16_t * w, uint8_t * a, const uint8_t * b, size_t length)
+                { detail::blend_wide_plain(w, a, b, length); }
+            static inline void multiply_wide(uint16_t * w, uint8_t * a, const uint8_t * b, size_t length)
+                { detail::multiply_wide_plain(w, a, b, length); }
+            static inline void blend_color(uint8_t * a, const uint8_t * color, size_t length)
+                { detail::blend_color_plain(a, color, length); }
+            static inline void blend_color_wide(uint16_t * w, uint8_t * a, const uint8_t * color, size_t length)
+                { detail::blend_color_wide_plain(w, a, color, length); }
+            static inline void sample_table(uint8_t * a, const uint8_t * table, const uint32_t * phases,
+                                            uint32_t offset, uint32_t mask, size_t length)
+                { detail::sample_table_plain(a, table, phases, offset, mask, length); }
+            static inline void accumulate(uint16_t * sums, const uint8_t * a, size_t length)
+                { detail::accumulate_plain(sums, a, length); }
+            static inline void integrate(float * position, float * velocity, float acceleration,
+                                         float dt, size_t length)
+                { detail::integrate_plain(position, velocity, acceleration, dt, length); }
         };
         struct sse2 {
             static inline void blend(uint8_t * a, const uint8_t * b, size_t length)
                 { detail::blend_sse2(a, b, length); }
             static inline void multiply(uint8_t * a, const uint8_t * b, size_t length)
                 { detail::multiply_sse2(a, b, length); }
+            static inline void blend_wide(uint16_t * w, uint8_t * a, const uint8_t * b, size_t length)
+                { detail::blend_wide_sse2(w, a, b, length); }
+            static inline void multiply_wide(uint16_t * w, uint8_t * a, const uint8_t * b, size_t length)
+                { detail::multiply_wide_sse2(w, a, b, length); }
+            static inline void blend_color(uint8_t * a, const uint8_t * color, size_t length)
+                { detail::blend_color_sse2(a, color, length); }
+            static inline void blend_color_wide(uint16_t * w, uint8_t * a, const uint8_t * color, size_t length)
+                { detail::blend_color_wide_sse2(w, a, color, length); }
+            static inline void sample_table(uint8_t * a, const uint8_t * table, const uint32_t * phases,
+                                            uint32_t offset, uint32_t mask, size_t length)
+                { detail::sample_table_plain(a, table, phases, offset, mask, length); }
+            static inline void accumulate(uint16_t * sums, const uint8_t * a, size_t length)
+                { detail::accumulate_sse2(sums, a, length); }
+            static inline void integrate(float * position, float * velocity, float acceleration,
+                                         float dt, size_t length)
+                { detail::integrate_sse2(position, velocity, acceleration, dt, length); }
         };
         struct avx2 {
             static inline void blend(uint8_t * a, const uint8_t * b, size_t length)
                 { detail::blend_avx2(a, b, length); }
             static inline void multiply(uint8_t * a, const uint8_t * b, size_t length)
                 { detail::multiply_avx2(a, b, length); }
+            static inline void blend_wide(uint16_t * w, uint8_t * a, const uint8_t * b, size_t length)
+                { detail::blend_wide_avx2(w, a, b, length); }
+            static inline void multiply_wide(uint16_t * w, uint8_t * a, const uint8_t * b, size_t length)
+                { detail::multiply_wide_avx2(w, a, b, length); }
+            static inline void blend_color(uint8_t * a, const uint8_t * color, size_t length)
+                { detail::blend_color_avx2(a, color, length); }
+            static inline void blend_color_wide(uint16_t * w, uint8_t * a, const uint8_t * color, size_t length)
+                { detail::blend_color_wide_avx2(w, a, color, length); }
+            static inline void sample_table(uint8_t * a, const uint8_t * table, const uint32_t * phases,
+                                            uint32_t offset, uint32_t mask, size_t length)
+                { detail::sample_table_avx2(a, table, phases, offset, mask, length); }
+            static inline void accumulate(uint16_t * sums, const uint8_t * a, size_t length)
+                { detail::accumulate_avx2(sums, a, length); }
+            static inline void integrate(float * position, float * velocity, float acceleration,
+                                         float dt, size_t length)
+                { detail::integrate_avx2(position, velocity, acceleration, dt, length); }
         };
     } // namespace architecture
 
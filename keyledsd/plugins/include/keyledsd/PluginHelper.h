@@ -54,6 +54,18 @@ namespace detail {
             { return str; }
     };
 
+    template <> struct get_config<bool> {
+        using alternative = std::string;
+        using value_type = bool;
+        static std::optional<value_type> parse(const EffectService &, const alternative & str) {
+            if (str == "true" || str == "yes" || str == "on") { return true; }
+            if (str == "false" || str == "no" || str == "off") { return false; }
+            auto val = tools::parseNumber(str);
+            if (!val) { return std::nullopt; }
+            return *val != 0;
+        }
+    };
+
     template <typename T>
     struct get_config<T, typename std::enable_if_t<std::is_integral_v<T>>> {
         using alternative = std::string;
@@ -54,6 +54,10 @@ public:
 
         virtual int             createThread(lua_State * lua, int nargs) = 0;
         virtual void            destroyThread(lua_State * lua, Thread &) = 0;
+        virtual void            pauseThread(lua_State * lua, Thread &) = 0;
+        virtual void            resumeThread(lua_State * lua, Thread &) = 0;
+
+        virtual InterpolatorEngine & interpolators() = 0;
     protected:
         ~Controller() {}
     };
@@ -61,8 +65,11 @@ public:
 public:
                     Environment(lua_State * lua) : m_lua(lua) {}
 
-    void            openKeyleds(Controller *);
+    void            openKeyleds(const KeyDatabase &);
+    void            setController(Controller *);
+    void            releaseController(Controller *);
     Controller *    controller() const;
+    const KeyDatabase * keyDatabase() const;
 
     void            stepInterpolators(Interpolator::milliseconds elapsed)
         { Interpolator::stepAll(m_lua, elapsed); }
@@ -17,10 +17,15 @@
 #ifndef KEYLEDS_PLUGINS_LUA_LUAEFFECT_H_F038C73D
 #define KEYLEDS_PLUGINS_LUA_LUAEFFECT_H_F038C73D
 
+#include <chrono>
+#include <cstddef>
 #include <memory>
+#include <mutex>
+#include <vector>
 #include "keyledsd/PluginHelper.h"
 #include "lua/Environment.h"
 
+struct lua_Debug;
 struct lua_State;
 
 
@@ -28,10 +33,75 @@ namespace keyleds::plugin::lua {
 
 /****************************************************************************/
 
-class LuaEffect final : public SimpleEffect, public keyleds::lua::Environment::Controller
+/** Lua VM shared by all effects of a device.
+ * Libraries and types are loaded once, each effect then runs in its own sandbox
+ * environment. Effects lock the state while running code in it.
+ *
+ * Memory is accounted per effect: allocations are charged to the account that
+ * is current when they happen, and credited back to it when freed. The collector
+ * only runs when collect() is invoked, in between frames.
+ */
+class SharedState final
 {
     struct lua_state_deleter { void operator()(lua_State *) const; };
     using state_ptr = std::unique_ptr<lua_State, lua_state_deleter>;
+public:
+    using account_id = unsigned;
+    using clock = std::chrono::steady_clock;
+
+    /// Memory use of an effect, in bytes
+    struct Account final
+    {
+        std::size_t     used = 0;       ///< Currently allocated
+        std::size_t     peak = 0;       ///< Highest value used reached
+        std::size_t     limit = 0;      ///< Soft limit, owner is disabled if still past it after
+                                        ///  collecting garbage. Zero for unlimited.
+        bool            open = false;   ///< Owner still exists, else reusable once empty
+
+        bool            exceeded() const noexcept { return limit > 0 && used > limit; }
+    };
+    static constexpr account_id sharedAccount = 0;  ///< Libraries and common objects
+public:
+    explicit        SharedState(const KeyDatabase &);
+                    SharedState(const SharedState &) = delete;
+
+    lua_State *     get() const noexcept { return m_state.get(); }
+    std::mutex &    mutex() noexcept { return m_mutex; }
+
+    /// Whether memory accounting is available, it requires a custom allocator
+    bool            accounting() const noexcept { return m_accounting; }
+    account_id      openAccount(std::size_t limit);
+    void            closeAccount(account_id);
+    void            setAccount(account_id id) noexcept { m_currentAccount = id; }
+    Account         account(account_id id) const { return m_accounts[id]; }
+
+    /// Runs incremental collection steps until deadline, at least one if a cycle is due
+    void            collect(clock::time_point deadline);
+    void            collectAll();
+
+private:
+    static lua_State * createState(SharedState &);
+    static void *   allocate(void * data, void * ptr, std::size_t osize, std::size_t nsize);
+
+private:
+    std::vector<Account> m_accounts;    ///< Memory use per account, indexed by id
+    account_id      m_currentAccount;   ///< Account new allocations are charged to
+    bool            m_accounting;       ///< Set if state uses allocate()
+    bool            m_collecting;       ///< A collection cycle is in progress
+    std::size_t     m_nextCycle;        ///< Heap size that triggers next cycle, in KiB
+    state_ptr       m_state;            ///< Lua container all effects of the device run in
+    std::mutex      m_mutex;            ///< Held while running code in the container
+};
+
+/****************************************************************************/
+
+class LuaEffect final : public SimpleEffect, public keyleds::lua::Environment::Controller
+{
+    using state_ptr = std::shared_ptr<SharedState>;
+    using InterpolatorEngine = keyleds::lua::InterpolatorEngine;
+    friend class SharedState;
+public:
+    using cpu_time = std::chrono::nanoseconds;
 public:
                     LuaEffect(std::string name, EffectService &, state_ptr);
                     LuaEffect(const LuaEffect &) = delete;
@@ -39,7 +109,8 @@ public:
 
     // Factory method
     static std::unique_ptr<LuaEffect> create(const std::string & name, EffectService &,
-                                             const std::string & code);
+                                             state_ptr, const std::string & code,
+                                             std::string * bytecode = nullptr);
 
 public: // Effect interface for keyleds & lua init hook
     void            init();
@@ -47,6 +118,15 @@ public: // Effect interface for keyleds & lua init hook
     void            handleContextChange(const string_map &) override;
     void            handleGenericEvent(const string_map &) override;
     void            handleKeyEvent(const KeyDatabase::Key &, bool) override;
+    void            idle(std::chrono::steady_clock::time_point) override;
+    string_map      statistics() const override;
+
+    /// Total CPU time spent running the script
+    cpu_time        cpuTime() const noexcept { return m_cpuTime; }
+    /// Number of times the script exceeded its CPU budget
+    unsigned        overruns() const noexcept { return m_totalOverruns; }
+    /// Memory use of the script
+    SharedState::Account memory() const;
 
 public: // Environment::Controller interface for lua
     void            print(const std::string &) const override;
@@ -55,18 +135,61 @@ public: // Environment::Controller interface for lua
     void            destroyRenderTarget(RenderTarget *) override;
     int             createThread(lua_State * lua, int nargs) override;
     void            destroyThread(lua_State * lua, Thread &) override;
+    void            pauseThread(lua_State * lua, Thread &) override;
+    void            resumeThread(lua_State * lua, Thread &) override;
+    InterpolatorEngine & interpolators() override { return m_interpolators; }
+
+private:
+    /// Entry of the thread schedule, threads are looked up by id in thread list
+    struct ScheduleEntry final
+    {
+        Thread::microseconds    wakeTime;   ///< effect time at which thread should be awoken
+        Thread::sequence_type   sequence;   ///< entry is stale unless it matches thread's
+        int                     id;         ///< thread identifier
+
+        bool operator>(const ScheduleEntry & other) const noexcept
+            { return wakeTime > other.wakeTime ||
+                     (wakeTime == other.wakeTime && sequence > other.sequence); }
+    };
+    using schedule_list = std::vector<ScheduleEntry>;
 
 private:
+           std::unique_lock<std::mutex> enter();
+           bool     load(const std::string & code, std::string * bytecode);
            void     setupState();
            void     stepThreads(milliseconds);
            void     runThread(Thread &, lua_State * thread, int nargs);
-    static bool     pushHook(lua_State *, const char *);
+           void     scheduleThread(Thread &);
+           cpu_time beginRun(milliseconds budget);
+           void     endRun(cpu_time start);
+           bool     checkMemory();
+    static void     watchdogHook(lua_State *, lua_Debug *);
+           bool     pushHook(lua_State *, const char *);
     static bool     handleError(lua_State *, EffectService &, int code);
 private:
     std::string     m_name;         ///< Name of the effect, from config file
     EffectService & m_service;      ///< For communicating with keyleds
     state_ptr       m_state;        ///< Lua container this effect's scripts runs in
+    SharedState::account_id m_account; ///< Memory account the script is charged to
+    int             m_sandbox;      ///< Reference to the environment table of the script
+    int             m_threads;      ///< Reference to the table of running threads
     bool            m_enabled;      ///< Should render/event handlers be run?
+    InterpolatorEngine m_interpolators; ///< Color animations started by the script
+
+    Thread::microseconds m_clock;   ///< Effect time, advanced on every render
+    schedule_list   m_schedule;     ///< Min-heap of running threads by wake up time
+    Thread::sequence_type m_nextSequence; ///< Sequence number of next schedule entry
+
+    milliseconds    m_budget;       ///< CPU time allowed per script invocation, zero for unlimited
+    cpu_time        m_deadline;     ///< Thread CPU time at which running script is interrupted
+    bool            m_overrun;      ///< Set when the script exceeded its budget
+    unsigned        m_overruns;     ///< Overruns since script last ran unthrottled
+    unsigned        m_throttle;     ///< Render one frame out of that many
+    unsigned        m_skipped;      ///< Frames skipped since last render
+    milliseconds    m_skippedTime;  ///< Time elapsed during skipped frames
+    unsigned        m_cleanRuns;    ///< Script runs within budget since last overrun
+    cpu_time        m_cpuTime;      ///< Total CPU time spent running the script
+    unsigned        m_totalOverruns;///< Total number of overruns
 };
 
 /****************************************************************************/
@@ -18,6 +18,7 @@
 #define KEYLEDS_PLUGINS_LUA_LUA_INTERPOLATOR_H_BCD195FC
 
 #include <chrono>
+#include <vector>
 #include "lua/lua_types.h"
 #include "keyledsd/PluginHelper.h"
 
@@ -25,29 +26,81 @@ namespace keyleds::lua {
 
 /****************************************************************************/
 
+/** Running color interpolators of an effect.
+ * Interpolators are stored as parallel arrays so stepping them all is a tight
+ * loop over contiguous values. Each one is indexed by its render target and
+ * key, so at most one runs on any key. Each target is held by a reference,
+ * which is handed back for releasing once no interpolator runs on it anymore.
+ */
+class InterpolatorEngine final
+{
+public:
+    using milliseconds = std::chrono::duration<unsigned, std::milli>;
+    using serial_type = unsigned long;          ///< Identifies an interpolator run, 0 is none
+    using ref_list = std::vector<int>;
+public:
+    bool            holds(const RenderTarget *) const;
+    serial_type     start(RenderTarget *, int targetRef, unsigned key, milliseconds duration,
+                          RGBAColor startValue, RGBAColor finishValue);
+    bool            running(const RenderTarget *, unsigned key, serial_type) const;
+    void            stop(const RenderTarget *, unsigned key, serial_type);
+    void            step(milliseconds);
+    void            clear();
+
+    /// References to targets no longer in use, to be released by caller
+    ref_list &      released() { return m_released; }
+
+private:
+    struct Target final
+    {
+        RenderTarget *      target;     ///< Target interpolators write into, nullptr if entry is free
+        int                 ref;        ///< Reference keeping target alive
+        unsigned            count;      ///< Number of interpolators running on target
+        std::vector<int>    slots;      ///< Interpolator slot for each key, -1 if none
+    };
+    using target_list = std::vector<Target>;
+
+    int             findTarget(const RenderTarget *) const;
+    int             findSlot(const RenderTarget *, unsigned key, serial_type) const;
+    void            remove(std::size_t slot);
+
+private:
+    target_list             m_targets;      ///< Targets with running interpolators
+    std::vector<unsigned>   m_owner;        ///< Per slot: index of target in m_targets
+    std::vector<unsigned>   m_key;          ///< Per slot: key index within target
+    std::vector<serial_type> m_serial;      ///< Per slot: serial of running interpolator
+    std::vector<unsigned>   m_elapsed;      ///< Per slot: elapsed time in ms
+    std::vector<unsigned>   m_duration;     ///< Per slot: total duration in ms
+    std::vector<RGBAColor>  m_startValue;   ///< Per slot: color when elapsed == 0
+    std::vector<RGBAColor>  m_finishValue;  ///< Per slot: color when elapsed >= duration
+    std::vector<RGBAColor>  m_value;        ///< Per slot: current color
+    serial_type             m_nextSerial = 1;
+    ref_list                m_released;     ///< Target references to release
+};
+
 /** Color interpolator for animating keys.
- * This is a lua userdata-based object created using `fade()` from lua.
+ * This is a lua userdata-based object created using `fade()` from lua. It holds
+ * animation parameters, and a handle to its run once started. The animation
+ * itself runs in the effect's InterpolatorEngine.
  */
 struct Interpolator
 {
     enum {
         hasStartValueFlag = (1 << 1)
     };
-    using milliseconds = std::chrono::duration<unsigned, std::milli>;
+    using milliseconds = InterpolatorEngine::milliseconds;
 
-    int             id;             ///< luaL_ref id in registry
     unsigned        flags;          ///< See flags_type above
-    unsigned        index;          ///< Key index withing render target
     milliseconds    duration;       ///< Animation duration in ms
-    milliseconds    elapsed;        ///< Elapsed time in ms
     RGBAColor       startValue;     ///< Color when elapsed == 0
     RGBAColor       finishValue;    ///< Color when elapsed >= duration
+    const RenderTarget * target;    ///< Target of last run, only used for lookups
+    unsigned        index;          ///< Key index within render target of last run
+    InterpolatorEngine::serial_type serial; ///< Last run of the interpolator, 0 if never started
 
     static void start(lua_State *, unsigned keyIndex); // on stack: (interpolator, rendertarget) [-2, 0]
     static void stop(lua_State *);                     // on stack: (interpolator) [-1, 0]
     static void stepAll(lua_State *, milliseconds);
-
-    RGBAColor   value() const;
 };
 
 int luaNewInterpolator(lua_State *);
@@ -25,12 +25,29 @@ namespace keyleds::lua {
 
 /****************************************************************************/
 
-/// Registration of RGBAColor as a lua object
-template <> struct metatable<keyleds::RGBAColor>
+/** Color as seen by scripts, with channels nominally ranging from 0 to 1.
+ * With LuaJIT, script colors are FFI structs with this layout, so that compiled
+ * traces can do color math without allocating. Otherwise they are userdata.
+ */
+struct ScriptColor
+{
+    lua_Number  red;
+    lua_Number  green;
+    lua_Number  blue;
+    lua_Number  alpha;
+};
+
+/// Registration of ScriptColor as a lua object, for the userdata implementation
+template <> struct metatable<ScriptColor>
     { static const char * const name; static constexpr struct luaL_Reg * methods = nullptr;
       static const struct luaL_Reg meta_methods[]; struct weak_table : std::false_type{}; };
 
+void openColors(lua_State * lua);
+
 void lua_push(lua_State * lua, keyleds::RGBAColor);
+void lua_pushcolor(lua_State * lua, lua_Number red, lua_Number green,
+                   lua_Number blue, lua_Number alpha);
+bool lua_iscolor(lua_State * lua, int index);
 RGBAColor lua_tocolor(lua_State * lua, int index);
 RGBAColor lua_checkcolor(lua_State * lua, int index);
 
@@ -19,17 +19,35 @@
 
 #include "lua/lua_types.h"
 
-namespace keyleds { class RenderTarget; }
+namespace keyleds { class RenderTarget; struct RGBAColor; }
 
 namespace keyleds::lua {
 
 /****************************************************************************/
 
+void releaseRenderTargets(lua_State *, const void * controller);
+void openPixelAccess(lua_State *);
+
+/** Direct access to the colors of a render target, returned by `RenderTarget:pixels()`.
+ * With LuaJIT, views are FFI objects that compiled traces can access directly,
+ * this userdata is the fallback implementing the same interface.
+ */
+struct RenderTargetPixels
+{
+    RGBAColor *     data;       ///< First color of the render target
+    unsigned        size;       ///< Number of colors in render target
+};
+
 /// Registration of RenderTarget as a lua object
 template <> struct metatable<RenderTarget *>
     { static const char * const name; static const struct luaL_Reg methods[];
       static const struct luaL_Reg meta_methods[]; struct weak_table : std::false_type{}; };
 
+/// Registration of RenderTargetPixels as a lua object
+template <> struct metatable<RenderTargetPixels>
+    { static const char * const name; static const struct luaL_Reg methods[];
+      static const struct luaL_Reg meta_methods[]; struct weak_table : std::false_type{}; };
+
 /****************************************************************************/
 
 } // namespace keyleds::lua
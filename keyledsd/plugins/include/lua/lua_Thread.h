@@ -25,14 +25,19 @@ namespace keyleds::lua {
 /****************************************************************************/
 
 /** Lua coroutine-based thread.
+ * Scheduling is done by the controller, which keeps running threads ordered
+ * by wake up time.
  */
 struct Thread
 {
-    using milliseconds = std::chrono::duration<unsigned, std::milli>;
+    using microseconds = std::chrono::microseconds;
+    using sequence_type = unsigned long;
 
-    int             id;         ///< unique identifier
+    int             id;         ///< unique identifier, LUA_NOREF once destroyed
     bool            running;    ///< whether the thread is currently running (schedulable)
-    milliseconds    sleepTime;  ///< time until thread should be awoken
+    microseconds    wakeTime;   ///< effect time at which thread should be awoken
+    microseconds    sleepTime;  ///< time left to sleep when thread was paused
+    sequence_type   sequence;   ///< identifies current scheduling of the thread, 0 if none
 };
 
 int luaNewThread(lua_State *);
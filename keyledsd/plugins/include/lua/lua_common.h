@@ -33,6 +33,10 @@ extern const char * const tooManyArgumentsErrorMessage;
 
 bool lua_handleMethodIndex(lua_State * lua, int index, const luaL_Reg[]);
 int lua_keyError(lua_State * lua, int index);
+/// Pushes the FFI module, loading it once per state - LuaJIT only
+void lua_pushffi(lua_State * lua);
+/// Whether a number is neither infinite nor NaN, reliable despite -ffast-math
+bool isFinite(double value);
 
 /****************************************************************************/
 
@@ -0,0 +1,459 @@
+/* Keyleds -- Gaming keyboard tool
+ * Copyright (C) 2017 Julien Hartmann, juli1.hartmann@gmail.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "keyledsd/PluginHelper.h"
+#include "keyledsd/tools/accelerated.h"
+#include "keyledsd/tools/utils.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <unistd.h>
+#include <xcb/xcb.h>
+#include <xcb/shm.h>
+
+using namespace std::literals::chrono_literals;
+
+static constexpr unsigned maxRowsPerPass = 257;     // accumulate() sums may overflow past that
+
+/****************************************************************************/
+
+namespace keyleds::plugin {
+
+/** Background screen capture
+ *
+ * Grabs the root window of an X display through MIT-SHM at a fixed rate, on
+ * its own thread, and shrinks it into a grid of average colors. Grids are
+ * published to the render thread through a lock-free exchange of three buffers.
+ *
+ * The capture uses its own xcb connection. Unlike Xlib, xcb reports errors
+ * with the request that caused them, so a failed capture never reaches a
+ * process-wide error handler, nor the thread that owns the service's display.
+ */
+class ScreenCapture final
+{
+    using clock = std::chrono::steady_clock;
+    using milliseconds = std::chrono::milliseconds;
+    using grid_type = std::vector<RGBAColor>;
+    static constexpr unsigned freshFlag = 4;    ///< set in m_shared when it holds an unread grid
+
+    struct ConnectionDeleter { void operator()(xcb_connection_t * conn) const { xcb_disconnect(conn); } };
+    using connection_ptr = std::unique_ptr<xcb_connection_t, ConnectionDeleter>;
+    struct ReplyDeleter { void operator()(void * reply) const { std::free(reply); } };
+    template <typename T> using reply_ptr = std::unique_ptr<T, ReplyDeleter>;
+
+public:
+    /// Connects to display and sets up shared memory. Returns null and sets error on failure.
+    static std::unique_ptr<ScreenCapture> open(const std::string & displayName,
+                                               unsigned columns, unsigned rows,
+                                               milliseconds period, std::string & error)
+    {
+        const char * name = displayName.empty() ? std::getenv("DISPLAY") : displayName.c_str();
+        if (!name || !isLocal(name)) {
+            error = "MIT-SHM requires a local display";
+            return nullptr;
+        }
+        int screenNumber = 0;
+        auto connection = connection_ptr(xcb_connect(name, &screenNumber));
+        if (xcb_connection_has_error(connection.get())) {
+            error = std::string("cannot open display ") + name;
+            return nullptr;
+        }
+        auto version = reply_ptr<xcb_shm_query_version_reply_t>(xcb_shm_query_version_reply(
+            connection.get(), xcb_shm_query_version(connection.get()), nullptr
+        ));
+        if (!version) {
+            error = "display does not support MIT-SHM";
+            return nullptr;
+        }
+
+        auto screens = xcb_setup_roots_iterator(xcb_get_setup(connection.get()));
+        for (; screens.rem > 0 && screenNumber > 0; --screenNumber) { xcb_screen_next(&screens); }
+        if (screens.rem == 0) {
+            error = std::string("display ") + name + " has no such screen";
+            return nullptr;
+        }
+
+        auto capture = std::unique_ptr<ScreenCapture>(
+            new ScreenCapture(std::move(connection), *screens.data, columns, rows, period)
+        );
+        if (!capture->checkFormat(error)) { return nullptr; }
+        if (!capture->attach(screens.data->width_in_pixels, screens.data->height_in_pixels, error)) {
+            return nullptr;
+        }
+        if (::pipe2(capture->m_wakeup, O_CLOEXEC | O_NONBLOCK) < 0) {
+            error = "cannot create pipe";
+            return nullptr;
+        }
+        capture->m_thread = std::thread(&ScreenCapture::run, capture.get());
+        return capture;
+    }
+
+    ~ScreenCapture()
+    {
+        if (m_thread.joinable()) {
+            char byte = 0;
+            while (::write(m_wakeup[1], &byte, 1) < 0 && errno == EINTR) {}
+            m_thread.join();
+        }
+        if (m_wakeup[0] >= 0) {
+            ::close(m_wakeup[0]);
+            ::close(m_wakeup[1]);
+        }
+        detach();
+    }
+
+    /// Latest published grid, row by row. Only call from one thread.
+    const RGBAColor * grid()
+    {
+        if (m_shared.load(std::memory_order_relaxed) & freshFlag) {
+            m_front = m_shared.exchange(m_front, std::memory_order_acq_rel) & ~freshFlag;
+        }
+        return m_grids[m_front].data();
+    }
+
+private:
+    ScreenCapture(connection_ptr connection, const xcb_screen_t & screen,
+                  unsigned columns, unsigned rows, milliseconds period)
+     : m_connection(std::move(connection)), m_root(screen.root),
+       m_columns(columns), m_rows(rows), m_period(period)
+    {
+        for (auto & grid : m_grids) { grid.assign(columns * rows, RGBAColor{0, 0, 0, 0}); }
+    }
+
+    /// Checks the root window uses 32-bit true color pixels, and locates the red channel
+    bool checkFormat(std::string & error)
+    {
+        const auto * setup = xcb_get_setup(m_connection.get());
+        auto screens = xcb_setup_roots_iterator(setup);
+        while (screens.data->root != m_root) { xcb_screen_next(&screens); }
+        const auto & screen = *screens.data;
+
+        bool supported = false;
+        for (auto formats = xcb_setup_pixmap_formats_iterator(setup); formats.rem > 0;
+             xcb_format_next(&formats)) {
+            if (formats.data->depth == screen.root_depth) {
+                supported = formats.data->bits_per_pixel == 32;
+            }
+        }
+        const xcb_visualtype_t * visual = nullptr;
+        for (auto depths = xcb_screen_allowed_depths_iterator(&screen); depths.rem > 0 && !visual;
+             xcb_depth_next(&depths)) {
+            for (auto visuals = xcb_depth_visuals_iterator(depths.data); visuals.rem > 0;
+                 xcb_visualtype_next(&visuals)) {
+                if (visuals.data->visual_id == screen.root_visual) { visual = visuals.data; break; }
+            }
+        }
+        if (!supported || !visual || setup->image_byte_order != XCB_IMAGE_ORDER_LSB_FIRST
+            || visual->green_mask != 0xff00
+            || !((visual->red_mask == 0xff0000 && visual->blue_mask == 0xff)
+                 || (visual->red_mask == 0xff && visual->blue_mask == 0xff0000))) {
+            error = "unsupported visual, a 24-bit or 32-bit true color display is required";
+            return false;
+        }
+        m_redOffset = visual->red_mask == 0xff ? 0 : 2;
+        return true;
+    }
+
+    /// Creates an image of given size, in memory shared with the X server
+    bool attach(unsigned width, unsigned height, std::string & error)
+    {
+        m_width = width;
+        m_height = height;
+
+        // Segment is marked for deletion right away, so it goes away with the process
+        m_shmid = ::shmget(IPC_PRIVATE, std::size_t(width) * height * 4, IPC_CREAT | 0600);
+        if (m_shmid < 0) {
+            error = "cannot allocate shared memory";
+            return false;
+        }
+        void * data = ::shmat(m_shmid, nullptr, 0);
+        ::shmctl(m_shmid, IPC_RMID, nullptr);
+        if (data == reinterpret_cast<void *>(-1)) {
+            error = "cannot map shared memory";
+            return false;
+        }
+        m_data = static_cast<const uint8_t *>(data);
+
+        m_segment = xcb_generate_id(m_connection.get());
+        auto failure = reply_ptr<xcb_generic_error_t>(xcb_request_check(
+            m_connection.get(), xcb_shm_attach_checked(m_connection.get(), m_segment, uint32_t(m_shmid), 0)
+        ));
+        if (failure || xcb_connection_has_error(m_connection.get())) {
+            error = "cannot attach shared memory to display";
+            return false;
+        }
+        m_attached = true;
+
+        m_sums.resize(std::size_t(width) * 4);
+        return true;
+    }
+
+    void detach()
+    {
+        if (m_attached) {
+            std::free(xcb_request_check(m_connection.get(),
+                                        xcb_shm_detach_checked(m_connection.get(), m_segment)));
+            m_attached = false;
+        }
+        if (m_data) {
+            ::shmdt(m_data);
+            m_data = nullptr;
+        }
+    }
+
+    /// Grabs the root window into the shared image. Returns false if it failed.
+    bool capture()
+    {
+        auto * conn = m_connection.get();
+        auto failure = static_cast<xcb_generic_error_t *>(nullptr);
+        auto image = reply_ptr<xcb_shm_get_image_reply_t>(xcb_shm_get_image_reply(conn,
+            xcb_shm_get_image(conn, m_root, 0, 0, uint16_t(m_width), uint16_t(m_height),
+                              ~uint32_t(0), XCB_IMAGE_FORMAT_Z_PIXMAP, m_segment, 0),
+            &failure
+        ));
+        std::free(failure);
+        return image != nullptr;
+    }
+
+    /// Current size of the root window, if it can be queried
+    std::optional<std::pair<unsigned, unsigned>> screenSize()
+    {
+        auto * conn = m_connection.get();
+        auto geometry = reply_ptr<xcb_get_geometry_reply_t>(
+            xcb_get_geometry_reply(conn, xcb_get_geometry(conn, m_root), nullptr)
+        );
+        if (!geometry) { return std::nullopt; }
+        return std::make_pair(unsigned(geometry->width), unsigned(geometry->height));
+    }
+
+    /// Whether a display name designates the local machine, a requirement for MIT-SHM
+    static bool isLocal(const std::string & name)
+    {
+        auto colon = name.rfind(':');
+        if (colon == std::string::npos) { return false; }
+        auto host = name.substr(0, colon);
+        if (auto slash = host.rfind('/'); slash != std::string::npos) { host = host.substr(slash + 1); }
+        return host.empty() || host == "unix" || host == "localhost";
+    }
+
+    void run()
+    {
+        auto nextCapture = clock::now();
+        for (;;) {
+            if (!sleepUntil(nextCapture)) { return; }
+            nextCapture = std::max(nextCapture + m_period, clock::now());
+
+            if (!capture()) {
+                // Capture fails when the screen was resized, re-create the image to match
+                std::string error;
+                auto size = screenSize();
+                if (size && *size != std::make_pair(m_width, m_height)) {
+                    detach();
+                    if (!attach(size->first, size->second, error)) { size.reset(); }
+                }
+                if (!size) {
+                    detach();
+                    sleepUntil(clock::time_point::max());   // nothing to capture, idle until stopped
+                    return;
+                }
+                continue;
+            }
+            downscale(m_grids[m_back]);
+            m_back = m_shared.exchange(m_back | freshFlag, std::memory_order_acq_rel) & ~freshFlag;
+        }
+    }
+
+    /// Averages the image over each grid cell
+    void downscale(grid_type & grid)
+    {
+        const auto width = m_width;
+        const auto height = m_height;
+        const auto * data = m_data;
+
+        for (unsigned row = 0; row < m_rows; ++row) {
+            // Vertical pass, skipping rows evenly on tall cells so sums cannot overflow
+            const unsigned top = row * height / m_rows;
+            const unsigned bottom = std::max((row + 1) * height / m_rows, top + 1);
+            const unsigned step = (bottom - top + maxRowsPerPass - 1) / maxRowsPerPass;
+            unsigned count = 0;
+            std::fill(m_sums.begin(), m_sums.end(), uint16_t(0));
+            for (unsigned y = top; y < bottom; y += step) {
+                tools::accumulate(m_sums.data(), data + std::size_t(y) * width * 4, m_sums.size());
+                ++count;
+            }
+
+            // Horizontal pass, summing accumulated pixels of each cell
+            for (unsigned column = 0; column < m_columns; ++column) {
+                const unsigned left = column * width / m_columns;
+                const unsigned right = std::max((column + 1) * width / m_columns, left + 1);
+                uint32_t sum[4] = {0, 0, 0, 0};
+                for (unsigned x = left; x < right; ++x) {
+                    for (unsigned channel = 0; channel < 4; ++channel) { sum[channel] += m_sums[4 * x + channel]; }
+                }
+                const auto total = count * (right - left);
+                grid[row * m_columns + column] = RGBAColor{
+                    RGBAColor::channel_type(sum[m_redOffset] / total),
+                    RGBAColor::channel_type(sum[1] / total),
+                    RGBAColor::channel_type(sum[2 - m_redOffset] / total),
+                    255
+                };
+            }
+        }
+    }
+
+    /// Waits until given time point. Returns false if stop was requested meanwhile.
+    bool sleepUntil(clock::time_point when)
+    {
+        for (;;) {
+            auto now = clock::now();
+            int timeout = -1;
+            if (when != clock::time_point::max()) {
+                if (when <= now) { return true; }
+                timeout = int(std::chrono::ceil<milliseconds>(when - now).count());
+            }
+            struct pollfd fds = { m_wakeup[0], POLLIN, 0 };
+            auto ret = ::poll(&fds, 1, timeout);
+            if (ret > 0) { return false; }
+            if (ret < 0 && errno != EINTR) { return false; }
+        }
+    }
+
+private:
+    connection_ptr          m_connection;       ///< connection used by capture thread only
+    const xcb_window_t      m_root;             ///< root window of captured screen
+    const unsigned          m_columns;          ///< grid width, in cells
+    const unsigned          m_rows;             ///< grid height, in cells
+    const milliseconds      m_period;           ///< minimum time between captures
+    int                     m_shmid = -1;       ///< shared memory identifier
+    const uint8_t *         m_data = nullptr;   ///< full screen capture, 4 bytes per pixel
+    unsigned                m_width = 0;        ///< capture width, in pixels
+    unsigned                m_height = 0;       ///< capture height, in pixels
+    xcb_shm_seg_t           m_segment = 0;      ///< X server's name for shared memory
+    bool                    m_attached = false; ///< whether X server mapped m_segment
+    unsigned                m_redOffset = 2;    ///< byte offset of red channel in pixels
+    std::vector<uint16_t>   m_sums;             ///< vertical box filter sums, one per byte of a row
+
+    std::array<grid_type, 3> m_grids;           ///< front, back and shared grids
+    std::atomic<unsigned>   m_shared = 1;       ///< grid available for exchange, with freshFlag
+    unsigned                m_back = 0;         ///< grid owned by capture thread
+    unsigned                m_front = 2;        ///< grid owned by render thread
+
+    int                     m_wakeup[2] = {-1, -1}; ///< pipe signaling capture thread to stop
+    std::thread             m_thread;
+};
+
+/****************************************************************************/
+
+class AmbientEffect final : public SimpleEffect
+{
+    using KeyGroup = KeyDatabase::KeyGroup;
+
+public:
+    AmbientEffect(EffectService & service, std::unique_ptr<ScreenCapture> capture,
+                  unsigned columns, unsigned rows)
+     : m_capture(std::move(capture)),
+       m_fade(getConfig<milliseconds>(service, "fade").value_or(300ms)),
+       m_buffer(service.keyDB().size())
+    {
+        const auto & keyDB = service.keyDB();
+        auto addKey = [&](const KeyDatabase::Key & key) {
+            auto center = keyDB.center(key);
+            auto column = std::min(unsigned(center.x * float(columns)), columns - 1);
+            auto row = std::min(unsigned(center.y * float(rows)), rows - 1);
+            m_keys.push_back(key.index);
+            m_cells.push_back(row * columns + column);
+        };
+        if (auto keys = getConfig<KeyGroup>(service, "group"); keys) {
+            for (const auto & key : *keys) { addKey(key); }
+        } else {
+            for (const auto & key : keyDB) { addKey(key); }
+        }
+        std::fill(m_buffer.begin(), m_buffer.end(), RGBAColor{0, 0, 0, 0});
+    }
+
+    static AmbientEffect * create(EffectService & service)
+    {
+        const auto & bounds = service.keyDB().bounds();
+        if (!(bounds.x0 < bounds.x1 && bounds.y0 < bounds.y1)) {
+            service.log(logging::info::value, "effect requires a valid layout");
+            return nullptr;
+        }
+
+        // Grid has the keyboard's aspect ratio, the screen is stretched onto it
+        const auto columns = std::clamp(getConfig<unsigned>(service, "columns").value_or(24u), 1u, 256u);
+        const auto rows = std::clamp(
+            unsigned(std::lround(float(columns) * float(bounds.y1 - bounds.y0) / float(bounds.x1 - bounds.x0))),
+            1u, 256u
+        );
+        const auto rate = std::clamp(getConfig<unsigned>(service, "rate").value_or(10u), 1u, 60u);
+
+        std::string error;
+        auto capture = ScreenCapture::open(getConfig<std::string>(service, "display").value_or(std::string()),
+                                           columns, rows, milliseconds(1000 / rate), error);
+        if (!capture) {
+            service.log(logging::error::value, error.c_str());
+            return nullptr;
+        }
+        return new AmbientEffect(service, std::move(capture), columns, rows);
+    }
+
+    void render(milliseconds elapsed, RenderTarget & target) override
+    {
+        // Move towards captured colors, so key colors do not jump at each capture
+        const auto * grid = m_capture->grid();
+        const unsigned ratio = m_fade > 0ms
+                             ? unsigned(std::min<milliseconds::rep>(256 * elapsed.count() / m_fade.count(), 256))
+                             : 256u;
+        for (std::size_t idx = 0; idx < m_keys.size(); ++idx) {
+            auto & color = m_buffer[m_keys[idx]];
+            const auto & goal = grid[m_cells[idx]];
+            auto mix = [ratio](int from, int to) {
+                auto step = (to - from) * int(ratio) / 256;
+                if (step == 0 && to != from) { step = to > from ? 1 : -1; }
+                return RGBAColor::channel_type(from + step);
+            };
+            color = RGBAColor{mix(color.red, goal.red), mix(color.green, goal.green),
+                              mix(color.blue, goal.blue), mix(color.alpha, goal.alpha)};
+        }
+        blend(target, m_buffer);
+    }
+
+private:
+    std::unique_ptr<ScreenCapture>  m_capture;  ///< capture thread and its latest grid
+    const milliseconds              m_fade;     ///< time to catch up with a new capture
+    std::vector<KeyDatabase::Key::index_type> m_keys;   ///< keys the effect applies to
+    std::vector<unsigned>           m_cells;    ///< grid cell each key in m_keys shows
+    RenderTarget                    m_buffer;   ///< this plugin's rendered state
+};
+
+KEYLEDSD_SIMPLE_EFFECT("ambient", AmbientEffect);
+
+} // namespace keyleds::plugin
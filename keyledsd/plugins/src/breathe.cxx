@@ -17,13 +17,18 @@
 #include "keyledsd/PluginHelper.h"
 #include "keyledsd/tools/utils.h"
 #include <algorithm>
+#include <array>
 #include <cmath>
 
 using namespace std::literals::chrono_literals;
 
+static constexpr unsigned int accuracy = 1024;
 static constexpr auto pi = 3.14159265358979f;
 static constexpr auto white = keyleds::RGBAColor{255, 255, 255, 255};
 
+static_assert(accuracy && ((accuracy & (accuracy - 1)) == 0),
+              "accuracy must be a power of two");
+
 /****************************************************************************/
 
 namespace keyleds::plugin {
@@ -35,12 +40,15 @@ public:
     explicit BreatheEffect(EffectService & service, milliseconds period)
      : m_period(period),
        m_keys(getConfig<KeyGroup>(service, "group")),
-       m_buffer(*service.createRenderTarget())
+       m_color(getConfig<RGBAColor>(service, "color").value_or(white)),
+       m_alphas(generateAlphas(m_color.alpha)),
+       m_buffer(m_keys ? service.createRenderTarget() : nullptr)
     {
-        auto color = getConfig<RGBAColor>(service, "color").value_or(white);
-        std::swap(color.alpha, m_alpha);
-
-        std::fill(m_buffer.begin(), m_buffer.end(), color);
+        if (m_buffer) {
+            auto transparent = m_color;
+            transparent.alpha = 0;
+            std::fill(m_buffer->begin(), m_buffer->end(), transparent);
+        }
     }
 
     static BreatheEffect * create(EffectService & service)
@@ -58,24 +66,41 @@ public:
         m_time += elapsed;
         if (m_time >= m_period) { m_time -= m_period; }
 
-        float t = float(m_time.count()) / float(m_period.count());
-        float alphaf = -std::cos(2.0f * pi * t);
-        auto alpha = RGBAColor::channel_type(m_alpha * (unsigned(128.0f * alphaf) + 128) / 256);
+        auto alpha = m_alphas[accuracy * m_time / m_period];
 
-        if (m_keys) {
-            for (const auto & key : *m_keys) { m_buffer[key.index].alpha = alpha; }
-        } else {
-            for (auto & key : m_buffer) { key.alpha = alpha; }
+        if (!m_buffer) {
+            // Whole keyboard breathes the same color, no need for a source buffer
+            auto color = m_color;
+            color.alpha = alpha;
+            blend(target, color);
+            return;
+        }
+        for (const auto & key : *m_keys) { (*m_buffer)[key.index].alpha = alpha; }
+        blend(target, *m_buffer);
+    }
+
+private:
+    using alpha_table = std::array<RGBAColor::channel_type, accuracy>;
+
+    /// Precomputes the breathing curve: alpha goes from 0 to peak and back over a cycle
+    static alpha_table generateAlphas(RGBAColor::channel_type peak)
+    {
+        alpha_table table;
+        for (unsigned idx = 0; idx < accuracy; ++idx) {
+            float t = float(idx) / float(accuracy);
+            float level = (1.0f - std::cos(2.0f * pi * t)) / 2.0f;
+            table[idx] = RGBAColor::channel_type(std::lround(float(peak) * level));
         }
-        blend(target, m_buffer);
+        return table;
     }
 
 private:
     const milliseconds              m_period;   ///< total duration of a cycle
     const std::optional<KeyGroup>   m_keys;     ///< what keys the effect applies to
-    uint8_t                         m_alpha = 0;///< peak alpha value through the breathing cycle
+    const RGBAColor                 m_color;    ///< color at peak of the breathing cycle
+    const alpha_table               m_alphas;   ///< alpha value through the cycle, by phase
 
-    RenderTarget &  m_buffer;           ///< this plugin's rendered state
+    RenderTarget *  m_buffer;           ///< this plugin's rendered state, only used with a key group
     milliseconds    m_time = 0ms;       ///< time since beginning of current cycle
 };
 
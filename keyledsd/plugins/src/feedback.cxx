@@ -17,12 +17,12 @@
 #include "keyledsd/PluginHelper.h"
 #include "keyledsd/tools/utils.h"
 #include <algorithm>
+#include <cstdint>
 #include <vector>
 
 using namespace std::literals::chrono_literals;
 using keyleds::tools::parseDuration;
 
-static constexpr auto transparent = keyleds::RGBAColor{0, 0, 0, 0};
 static constexpr auto white = keyleds::RGBAColor{255, 255, 255, 255};
 
 /****************************************************************************/
@@ -42,23 +42,28 @@ public:
       : m_color(getConfig<RGBAColor>(service, "color").value_or(white)),
         m_sustain(getConfig<milliseconds>(service, "sustain").value_or(750ms)),
         m_decay(getConfig<milliseconds>(service, "decay").value_or(500ms)),
-        m_buffer(*service.createRenderTarget())
-    {
-        std::fill(m_buffer.begin(), m_buffer.end(), transparent);
-    }
+        m_buffer(service.keyDB().size())
+    {}
 
     void render(milliseconds elapsed, RenderTarget & target) override
     {
         const auto lifetime = m_sustain + m_decay;
 
-        for (auto & keyPress : m_presses) {
-            RGBAColor color;
+        for (auto & keyPress : m_presses) { keyPress.age += elapsed; }
+        m_presses.erase(
+            std::remove_if(m_presses.begin(), m_presses.end(),
+                           [lifetime](const auto & keyPress){ return keyPress.age >= lifetime; }),
+            m_presses.end()
+        );
 
-            keyPress.age += elapsed;
+        // Only keys pressed recently are touched, the rest of the keyboard is left alone
+        m_indices.resize(m_presses.size());
+        for (std::size_t idx = 0; idx < m_presses.size(); ++idx) {
+            const auto & keyPress = m_presses[idx];
             if (keyPress.age <= m_sustain) {
-                color = m_color;
-            } else if (keyPress.age < lifetime) {
-                color = {
+                m_buffer[idx] = m_color;
+            } else {
+                m_buffer[idx] = {
                     m_color.red,
                     m_color.green,
                     m_color.blue,
@@ -66,17 +71,10 @@ public:
                         m_color.alpha * (lifetime - keyPress.age) / m_decay
                     )
                 };
-            } else {
-                color = transparent;
             }
-            m_buffer[keyPress.key->index] = color;
+            m_indices[idx] = uint32_t(keyPress.key->index);
         }
-        m_presses.erase(
-            std::remove_if(m_presses.begin(), m_presses.end(),
-                           [lifetime](const auto & keyPress){ return keyPress.age >= lifetime; }),
-            m_presses.end()
-        );
-        blend(target, m_buffer);
+        blend(target, m_buffer, m_indices.data(), m_indices.size());
     }
 
     void handleKeyEvent(const KeyDatabase::Key & key, bool) override
@@ -95,7 +93,8 @@ private:
     const milliseconds  m_sustain;      ///< how long key remains at full color
     const milliseconds  m_decay;        ///< how long it takes for keys to fade out
 
-    RenderTarget &      m_buffer;       ///< this plugin's rendered state
+    RenderTarget        m_buffer;       ///< current color of each keypress, at most one per key
+    std::vector<uint32_t> m_indices;    ///< key index of each keypress
     std::vector<KeyPress> m_presses;    ///< list of recent keypresses still drawn
 };
 
@@ -0,0 +1,198 @@
+/* Keyleds -- Gaming keyboard tool
+ * Copyright (C) 2017 Julien Hartmann, juli1.hartmann@gmail.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "keyledsd/PluginHelper.h"
+#include "keyledsd/tools/utils.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std::literals::chrono_literals;
+
+static constexpr unsigned int gradientSize = 256;   // entry 0 is for keys never pressed
+static constexpr uint32_t pressWeight = 256;        // counter increment, leaves room for decay
+static constexpr unsigned decaySteps = 16;          // decay steps per half-life
+static constexpr uint32_t decayFactor = 981;        // 2^(-1/16), as a fraction of 1024
+static constexpr uint32_t maximumDecayFactor = 1002; // 2^(-1/32), normalizer cools half as fast
+static constexpr auto blue = keyleds::RGBAColor{0, 0, 255, 255};
+static constexpr auto red = keyleds::RGBAColor{255, 0, 0, 255};
+
+static_assert(gradientSize && ((gradientSize & (gradientSize - 1)) == 0),
+              "gradientSize must be a power of two");
+
+/****************************************************************************/
+
+namespace keyleds::plugin {
+
+class HeatmapEffect final : public SimpleEffect
+{
+    /// Key press counters for a context
+    struct Context
+    {
+        std::string             id;         ///< window class and instance
+        std::vector<uint32_t>   counts;     ///< one per key, in units of pressWeight
+        uint32_t                maximum;    ///< normalizer, at least the highest value in counts
+    };
+    using gradient_table = std::array<RGBAColor, gradientSize>;
+
+public:
+    explicit HeatmapEffect(EffectService & service)
+     : m_keyCount(service.keyDB().size()),
+       m_gradient(generateGradient(getConfig<RGBAColor>(service, "cold").value_or(blue),
+                                   getConfig<RGBAColor>(service, "hot").value_or(red))),
+       m_maxContexts(std::max(getConfig<unsigned>(service, "contexts").value_or(16u), 1u)),
+       m_decayStep(getConfig<milliseconds>(service, "decay").value_or(0ms) / decaySteps),
+       m_buffer(m_keyCount),
+       m_indices(m_buffer.capacity(), 0)
+    {
+        m_contexts.push_back(Context{std::string(1, '\0'), std::vector<uint32_t>(m_keyCount, 0), 0});
+        update();
+    }
+
+    void render(milliseconds elapsed, RenderTarget & target) override
+    {
+        if (m_decayStep > 0ms) {
+            m_decayTime += elapsed;
+            if (m_decayTime >= m_decayStep) {
+                while (m_decayTime >= m_decayStep) {
+                    decay(m_contexts.front());
+                    m_decayTime -= m_decayStep;
+                }
+                m_dirty = true;
+            }
+        }
+        if (m_dirty) { update(); }
+        blend(target, m_buffer);
+    }
+
+    void handleContextChange(const string_map & data) override
+    {
+        std::string id;
+        for (const auto & [key, value] : data) { if (key == "class") { id = value; } }
+        id.push_back('\0');
+        for (const auto & [key, value] : data) { if (key == "instance") { id += value; } }
+
+        // Most recently used context is kept at front
+        auto it = std::find_if(m_contexts.begin(), m_contexts.end(),
+                               [&](const auto & context) { return context.id == id; });
+        if (it == m_contexts.begin()) { return; }
+        if (it == m_contexts.end()) {
+            if (m_contexts.size() < m_maxContexts) {
+                m_contexts.push_back(Context{{}, std::vector<uint32_t>(m_keyCount), 0});
+            }
+            it = std::prev(m_contexts.end());   // recycle least recently used context
+            it->id = std::move(id);
+            std::fill(it->counts.begin(), it->counts.end(), 0);
+            it->maximum = 0;
+        }
+        std::rotate(m_contexts.begin(), it, std::next(it));
+        m_dirty = true;
+    }
+
+    void handleGenericEvent(const string_map & data) override
+    {
+        auto get = [&data](const char * name) -> const std::string * {
+            auto it = std::find_if(data.begin(), data.end(),
+                                   [name](const auto & item) { return item.first == name; });
+            return it != data.end() ? &it->second : nullptr;
+        };
+        const auto * effect = get("effect");
+        const auto * command = get("command");
+        if (!effect || *effect != "heatmap" || !command || *command != "reset") { return; }
+
+        m_contexts.erase(std::next(m_contexts.begin()), m_contexts.end());
+        std::fill(m_contexts.front().counts.begin(), m_contexts.front().counts.end(), 0);
+        m_contexts.front().maximum = 0;
+        m_dirty = true;
+    }
+
+    void handleKeyEvent(const KeyDatabase::Key & key, bool press) override
+    {
+        if (!press) { return; }
+        auto & context = m_contexts.front();
+        auto & count = context.counts[key.index];
+        count += pressWeight;
+        context.maximum = std::max(context.maximum, count);
+        m_dirty = true;
+    }
+
+private:
+    /// Maps counters to gradient entries and samples the gradient into the buffer
+    void update()
+    {
+        const auto & context = m_contexts.front();
+        for (std::size_t idx = 0; idx < m_keyCount; ++idx) {
+            auto count = uint64_t(context.counts[idx]);
+            auto entry = count > 0
+                       ? std::max(uint32_t(count * (gradientSize - 1) / context.maximum), 1u)
+                       : 0u;
+            // sample_table looks up (offset - phase), negating entries makes it a plain lookup
+            m_indices[idx] = 0u - entry;
+        }
+        tools::sample_table(reinterpret_cast<uint8_t *>(m_buffer.data()),
+                            reinterpret_cast<const uint8_t *>(m_gradient.data()),
+                            m_indices.data(), 0, gradientSize - 1, m_buffer.capacity());
+        m_dirty = false;
+    }
+
+    /// Multiplies all counters by decayFactor, so they halve every decaySteps calls.
+    /// The maximum decays slower, so keys cool down relative to it instead of keeping
+    /// their color until they reach zero.
+    static void decay(Context & context)
+    {
+        uint32_t highest = 0;
+        for (auto & count : context.counts) {
+            count = uint32_t(uint64_t(count) * decayFactor / 1024);
+            highest = std::max(highest, count);
+        }
+        context.maximum = std::max(uint32_t(uint64_t(context.maximum) * maximumDecayFactor / 1024),
+                                   highest);
+    }
+
+    static gradient_table generateGradient(RGBAColor cold, RGBAColor hot)
+    {
+        gradient_table table;
+        table[0] = RGBAColor{0, 0, 0, 0};
+        for (unsigned idx = 1; idx < gradientSize; ++idx) {
+            float ratio = float(idx - 1) / float(gradientSize - 2);
+            table[idx] = RGBAColor{
+                RGBAColor::channel_type(cold.red * (1.0f - ratio) + hot.red * ratio),
+                RGBAColor::channel_type(cold.green * (1.0f - ratio) + hot.green * ratio),
+                RGBAColor::channel_type(cold.blue * (1.0f - ratio) + hot.blue * ratio),
+                RGBAColor::channel_type(cold.alpha * (1.0f - ratio) + hot.alpha * ratio),
+            };
+        }
+        return table;
+    }
+
+private:
+    const std::size_t       m_keyCount;     ///< number of keys on device
+    const gradient_table    m_gradient;     ///< colors from cold to hot, after a transparent entry
+    const std::size_t       m_maxContexts;  ///< how many contexts are remembered
+    const milliseconds      m_decayStep;    ///< time between decay steps, zero to disable decay
+
+    std::vector<Context>    m_contexts;     ///< known contexts, most recently used first
+    RenderTarget            m_buffer;       ///< this plugin's rendered state
+    std::vector<uint32_t>   m_indices;      ///< negated gradient entry of each key
+    milliseconds            m_decayTime = 0ms; ///< time elapsed since last decay step
+    bool                    m_dirty = false;///< counters changed since buffer was rendered
+};
+
+KEYLEDSD_SIMPLE_EFFECT("heatmap", HeatmapEffect);
+
+} // namespace keyleds::plugin
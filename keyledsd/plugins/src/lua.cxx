@@ -22,6 +22,7 @@
 #include <vector>
 
 using keyleds::plugin::lua::LuaEffect;
+using keyleds::plugin::lua::SharedState;
 
 namespace keyleds::plugin {
 
@@ -32,23 +33,44 @@ class LuaPlugin final : public Plugin
         std::unique_ptr<LuaEffect>  effect;
     };
     using state_list = std::vector<StateInfo>;
+    struct ScriptInfo {
+        std::string name;           ///< Effect name the script was loaded for
+        std::string source;         ///< Source code, to detect changes
+        std::string bytecode;       ///< Compiled script
+    };
+    using script_list = std::vector<ScriptInfo>;
+    using shared_state_map = std::vector<std::pair<std::string, std::weak_ptr<SharedState>>>;
 
 public:
     explicit LuaPlugin(const char *) {}
 
     Effect * createEffect(const std::string & name, EffectService & service) override
     {
-        auto source = service.getFile("effects/" + name + ".lua");
+        const auto & source = service.getFile("effects/" + name + ".lua");
         if (source.empty()) { return nullptr; }
 
+        // Reuse compiled script if source did not change
+        auto sit = std::find_if(m_scripts.begin(), m_scripts.end(),
+                                [&name](const auto & script) { return script.name == name; });
+        bool compiled = sit != m_scripts.end() && sit->source == source;
+
         StateInfo info;
+        std::string bytecode;
         try {
-            info.effect = LuaEffect::create(name, service, source);
+            info.effect = LuaEffect::create(name, service, sharedState(service),
+                                            compiled ? sit->bytecode : source,
+                                            compiled ? nullptr : &bytecode);
         } catch (std::exception & err) {
             service.log(logging::error::value, err.what());
             return nullptr;
         }
 
+        if (!compiled && !bytecode.empty()) {
+            if (sit == m_scripts.end()) { sit = m_scripts.insert(sit, ScriptInfo{name, {}, {}}); }
+            sit->source = source;
+            sit->bytecode = std::move(bytecode);
+        }
+
         service.getFile({});    // let the service clear file data
 
         if (!info.effect) { return nullptr; }
@@ -66,9 +88,30 @@ public:
         m_states.pop_back();
     }
 
+private:
+    /// Returns the VM effects of the service's device run in, creating it if needed
+    std::shared_ptr<SharedState> sharedState(EffectService & service)
+    {
+        m_sharedStates.erase(
+            std::remove_if(m_sharedStates.begin(), m_sharedStates.end(),
+                           [](const auto & item) { return item.second.expired(); }),
+            m_sharedStates.end()
+        );
+
+        const auto & serial = service.deviceSerial();
+        auto it = std::find_if(m_sharedStates.begin(), m_sharedStates.end(),
+                               [&serial](const auto & item) { return item.first == serial; });
+        if (it != m_sharedStates.end()) { return it->second.lock(); }
+
+        auto state = std::make_shared<SharedState>(service.keyDB());
+        m_sharedStates.emplace_back(serial, state);
+        return state;
+    }
 
 private:
-    state_list  m_states;
+    state_list          m_states;
+    script_list         m_scripts;      ///< Compiled scripts, by effect name
+    shared_state_map    m_sharedStates; ///< Per-device VMs, by device serial
 };
 
 KEYLEDSD_EXPORT_PLUGIN("lua", LuaPlugin);
@@ -25,6 +25,7 @@
 namespace keyleds::lua {
 
 static void * const controllerToken = const_cast<void **>(&controllerToken);
+static void * const databaseToken = const_cast<void **>(&databaseToken);
 
 /****************************************************************************/
 // Global scope
@@ -49,7 +50,7 @@ static int luaPrint(lua_State * lua)        // (...) => ()
     return 0;
 }
 
-static int luaToColor(lua_State * lua)      // (any) => (table)
+static int luaToColor(lua_State * lua)      // (any) => (color)
 {
     int nargs = lua_gettop(lua);
     if (nargs == 1) {
@@ -68,17 +69,10 @@ static int luaToColor(lua_State * lua)      // (any) => (table)
             }
         }
     } else if (3 <= nargs && nargs <= 4) {
-        if (nargs == 3) { lua_pushnumber(lua, 1.0); }
-        if (lua_isnumber(lua, 1) && lua_isnumber(lua, 2) &&
-            lua_isnumber(lua, 3) && lua_isnumber(lua, 4)) {
-            lua_createtable(lua, 4, 0);
-            luaL_getmetatable(lua, metatable<RGBAColor>::name);
-            lua_setmetatable(lua, -2);
-            lua_insert(lua, 1);
-            lua_rawseti(lua, 1, 4);
-            lua_rawseti(lua, 1, 3);
-            lua_rawseti(lua, 1, 2);
-            lua_rawseti(lua, 1, 1);
+        if (lua_isnumber(lua, 1) && lua_isnumber(lua, 2) && lua_isnumber(lua, 3) &&
+            (nargs == 3 || lua_isnumber(lua, 4))) {
+            lua_pushcolor(lua, lua_tonumber(lua, 1), lua_tonumber(lua, 2), lua_tonumber(lua, 3),
+                          nargs == 3 ? 1.0 : lua_tonumber(lua, 4));
             return 1;
         }
     }
@@ -110,14 +104,18 @@ static const luaL_Reg keyledsGlobals[] = {
 
 const void * const Environment::waitToken = &Environment::waitToken;
 
-void Environment::openKeyleds(Controller * controller)
+/** Load keyleds library into the global environment.
+ * Effects share the global environment, each one running in its own sandbox.
+ * @param db Key database of the device all effects run on.
+ */
+void Environment::openKeyleds(const KeyDatabase & db)
 {
     SAVE_TOP(m_lua);
 
-    // Save controller pointer
-    lua_pushlightuserdata(m_lua, controllerToken);
-    lua_pushlightuserdata(m_lua, static_cast<void *>(controller));
-    lua_rawset(m_lua, LUA_GLOBALSINDEX);
+    // Save key database pointer
+    lua_pushlightuserdata(m_lua, databaseToken);
+    lua_pushlightuserdata(m_lua, const_cast<KeyDatabase *>(&db));
+    lua_rawset(m_lua, LUA_REGISTRYINDEX);
 
     // Register types
     registerType<Interpolator>(m_lua);
@@ -125,8 +123,11 @@ void Environment::openKeyleds(Controller * controller)
     registerType<const KeyDatabase::KeyGroup *>(m_lua);
     registerType<const KeyDatabase::Key *>(m_lua);
     registerType<RenderTarget *>(m_lua);
-    registerType<RGBAColor>(m_lua);
+    registerType<RenderTargetPixels>(m_lua);
+    registerType<ScriptColor>(m_lua);
     registerType<Thread>(m_lua);
+    openColors(m_lua);
+    openPixelAccess(m_lua);
 
     // Register globals
     lua_pushvalue(m_lua, LUA_GLOBALSINDEX);
@@ -136,19 +137,47 @@ void Environment::openKeyleds(Controller * controller)
     CHECK_TOP(m_lua, 0);
 }
 
+/// Sets the controller that is about to run code, nullptr when done
+void Environment::setController(Controller * controller)
+{
+    lua_pushlightuserdata(m_lua, controllerToken);
+    lua_pushlightuserdata(m_lua, static_cast<void *>(controller));
+    lua_rawset(m_lua, LUA_REGISTRYINDEX);
+}
+
+/// Forgets objects tied to a controller that is being destroyed
+void Environment::releaseController(Controller * controller)
+{
+    releaseRenderTargets(m_lua, static_cast<void *>(controller));
+    if (this->controller() == controller) { setController(nullptr); }
+}
+
 Environment::Controller * Environment::controller() const
 {
     SAVE_TOP(m_lua);
 
     lua_pushlightuserdata(m_lua, controllerToken);
-    lua_rawget(m_lua, LUA_GLOBALSINDEX);
-    auto * controller = static_cast<Controller *>(const_cast<void *>(lua_topointer(m_lua, -1)));
+    lua_rawget(m_lua, LUA_REGISTRYINDEX);
+    auto * controller = static_cast<Controller *>(lua_touserdata(m_lua, -1));
     lua_pop(m_lua, 1);
 
     CHECK_TOP(m_lua, 0);
     return controller;
 }
 
+const KeyDatabase * Environment::keyDatabase() const
+{
+    SAVE_TOP(m_lua);
+
+    lua_pushlightuserdata(m_lua, databaseToken);
+    lua_rawget(m_lua, LUA_REGISTRYINDEX);
+    auto * db = static_cast<const KeyDatabase *>(lua_touserdata(m_lua, -1));
+    lua_pop(m_lua, 1);
+
+    CHECK_TOP(m_lua, 0);
+    return db;
+}
+
 /****************************************************************************/
 
 } // namespace keyleds::lua
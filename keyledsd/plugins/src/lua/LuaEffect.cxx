@@ -20,11 +20,16 @@
 #include "lua/lua_common.h"
 #include <algorithm>
 #include <cassert>
+#include <cstdlib>
 #include <cstring>
+#include <ctime>
+#include <functional>
 #include <lua.hpp>
+#include <new>
 #include <sstream>
 
 using keyleds::plugin::lua::LuaEffect;
+using keyleds::plugin::lua::SharedState;
 using namespace keyleds::lua;
 
 /****************************************************************************/
@@ -51,13 +56,214 @@ static constexpr std::array<const char *, 25> globalWhitelist = {{
     "_G", "_VERSION"
 }};
 
-static void * const threadToken = const_cast<void **>(&threadToken);
+// Library tables copied into each sandbox, so scripts cannot alter them for others
+static constexpr std::array<const char *, 4> sandboxLibraries = {{
+    "coroutine", "math", "string", "table"
+}};
+
+static void * const debugToken = const_cast<void **>(&debugToken);
+
+// CPU watchdog
+using namespace std::literals::chrono_literals;
+static constexpr auto defaultBudget = 10ms;         // CPU time allowed per invocation
+static constexpr unsigned initBudgetFactor = 10;    // loading and init get more time
+static constexpr int watchdogInstructions = 10000;  // how often watchdog checks time
+static constexpr unsigned maxThrottle = 8;          // lowest render rate, as a divisor
+static constexpr unsigned recoveryRuns = 256;       // runs within budget before raising rate again
+
+// Memory management
+static constexpr unsigned defaultMemoryLimit = 16384; // KiB a script may use, including garbage
+static constexpr std::size_t minimumCycle = 256;    // KiB of heap before a collection cycle is due
+static constexpr int collectStepSize = 16;          // KiB of work per incremental step
 
 /****************************************************************************/
 // Helper functions
 
 static int luaPanicHandler(lua_State *);
 static int luaErrorHandler(lua_State *);
+static int luaWriter(lua_State *, const void *, size_t, void *);
+static LuaEffect::cpu_time threadCpuTime();
+
+/****************************************************************************/
+// Shared state
+
+SharedState::SharedState(const KeyDatabase & db)
+ : m_accounts(1),
+   m_currentAccount(sharedAccount),
+   m_accounting(false),
+   m_collecting(false),
+   m_nextCycle(minimumCycle),
+   m_state(createState(*this))
+{
+    auto * lua = m_state.get();
+    if (!lua) { throw std::bad_alloc(); }
+    m_accounts[sharedAccount].open = true;
+    lua_atpanic(lua, luaPanicHandler);
+    SAVE_TOP(lua);
+
+    // Load libraries in default environment
+    for (const auto & module : loadModules) {
+        lua_pushcfunction(lua, module);
+        lua_call(lua, 0, 0);
+    }
+#ifdef LUAJIT_VERSION
+    // Opening the jit module is what turns the trace compiler on
+    lua_pushcfunction(lua, luaopen_jit);
+    lua_call(lua, 0, 0);
+#endif
+
+    // Remove global symbols not in whitelist
+    lua_pushnil(lua);
+    while (lua_next(lua, LUA_GLOBALSINDEX) != 0) {
+        lua_pop(lua, 1);
+        if (lua_isstring(lua, -1)) {
+            const char * key = lua_tostring(lua, -1);
+            auto it = std::find_if(globalWhitelist.begin(), globalWhitelist.end(),
+                                   [key](const auto * item) { return std::strcmp(key, item) == 0; });
+            if (it == globalWhitelist.end()) {
+                lua_pushnil(lua);
+                lua_setglobal(lua, key);
+            }
+        }
+    }
+
+    // Hide string metatable, its __index is the string library all effects share
+    lua_pushliteral(lua, "");
+    lua_getmetatable(lua, -1);
+    lua_pushboolean(lua, false);
+    lua_setfield(lua, -2, "__metatable");
+    lua_pop(lua, 2);
+
+    // Load keyleds library
+    Environment(lua).openKeyleds(db);
+
+    // Install CPU watchdog. Threads inherit it when they are created
+    lua_sethook(lua, LuaEffect::watchdogHook, LUA_MASKCOUNT, watchdogInstructions);
+
+    // Load debug module aside, for effects whose configuration requests it
+    lua_pushcfunction(lua, luaopen_debug);
+    lua_call(lua, 0, 0);
+    lua_pushlightuserdata(lua, debugToken);
+    lua_getglobal(lua, "debug");
+    lua_rawset(lua, LUA_REGISTRYINDEX);
+    lua_pushnil(lua);
+    lua_setglobal(lua, "debug");
+
+    // Collection only happens between frames, see collect()
+    lua_gc(lua, LUA_GCCOLLECT, 0);
+    lua_gc(lua, LUA_GCSTOP, 0);
+    m_nextCycle = std::max(2 * std::size_t(lua_gc(lua, LUA_GCCOUNT, 0)), minimumCycle);
+
+    CHECK_TOP(lua, 0);
+}
+
+void SharedState::lua_state_deleter::operator()(lua_State *p) const { lua_close(p); }
+
+/// Creates the Lua state, with accounting allocator if the interpreter accepts it
+lua_State * SharedState::createState(SharedState & self)
+{
+    // LuaJIT without GC64 mode refuses custom allocators on 64-bit platforms
+    auto * lua = lua_newstate(allocate, &self);
+    if (lua) {
+        self.m_accounting = true;
+        return lua;
+    }
+    return luaL_newstate();
+}
+
+/** Opens a new memory account. Shared state must be locked.
+ * @param limit Amount of memory, in bytes, the account should stay under, zero for unlimited.
+ */
+SharedState::account_id SharedState::openAccount(std::size_t limit)
+{
+    auto it = std::find_if(m_accounts.begin() + 1, m_accounts.end(),
+                           [](const auto & account) { return !account.open && account.used == 0; });
+    if (it == m_accounts.end()) { it = m_accounts.emplace(m_accounts.end()); }
+    *it = Account{};
+    it->limit = limit;
+    it->open = true;
+    return account_id(std::distance(m_accounts.begin(), it));
+}
+
+/** Closes a memory account. Shared state must be locked.
+ * Memory still charged to it is credited back as the collector frees it, the
+ * account gets reused once empty.
+ */
+void SharedState::closeAccount(account_id id)
+{
+    assert(id != sharedAccount);
+    if (m_currentAccount == id) { m_currentAccount = sharedAccount; }
+    m_accounts[id].limit = 0;
+    m_accounts[id].open = false;
+}
+
+/** Runs incremental garbage collection. Shared state must be locked.
+ * Does nothing until heap size reaches twice what was live after previous cycle,
+ * then runs collection steps until deadline, spreading the cycle over as many
+ * frames as needed.
+ */
+void SharedState::collect(clock::time_point deadline)
+{
+    auto * lua = m_state.get();
+    if (!m_collecting) {
+        if (std::size_t(lua_gc(lua, LUA_GCCOUNT, 0)) < m_nextCycle) { return; }
+        m_collecting = true;
+    }
+
+    auto previousAccount = m_currentAccount;
+    m_currentAccount = sharedAccount;
+    do {
+        if (lua_gc(lua, LUA_GCSTEP, collectStepSize) != 0) {
+            m_collecting = false;
+            m_nextCycle = std::max(2 * std::size_t(lua_gc(lua, LUA_GCCOUNT, 0)), minimumCycle);
+            break;
+        }
+    } while (clock::now() < deadline);
+    lua_gc(lua, LUA_GCSTOP, 0);     // stepping restarts the collector
+    m_currentAccount = previousAccount;
+}
+
+/// Runs a full garbage collection cycle right away. Shared state must be locked.
+void SharedState::collectAll()
+{
+    auto * lua = m_state.get();
+    auto previousAccount = m_currentAccount;
+    m_currentAccount = sharedAccount;
+    lua_gc(lua, LUA_GCCOLLECT, 0);
+    lua_gc(lua, LUA_GCSTOP, 0);
+    m_collecting = false;
+    m_nextCycle = std::max(2 * std::size_t(lua_gc(lua, LUA_GCCOUNT, 0)), minimumCycle);
+    m_currentAccount = previousAccount;
+}
+
+/** Lua allocator function, charging each block to the current account.
+ * Blocks are prefixed with a header recording the account, so they are credited
+ * back to the right one whichever effect is active when they get freed.
+ */
+void * SharedState::allocate(void * data, void * ptr, std::size_t osize, std::size_t nsize)
+{
+    struct alignas(std::max_align_t) BlockHeader final { account_id account; };
+    auto & self = *static_cast<SharedState *>(data);
+    auto * block = ptr ? static_cast<BlockHeader *>(ptr) - 1 : nullptr;
+
+    if (nsize == 0) {
+        if (block) {
+            self.m_accounts[block->account].used -= osize;
+            std::free(block);
+        }
+        return nullptr;
+    }
+
+    auto * result = static_cast<BlockHeader *>(std::realloc(block, sizeof(BlockHeader) + nsize));
+    if (!result) { return nullptr; }
+    if (block) { self.m_accounts[result->account].used -= osize; }
+
+    result->account = self.m_currentAccount;
+    auto & account = self.m_accounts[result->account];
+    account.used += nsize;
+    account.peak = std::max(account.peak, account.used);
+    return result + 1;
+}
 
 /****************************************************************************/
 // Lifecycle management
@@ -66,88 +272,177 @@ LuaEffect::LuaEffect(std::string name, EffectService & service, state_ptr state)
  : m_name(std::move(name)),
    m_service(service),
    m_state(std::move(state)),
-   m_enabled(true)
+   m_account(SharedState::sharedAccount),
+   m_sandbox(LUA_NOREF),
+   m_threads(LUA_NOREF),
+   m_enabled(true),
+   m_clock(Thread::microseconds::zero()),
+   m_nextSequence(1),
+   m_budget(getConfig<milliseconds>(service, "budget").value_or(defaultBudget)),
+   m_deadline(cpu_time::zero()),
+   m_overrun(false),
+   m_overruns(0),
+   m_throttle(1),
+   m_skipped(0),
+   m_skippedTime(milliseconds::zero()),
+   m_cleanRuns(0),
+   m_cpuTime(cpu_time::zero()),
+   m_totalOverruns(0)
 {}
 
-LuaEffect::~LuaEffect() = default;
+LuaEffect::~LuaEffect()
+{
+    SharedState::Account memory;
+    {
+        auto lock = enter();
+        auto * lua = m_state->get();
+
+        // Drop everything the sandbox references, the collector reclaims it
+        luaL_unref(lua, LUA_REGISTRYINDEX, m_threads);
+        luaL_unref(lua, LUA_REGISTRYINDEX, m_sandbox);
+        m_interpolators.clear();
+        for (auto ref : m_interpolators.released()) { luaL_unref(lua, LUA_REGISTRYINDEX, ref); }
+        Environment(lua).releaseController(this);
+
+        memory = m_state->account(m_account);
+        if (m_account != SharedState::sharedAccount) { m_state->closeAccount(m_account); }
+    }
 
+    std::ostringstream msg;
+    msg <<"effect " <<m_name <<" used "
+        <<std::chrono::duration_cast<std::chrono::milliseconds>(m_cpuTime).count()
+        <<"ms of CPU time, exceeded its budget " <<m_totalOverruns <<" times";
+    if (m_state->accounting()) { msg <<", peaked at " <<memory.peak / 1024 <<"KiB of memory"; }
+    m_service.log(logging::debug::value, msg.str().c_str());
+}
+
+/** Create an effect running given script.
+ * @param code Script source, or bytecode previously returned through bytecode parameter.
+ * @param bytecode If not null, receives the compiled script, for faster loading next time.
+ */
 std::unique_ptr<LuaEffect> LuaEffect::create(const std::string & name, EffectService & service,
-                                             const std::string & code)
+                                             state_ptr state, const std::string & code,
+                                             std::string * bytecode)
 {
-    // Create a LUA state
-    state_ptr state(luaL_newstate());
-    auto * lua = state.get();
-    lua_atpanic(lua, luaPanicHandler);
+    auto effect = std::make_unique<LuaEffect>(name, service, std::move(state));
+    if (!effect->load(code, bytecode)) { return nullptr; }
+
+    // Let the effect run init hook
+    effect->init();
+    return effect;
+}
+
+/// Locks the shared state and makes this effect the active controller
+std::unique_lock<std::mutex> LuaEffect::enter()
+{
+    std::unique_lock<std::mutex> lock(m_state->mutex());
+    Environment(m_state->get()).setController(this);
+    m_state->setAccount(m_account);
+    return lock;
+}
+
+/// Memory use of the script, all zeroes if the interpreter does not support accounting
+SharedState::Account LuaEffect::memory() const
+{
+    std::lock_guard<std::mutex> lock(m_state->mutex());
+    if (m_account == SharedState::sharedAccount) { return {}; }
+    return m_state->account(m_account);
+}
 
+/// Builds the sandbox and runs script in it to let it build its environment
+bool LuaEffect::load(const std::string & code, std::string * bytecode)
+{
+    auto lock = enter();
+    auto * lua = m_state->get();
     SAVE_TOP(lua);
 
+    // Charge everything the script allocates to its own account
+    if (m_state->accounting()) {
+        auto limit = getConfig<unsigned>(m_service, "memory").value_or(defaultMemoryLimit);
+        m_account = m_state->openAccount(std::size_t(limit) * 1024);
+        m_state->setAccount(m_account);
+    }
+
     // Load script
-    if (luaL_loadbuffer(lua, code.data(), code.size(), name.c_str()) != 0) {
-        service.log(logging::error::value, lua_tostring(lua, -1));
-        return nullptr;
+    if (luaL_loadbuffer(lua, code.data(), code.size(), m_name.c_str()) != 0) {
+        m_service.log(logging::error::value, lua_tostring(lua, -1));
+        lua_pop(lua, 1);
+        return false;
     }                                       // ^push (script)
 
-    auto effect = std::make_unique<LuaEffect>(name, service, std::move(state));
-    effect->setupState();
+    if (bytecode) {
+        bytecode->clear();
+        if (lua_dump(lua, luaWriter, bytecode) != 0) { bytecode->clear(); }
+    }
+
+#ifdef LUAJIT_VERSION
+    // Compiled code never runs the watchdog hook, endRun() catches it once it returns
+    if (!getConfig<bool>(m_service, "jit").value_or(true)) {
+        luaJIT_setmode(lua, -1, LUAJIT_MODE_ALLFUNC | LUAJIT_MODE_OFF);
+    }
+#endif
+
+    setupState();
+    lua_rawgeti(lua, LUA_REGISTRYINDEX, m_sandbox); // push (sandbox)
+    lua_setfenv(lua, -2);                   // pop (sandbox)
 
-    // Run script to let it build its environment
+    // Run script
     lua_pushcfunction(lua, luaErrorHandler);// push (errhandler)
     lua_insert(lua, -2);                    // swap (script, errhandler) => (errhandler, script)
-    if (!handleError(lua, service, lua_pcall(lua, 0, 0, -2))) { // pop (errhandler, script)
-        return nullptr;
+    auto start = beginRun(m_budget * initBudgetFactor);
+    auto result = lua_pcall(lua, 0, 0, -2);
+    endRun(start);
+    if (!handleError(lua, m_service, result)) { // pop (errhandler, script)
+        return false;
     }
 
     CHECK_TOP(lua, 0);
-
-    // Let the effect run init hook
-    effect->init();
-    return effect;
+    return true;
 }
 
+/// Creates the sandbox the script runs in
 void LuaEffect::setupState()
 {
-    auto lua = m_state.get();
+    auto * lua = m_state->get();
     SAVE_TOP(lua);
 
-    // Load libraries in default environment
-    for (const auto & module : loadModules) {
-        lua_pushcfunction(lua, module);
-        lua_call(lua, 0, 0);
-    }
-
-    // Remove global symbols not in whitelist
-    lua_pushnil(lua);
-    while (lua_next(lua, LUA_GLOBALSINDEX) != 0) {
-        lua_pop(lua, 1);
-        if (lua_isstring(lua, -1)) {
-            const char * key = lua_tostring(lua, -1);
-            auto it = std::find_if(globalWhitelist.begin(), globalWhitelist.end(),
-                                   [key](const auto * item) { return std::strcmp(key, item) == 0; });
-            if (it == globalWhitelist.end()) {
-                lua_pushnil(lua);
-                lua_setglobal(lua, key);
-            }
+    lua_createtable(lua, 0, 8);                     // push(sandbox)
+
+    // Copy library tables
+    for (const auto * name : sandboxLibraries) {
+        lua_getglobal(lua, name);                   // push(library)
+        lua_newtable(lua);                          // push(copy)
+        lua_pushnil(lua);
+        while (lua_next(lua, -3) != 0) {
+            lua_pushvalue(lua, -2);
+            lua_insert(lua, -2);
+            lua_rawset(lua, -4);
         }
+        lua_setfield(lua, -3, name);                // pop(copy)
+        lua_pop(lua, 1);                            // pop(library)
     }
-
-    // Load keyleds library, passing ourselves as controller
-    Environment(lua).openKeyleds(this);
+    lua_pushvalue(lua, -1);
+    lua_setfield(lua, -2, "_G");
 
     // Add debug module if configuration requests it
     if (getConfig<bool>(m_service, "debug").value_or(false)) {
-        lua_pushcfunction(lua, luaopen_debug);
-        lua_call(lua, 0, 0);
+        lua_pushlightuserdata(lua, debugToken);
+        lua_rawget(lua, LUA_REGISTRYINDEX);
+        lua_setfield(lua, -2, "debug");
     }
 
-    // Insert thread list
-    lua_pushlightuserdata(lua, threadToken);
-    lua_newtable(lua);
-    lua_rawset(lua, LUA_REGISTRYINDEX);
+    // Fall back to shared globals for everything else, without exposing them
+    lua_createtable(lua, 0, 2);                     // push(metatable)
+    lua_pushvalue(lua, LUA_GLOBALSINDEX);
+    lua_setfield(lua, -2, "__index");
+    lua_pushboolean(lua, false);
+    lua_setfield(lua, -2, "__metatable");
+    lua_setmetatable(lua, -2);                      // pop(metatable)
 
     // Set keyleds members
     lua_createtable(lua, 0, 6);
     lua_pushvalue(lua, -1);
-    lua_setglobal(lua, "keyleds");
+    lua_setfield(lua, -3, "keyleds");
     {
         lua_pushlstring(lua, m_service.deviceName().data(), m_service.deviceName().size());
         lua_setfield(lua, -2, "deviceName");
@@ -191,6 +486,12 @@ void LuaEffect::setupState()
     }
     lua_pop(lua, 1);        // pop(keyleds)
 
+    m_sandbox = luaL_ref(lua, LUA_REGISTRYINDEX);   // pop(sandbox)
+
+    // Insert thread list
+    lua_newtable(lua);
+    m_threads = luaL_ref(lua, LUA_REGISTRYINDEX);
+
     CHECK_TOP(lua, 0);
 }
 
@@ -200,14 +501,17 @@ void LuaEffect::setupState()
 void LuaEffect::init()
 {
     if (!m_enabled) { return; }
-    auto lua = m_state.get();
+    auto lock = enter();
+    auto lua = m_state->get();
     SAVE_TOP(lua);
 
     if (pushHook(lua, "init")) {                    // push(init)
         lua_pushcfunction(lua, luaErrorHandler);    // push(errhandler)
         lua_insert(lua, -2);                        // swap(init, errhandler) => (errhandler, init)
-        if (!handleError(lua, m_service,
-                         lua_pcall(lua, 0, 0, -2))) {// pop(errhandler, render)
+        auto start = beginRun(m_budget * initBudgetFactor);
+        auto result = lua_pcall(lua, 0, 0, -2);
+        endRun(start);
+        if (!handleError(lua, m_service, result)) { // pop(errhandler, render)
             m_enabled = false;
         }
     }
@@ -217,8 +521,19 @@ void LuaEffect::init()
 void LuaEffect::render(milliseconds elapsed, RenderTarget & target)
 {
     if (!m_enabled) { return; }
-    auto lua = m_state.get();
+    auto lock = enter();
+    auto lua = m_state->get();
+
+    // Throttled effects only render some frames, catching up on time when they do
+    if (++m_skipped < m_throttle) {
+        m_skippedTime += elapsed;
+        return;
+    }
+    elapsed += m_skippedTime;
+    m_skipped = 0;
+    m_skippedTime = milliseconds::zero();
 
+    auto start = beginRun(m_budget);
     Environment(lua).stepInterpolators(elapsed);
     stepThreads(elapsed);
 
@@ -230,7 +545,7 @@ void LuaEffect::render(milliseconds elapsed, RenderTarget & target)
         lua_pushinteger(lua, lua_Integer(elapsed.count())); // push(arg1)
         lua_pushvalue(lua, -4);                     // push(arg2)
         if (!handleError(lua, m_service,
-                         lua_pcall(lua, 2, 0, -4))) {// pop(errhandler, render, arg1, arg2)
+                         lua_pcall(lua, 2, 0, -4)) && !m_overrun) { // pop(errhandler, render, arg1, arg2)
             m_enabled = false;
         }
     } else {
@@ -240,12 +555,38 @@ void LuaEffect::render(milliseconds elapsed, RenderTarget & target)
     lua_to<RenderTarget *>(lua, -1) = nullptr;      // mark target as gone
     lua_pop(lua, 1);
     CHECK_TOP(lua, 0);
+    endRun(start);
+}
+
+/// Runs garbage collection in the time left until next frame
+void LuaEffect::idle(std::chrono::steady_clock::time_point deadline)
+{
+    auto lock = enter();
+    m_state->collect(deadline);
+}
+
+LuaEffect::string_map LuaEffect::statistics() const
+{
+    std::lock_guard<std::mutex> lock(m_state->mutex());
+    auto result = string_map{
+        { "cpu", std::to_string(std::chrono::duration_cast<milliseconds>(m_cpuTime).count()) },
+        { "overruns", std::to_string(m_totalOverruns) },
+        { "enabled", m_enabled ? "yes" : "no" },
+    };
+    if (m_state->accounting()) {
+        auto memory = m_state->account(m_account);
+        result.emplace_back("heap", std::to_string(memory.used / 1024));
+        result.emplace_back("peak", std::to_string(memory.peak / 1024));
+        result.emplace_back("limit", std::to_string(memory.limit / 1024));
+    }
+    return result;
 }
 
 void LuaEffect::handleContextChange(const string_map & data)
 {
     if (!m_enabled) { return; }
-    auto lua = m_state.get();
+    auto lock = enter();
+    auto lua = m_state->get();
     SAVE_TOP(lua);
     lua_pushcfunction(lua, luaErrorHandler);        // push(errhandler)
     if (pushHook(lua, "onContextChange")) {         // push(hook)
@@ -255,7 +596,10 @@ void LuaEffect::handleContextChange(const string_map & data)
             lua_pushlstring(lua, item.second.c_str(), item.second.size());
             lua_rawset(lua, -3);
         }
-        if (!handleError(lua, m_service, lua_pcall(lua, 1, 0, -3))) { // pop(errhandler, hook, table)
+        auto start = beginRun(m_budget);
+        auto result = lua_pcall(lua, 1, 0, -3);
+        endRun(start);
+        if (!handleError(lua, m_service, result) && !m_overrun) { // pop(errhandler, hook, table)
             m_enabled = false;
         }
     } else {
@@ -267,7 +611,8 @@ void LuaEffect::handleContextChange(const string_map & data)
 void LuaEffect::handleGenericEvent(const string_map & data)
 {
     if (!m_enabled) { return; }
-    auto lua = m_state.get();
+    auto lock = enter();
+    auto lua = m_state->get();
     SAVE_TOP(lua);
     lua_pushcfunction(lua, luaErrorHandler);        // push(errhandler)
     if (pushHook(lua, "onGenericEvent")) {          // push(hook)
@@ -277,7 +622,10 @@ void LuaEffect::handleGenericEvent(const string_map & data)
             lua_pushlstring(lua, item.second.c_str(), item.second.size());
             lua_rawset(lua, -3);
         }
-        if (!handleError(lua, m_service, lua_pcall(lua, 1, 0, -3))) { // pop(errhandler, hook, table)
+        auto start = beginRun(m_budget);
+        auto result = lua_pcall(lua, 1, 0, -3);
+        endRun(start);
+        if (!handleError(lua, m_service, result) && !m_overrun) { // pop(errhandler, hook, table)
             m_enabled = false;
         }
     } else {
@@ -289,14 +637,17 @@ void LuaEffect::handleGenericEvent(const string_map & data)
 void LuaEffect::handleKeyEvent(const KeyDatabase::Key & key, bool press)
 {
     if (!m_enabled) { return; }
-    auto lua = m_state.get();
+    auto lock = enter();
+    auto lua = m_state->get();
     SAVE_TOP(lua);
     lua_pushcfunction(lua, luaErrorHandler);        // push(errhandler)
     if (pushHook(lua, "onKeyEvent")) {              // push(hook)
         lua_push(lua, &key);                        // push(arg1)
         lua_pushboolean(lua, press);                // push(arg2)
-        if (!handleError(lua, m_service,
-                         lua_pcall(lua, 2, 0, -4))) {// pop(errhandler, hook, arg1, arg2)
+        auto start = beginRun(m_budget);
+        auto result = lua_pcall(lua, 2, 0, -4);
+        endRun(start);
+        if (!handleError(lua, m_service, result) && !m_overrun) { // pop(errhandler, hook, arg1, arg2)
             m_enabled = false;
         }
     } else {
@@ -336,15 +687,14 @@ void LuaEffect::destroyRenderTarget(RenderTarget * target)
 int LuaEffect::createThread(lua_State * lua, int nargs)
 {
     SAVE_TOP(lua);
-    lua_push(lua, Thread{0, true, Thread::milliseconds::zero()});   // push(thread)
+    lua_push(lua, Thread{0, true, m_clock, Thread::microseconds::zero(), 0}); // push(thread)
 
     lua_createtable(lua, 0, 1);                     // push(fenv)
-    auto * thread = lua_newthread(m_state.get());   // push(thread)
+    auto * thread = lua_newthread(m_state->get());  // push(thread)
     lua_setfield(lua, -2, "thread");                // pop(thread)
     lua_setfenv(lua, -2);                           // pop(fenv)
 
-    lua_pushlightuserdata(lua, threadToken); // push(token)
-    lua_rawget(lua, LUA_REGISTRYINDEX);             // pop(token) push(threadlist)
+    lua_rawgeti(lua, LUA_REGISTRYINDEX, m_threads); // push(threadlist)
     lua_pushvalue(lua, -2);                         // push(thread)
     auto id = luaL_ref(lua, -2);                    // pop(thread)
     lua_to<Thread>(lua, -2).id = id;
@@ -362,76 +712,96 @@ int LuaEffect::createThread(lua_State * lua, int nargs)
 void LuaEffect::destroyThread(lua_State * lua, Thread & thread)
 {
     SAVE_TOP(lua);
-    lua_pushlightuserdata(lua, threadToken);
-    lua_rawget(lua, LUA_REGISTRYINDEX);
+    lua_rawgeti(lua, LUA_REGISTRYINDEX, m_threads);
 
     luaL_unref(lua, -1, thread.id);
     lua_pop(lua, 1);
+    thread.id = LUA_NOREF;
     thread.running = false;
+    thread.sequence = 0;                            // stale entry gets dropped when due
     CHECK_TOP(lua, 0);
 }
 
+void LuaEffect::pauseThread(lua_State *, Thread & thread)
+{
+    if (!thread.running) { return; }
+    thread.running = false;
+    thread.sleepTime = std::max(thread.wakeTime - m_clock, Thread::microseconds::zero());
+    thread.sequence = 0;
+}
+
+void LuaEffect::resumeThread(lua_State *, Thread & thread)
+{
+    if (thread.running || thread.id == LUA_NOREF) { return; }
+    thread.running = true;
+    thread.wakeTime = m_clock + thread.sleepTime;
+    scheduleThread(thread);
+}
+
+/** Run threads that are due.
+ * Threads are resumed in wake up time order, including those that wake up
+ * several times within elapsed time, so waits shorter than a frame keep
+ * their relative timing.
+ */
 void LuaEffect::stepThreads(milliseconds elapsed)
 {
-    auto * lua = m_state.get();
+    auto * lua = m_state->get();
     SAVE_TOP(lua);
-    lua_pushlightuserdata(lua, threadToken);
-    lua_rawget(lua, LUA_REGISTRYINDEX);
-
-    auto size = lua_objlen(lua, -1);
-    assert(size <= std::numeric_limits<int>::max());
-    for (int index = 1; index <= int(size); ++index) {
-        lua_rawgeti(lua, -1, index);                    // push(threadInfo)
-        if (!lua_is<Thread>(lua, -1)) {
-            lua_pop(lua, 1);                            // (pop(threadInfo))
-            continue;
-        }
+    m_clock += elapsed;
 
-        auto & threadInfo = lua_to<Thread>(lua, -1);
+    lua_rawgeti(lua, LUA_REGISTRYINDEX, m_threads);
 
-        if (threadInfo.running) {
-            if (threadInfo.sleepTime <= elapsed) {
-                lua_getfenv(lua, -1);                   // push(fenv)
-                lua_getfield(lua, -1, "thread");        // push(thread)
-                auto * thread = static_cast<lua_State *>(const_cast<void *>(lua_topointer(lua, -1)));
+    while (!m_schedule.empty() && m_schedule.front().wakeTime <= m_clock) {
+        std::pop_heap(m_schedule.begin(), m_schedule.end(), std::greater<>());
+        const auto entry = m_schedule.back();
+        m_schedule.pop_back();
 
-                while (threadInfo.running && threadInfo.sleepTime <= elapsed) {
-                    runThread(threadInfo, thread, 0);
-                }
-
-                lua_pop(lua, 2);                        // pop(fenv, thread)
-            }
-            if (threadInfo.sleepTime > elapsed) {
-                threadInfo.sleepTime -= elapsed;
-            } else {
-                threadInfo.sleepTime = Thread::milliseconds::zero();
-            }
+        lua_rawgeti(lua, -1, entry.id);                 // push(threadInfo)
+        if (!lua_is<Thread>(lua, -1) || lua_to<Thread>(lua, -1).sequence != entry.sequence) {
+            lua_pop(lua, 1);                            // pop(threadInfo)
+            continue;                                   // thread was paused or destroyed
         }
-        lua_pop(lua, 1);                                // pop(threadInfo)
+        auto & threadInfo = lua_to<Thread>(lua, -1);
+        threadInfo.sequence = 0;
+
+        lua_getfenv(lua, -1);                           // push(fenv)
+        lua_getfield(lua, -1, "thread");                // push(thread)
+        auto * thread = static_cast<lua_State *>(const_cast<void *>(lua_topointer(lua, -1)));
+        runThread(threadInfo, thread, 0);
+        lua_pop(lua, 3);                                // pop(threadInfo, fenv, thread)
     }
-    lua_pop(lua, 1);                                    // pop(animlist)
+    lua_pop(lua, 1);                                    // pop(threadlist)
     CHECK_TOP(lua, 0);
 }
 
 void LuaEffect::runThread(Thread & threadInfo, lua_State * thread, int nargs)
 {
-    auto * lua = m_state.get();
+    auto * lua = m_state->get();
     SAVE_TOP(lua);
 
     bool terminate = true;
     switch (lua_resume(thread, nargs)) {
         case 0:
             break;
-        case LUA_YIELD:
+        case LUA_YIELD: {
             if (lua_topointer(thread, 1) != const_cast<void *>(Environment::waitToken)) {
                 luaL_traceback(lua, thread, "invalid yield", 0);
                 m_service.log(logging::error::value, lua_tostring(lua, -1));
                 lua_pop(lua, 1);
                 break;
             }
-            threadInfo.sleepTime += Thread::milliseconds(unsigned(1000.0 * lua_tonumber(thread, 2)));
+            auto duration = Thread::microseconds(Thread::microseconds::rep(
+                std::max(lua_Number(0), 1000000.0 * lua_tonumber(thread, 2))
+            ));
+            if (threadInfo.running) {
+                threadInfo.wakeTime += duration;
+                scheduleThread(threadInfo);
+            } else {                                    // thread paused itself
+                threadInfo.sleepTime += duration;
+            }
             terminate = false;
             break;
+        }
         case LUA_ERRRUN:
             luaL_traceback(lua, thread, lua_tostring(thread, -1), 0);
             m_service.log(logging::error::value, lua_tostring(lua, -1));
@@ -444,18 +814,121 @@ void LuaEffect::runThread(Thread & threadInfo, lua_State * thread, int nargs)
             m_service.log(logging::critical::value, "unexpected error");
     }
     if (terminate) {
-        destroyThread(m_state.get(), threadInfo);
+        destroyThread(m_state->get(), threadInfo);
     }
     CHECK_TOP(lua, 0);
 }
 
+/// Inserts thread into schedule, at its wake up time
+void LuaEffect::scheduleThread(Thread & thread)
+{
+    thread.sequence = m_nextSequence++;
+    m_schedule.push_back({thread.wakeTime, thread.sequence, thread.id});
+    std::push_heap(m_schedule.begin(), m_schedule.end(), std::greater<>());
+}
+
+/****************************************************************************/
+// CPU watchdog
+
+/** Arm the watchdog before running script code.
+ * @param budget CPU time the script is allowed to use before being interrupted.
+ * @return Current thread CPU time, to be passed to endRun().
+ */
+LuaEffect::cpu_time LuaEffect::beginRun(milliseconds budget)
+{
+    auto now = threadCpuTime();
+    m_deadline = budget > milliseconds::zero() ? now + budget : cpu_time::zero();
+    m_overrun = false;
+    return now;
+}
+
+/** Disarm the watchdog and update throttling after running script code.
+ * Each overrun halves the render rate of the effect, until it overruns while
+ * already at lowest rate, at which point it is disabled. Rate is raised
+ * back progressively once script runs, hooks included, stay within budget.
+ * @param start Value returned by matching beginRun().
+ */
+void LuaEffect::endRun(cpu_time start)
+{
+    auto now = threadCpuTime();
+    m_cpuTime += now - start;
+    // Compiled code cannot be interrupted, but is still accounted once it returns
+    if (m_deadline != cpu_time::zero() && now >= m_deadline) { m_overrun = true; }
+    m_deadline = cpu_time::zero();
+
+    if (m_enabled && !checkMemory()) {
+        m_service.log(logging::error::value,
+                      ("effect " + m_name + " exceeds its memory limit, disabling it").c_str());
+        m_enabled = false;
+    }
+
+    if (!m_overrun) {
+        if (m_throttle > 1 && ++m_cleanRuns >= recoveryRuns) {
+            m_throttle /= 2;
+            m_cleanRuns = 0;
+            if (m_throttle == 1) { m_overruns = 0; }
+        }
+        return;
+    }
+
+    ++m_overruns;
+    ++m_totalOverruns;
+    m_cleanRuns = 0;
+    if (m_throttle >= maxThrottle) {
+        m_service.log(logging::error::value,
+                      ("effect " + m_name + " keeps exceeding its CPU budget, disabling it").c_str());
+        m_enabled = false;
+    } else {
+        m_throttle *= 2;
+        m_service.log(logging::warning::value,
+                      ("effect " + m_name + " exceeded its CPU budget, rendering one frame out of "
+                       + std::to_string(m_throttle)).c_str());
+    }
+}
+
+/** Lua count hook that interrupts scripts once they exhaust their budget.
+ * The error it raises can be caught by the script, but the watchdog keeps
+ * raising it on every check until the script returns.
+ * @note LuaJIT does not invoke hooks from compiled code, so there the watchdog
+ *       only interrupts loops that remain interpreted. Compiled code that overruns
+ *       its budget is caught by endRun() after it returns, and a compiled loop
+ *       that never returns hangs the service: disable jit when writing scripts.
+ */
+void LuaEffect::watchdogHook(lua_State * lua, lua_Debug *)
+{
+    auto * effect = static_cast<LuaEffect *>(Environment(lua).controller());
+    if (!effect) { return; }
+
+    if (effect->m_deadline != cpu_time::zero() && threadCpuTime() >= effect->m_deadline) {
+        effect->m_overrun = true;
+        luaL_error(lua, "script exceeded its CPU budget");
+    }
+    if (!effect->checkMemory()) {
+        luaL_error(lua, "script exceeded its memory limit");
+    }
+}
+
+/** Checks whether the script stays within its memory limit.
+ * The limit is soft: allocations never fail, as that would abort the service when
+ * it happens outside of protected calls. Instead, the watchdog and endRun() check
+ * the limit, collecting garbage before deciding the script really exceeds it.
+ */
+bool LuaEffect::checkMemory()
+{
+    if (!m_state->account(m_account).exceeded()) { return true; }
+    m_state->collectAll();
+    return !m_state->account(m_account).exceeded();
+}
+
 /****************************************************************************/
 // Static Helper methods
 
 bool LuaEffect::pushHook(lua_State * lua, const char * name)
 {
     SAVE_TOP(lua);
-    lua_getglobal(lua, name);               // push(hook)
+    lua_rawgeti(lua, LUA_REGISTRYINDEX, m_sandbox); // push(sandbox)
+    lua_getfield(lua, -1, name);            // push(hook)
+    lua_remove(lua, -2);                    // pop(sandbox)
     if (!lua_isfunction(lua, -1)) {
         lua_pop(lua, 1);                    // pop(hook)
         CHECK_TOP(lua, 0);
@@ -488,16 +961,29 @@ bool LuaEffect::handleError(lua_State * lua, EffectService & service, int code)
     return ok;
 }
 
-void LuaEffect::lua_state_deleter::operator()(lua_State *p) const { lua_close(p); }
-
 /****************************************************************************/
 
 /// Convert a lua panic into abort - gives better messages than letting lua exit().
 static int luaPanicHandler(lua_State *) { abort(); }
 
+/// Returns CPU time used by calling thread, so time spent preempted is not counted
+static LuaEffect::cpu_time threadCpuTime()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return std::chrono::seconds(now.tv_sec) + std::chrono::nanoseconds(now.tv_nsec);
+}
+
 /// Builds the error message for script errors
 static int luaErrorHandler(lua_State * lua)
 {
     luaL_traceback(lua, lua, lua_tostring(lua, -1), 1);
     return 1;
 }
+
+/// Appends chunks of dumped bytecode to a string
+static int luaWriter(lua_State *, const void * data, size_t size, void * buffer)
+{
+    static_cast<std::string *>(buffer)->append(static_cast<const char *>(data), size);
+    return 0;
+}
@@ -18,6 +18,7 @@
 
 #include "lua/Environment.h"
 #include "lua/lua_common.h"
+#include <algorithm>
 #include <cassert>
 #include <limits>
 #include <lua.hpp>
@@ -30,24 +31,23 @@ using milliseconds = Interpolator::milliseconds;
 
 static constexpr milliseconds maximumDuration = 1h;  // One hour
 
-static void * const interpolatorToken = const_cast<void **>(&interpolatorToken);
-static const char targetLink[] = "target";
-
 /****************************************************************************/
 
-static void pushRegistry(lua_State * lua)
+static InterpolatorEngine & engine(lua_State * lua)
 {
-    SAVE_TOP(lua);
-    lua_pushlightuserdata(lua, interpolatorToken);
-    lua_rawget(lua, LUA_REGISTRYINDEX);
-    if (!lua_istable(lua, -1)) {
-        lua_pop(lua, 1);
-        lua_createtable(lua, 1, 1);
-        lua_pushlightuserdata(lua, interpolatorToken);
-        lua_pushvalue(lua, -2);
-        lua_rawset(lua, LUA_REGISTRYINDEX);
+    auto * controller = Environment(lua).controller();
+    if (!controller) {
+        luaL_error(lua, noEffectTokenErrorMessage);
+        // does not return
     }
-    CHECK_TOP(lua, +1);
+    return controller->interpolators();
+}
+
+/// Releases references to targets the engine no longer uses
+static void releaseTargets(lua_State * lua, InterpolatorEngine & engine)
+{
+    for (auto ref : engine.released()) { luaL_unref(lua, LUA_REGISTRYINDEX, ref); }
+    engine.released().clear();
 }
 
 /****************************************************************************/
@@ -59,8 +59,10 @@ int luaNewInterpolator(lua_State * lua)
 
     unsigned flags = 0;
 
+    // Durations are rounded to milliseconds, and must not round to zero
     auto duration = std::chrono::duration<lua_Number>(luaL_checknumber(lua, 1));
-    if (duration <= decltype(duration)::zero() || duration > maximumDuration) {
+    if (!isFinite(duration.count())
+        || duration < Interpolator::milliseconds(1) || duration > maximumDuration) {
         return luaL_argerror(lua, 1, "invalid duration");
     }
 
@@ -75,14 +77,11 @@ int luaNewInterpolator(lua_State * lua)
 
     // Create object
     lua_push(lua, Interpolator{
-        LUA_NOREF, flags, 0,
+        flags,
         std::chrono::duration_cast<Interpolator::milliseconds>(duration),
-        Interpolator::milliseconds::zero(),
-        startValue, finishValue
+        startValue, finishValue,
+        nullptr, 0, 0
     });                                                         // push(interpol)
-    lua_createtable(lua, 0, 1);                                 // push(fenv)
-    lua_setfenv(lua, -2);                                       // pop(fenv)
-
     return 1;
 }
 
@@ -116,54 +115,33 @@ void Interpolator::start(lua_State * lua, unsigned keyIndex)
 
     auto & interpolator = lua_to<Interpolator>(lua, -2);
     auto * target = lua_to<RenderTarget *>(lua, -1);
+    auto & interpolators = engine(lua);
 
-    if (interpolator.id != LUA_NOREF) {
+    if (interpolators.running(interpolator.target, interpolator.index, interpolator.serial)) {
         luaL_error(lua, "interpolator already active");
         // does not return
     }
 
     SAVE_TOP(lua);
-    pushRegistry(lua);                                              // push(registry)
-
-    // see whether another interpolator already runs on this key
-    auto size = lua_objlen(lua, -1);
-    assert(size <= std::numeric_limits<int>::max());
-    for (decltype(size) index = 1; index <= size; ++index) {
-        lua_rawgeti(lua, -1, static_cast<int>(index));              // push(otherinter)
-        if (lua_isuserdata(lua, -1)) {      // any user data is an Interpolator
-            auto & other = lua_to<Interpolator>(lua, -1);
-            if (other.index == keyIndex) {
-                lua_getfenv(lua, -1);                               // push(otherfenv)
-                lua_getfield(lua, -1, targetLink);                  // push(othertarget)
-                auto * otherTarget = lua_to<RenderTarget *>(lua, -1);
-                lua_pop(lua, 2);                                    // pop(otherfenv, othertarget)
-                if (otherTarget == target) {
-                    Interpolator::stop(lua);    // (pop(otherinter))
-                    continue;
-                }
-            }
-        }
-        lua_pop(lua, 1);                                            // pop(otherinter)
+
+    // keep the render target alive while interpolators run on it
+    int targetRef = LUA_NOREF;
+    if (!interpolators.holds(target)) {
+        lua_pushvalue(lua, -1);                                     // push(target)
+        targetRef = luaL_ref(lua, LUA_REGISTRYINDEX);               // pop(target)
     }
 
-    lua_pushvalue(lua, -3);                                         // push(interpolator)
-    interpolator.id = luaL_ref(lua, -2);                            // pop(interpolator)
+    auto startValue = (interpolator.flags & Interpolator::hasStartValueFlag) != 0
+                    ? interpolator.startValue : (*target)[keyIndex];
+    (*target)[keyIndex] = startValue;
 
-    // fill in missing values
+    interpolator.target = target;
     interpolator.index = keyIndex;
-    interpolator.elapsed = Interpolator::milliseconds::zero();
-    if ((interpolator.flags & Interpolator::hasStartValueFlag) == 0) {
-        interpolator.startValue = (*lua_to<RenderTarget *>(lua, -2))[keyIndex];
-    } else {
-        (*target)[keyIndex] = interpolator.startValue;
-    }
+    interpolator.serial = interpolators.start(target, targetRef, keyIndex, interpolator.duration,
+                                              startValue, interpolator.finishValue);
+    releaseTargets(lua, interpolators);     // in case it replaced the only one on its target
 
-    // create a reference to the render target
-    lua_getfenv(lua, -3);                                           // push(fenv)
-    lua_pushvalue(lua, -3);                                         // push(target)
-    lua_setfield(lua, -2, targetLink);                              // pop(target)
-
-    lua_pop(lua, 4);                                                // pop(arg1, arg2, registry, fenv)
+    lua_pop(lua, 2);                                                // pop(arg1, arg2)
     CHECK_TOP(lua, -2);
 }
 
@@ -174,73 +152,201 @@ void Interpolator::stop(lua_State * lua)
     assert(lua_is<Interpolator>(lua, -1));
 
     auto & interpolator = lua_to<Interpolator>(lua, -1);
+    auto & interpolators = engine(lua);
 
-    lua_getfenv(lua, -1);                                   // push(fenv)
-    pushRegistry(lua);                                      // push(registry)
-
-    // unregister interpolator from running list
-    luaL_unref(lua, -1, interpolator.id);
-    interpolator.id = LUA_NOREF;
+    interpolators.stop(interpolator.target, interpolator.index, interpolator.serial);
+    interpolator.serial = 0;
+    releaseTargets(lua, interpolators);
 
-    // remove reference to the render target
-    lua_pushnil(lua);                                       // push(nil)
-    lua_setfield(lua, -3, targetLink);                      // pop(nil)
-
-    lua_pop(lua, 3);                                        // pop(interpolator, fenv, registry)
+    lua_pop(lua, 1);                                        // pop(interpolator)
     CHECK_TOP(lua, -1);
 }
 
 void Interpolator::stepAll(lua_State * lua, milliseconds elapsed)
 {
-    SAVE_TOP(lua);
-    pushRegistry(lua);                                              // push(registry)
-
-    auto size = lua_objlen(lua, -1);
-    assert(size <= std::numeric_limits<int>::max());
-    for (decltype(size) index = 1; index <= size; ++index) {
-        lua_rawgeti(lua, -1, static_cast<int>(index));              // push(interpolator)
-        if (lua_isuserdata(lua, -1)) {      // any user data is an Interpolator
-            auto & interpolator = lua_to<Interpolator>(lua, -1);
-
-            lua_getfenv(lua, -1);                                   // push(fenv)
-            lua_getfield(lua, -1, targetLink);                      // push(target)
-            auto * target = lua_to<RenderTarget *>(lua, -1);
-            assert(target);
-            lua_pop(lua, 2);                                        // pop(fenv, target)
-
-            interpolator.elapsed += elapsed;
-            if (interpolator.elapsed >= interpolator.duration) {
-                (*target)[interpolator.index] = interpolator.finishValue;
-                Interpolator::stop(lua);                            // pop(interpolator)
-                continue;
-            }
-
-            (*target)[interpolator.index] = interpolator.value();
-        }
-        lua_pop(lua, 1);                                            // pop(interpolator)
+    auto & interpolators = engine(lua);
+    interpolators.step(elapsed);
+    releaseTargets(lua, interpolators);
+}
+
+/****************************************************************************/
+
+bool InterpolatorEngine::holds(const RenderTarget * target) const
+{
+    return findTarget(target) >= 0;
+}
+
+/** Start an interpolator, replacing the one running on the same key if any.
+ * @param target Render target to write colors into.
+ * @param targetRef Reference keeping the target alive. Only used if the engine
+ *                  does not hold the target already, see holds().
+ * @param key Index of the key within target.
+ * @param duration Animation duration.
+ * @param startValue Color at the start of animation.
+ * @param finishValue Color at the end of animation.
+ * @return Serial identifying this run.
+ */
+InterpolatorEngine::serial_type
+InterpolatorEngine::start(RenderTarget * target, int targetRef, unsigned key, milliseconds duration,
+                          RGBAColor startValue, RGBAColor finishValue)
+{
+    int owner = findTarget(target);
+    if (owner < 0) {
+        auto it = std::find_if(m_targets.begin(), m_targets.end(),
+                               [](const auto & item) { return item.target == nullptr; });
+        if (it == m_targets.end()) { it = m_targets.insert(it, Target{}); }
+        it->target = target;
+        it->ref = targetRef;
+        it->count = 0;
+        it->slots.assign(target->size(), -1);
+        owner = static_cast<int>(it - m_targets.begin());
+    } else {
+        assert(targetRef < 0);
     }
+    auto & info = m_targets[static_cast<std::size_t>(owner)];
+    assert(key < info.slots.size());
+
+    const auto serial = m_nextSerial++;
+    auto slot = info.slots[key];
+    if (slot < 0) {     // new interpolator on that key
+        slot = static_cast<int>(m_serial.size());
+        info.slots[key] = slot;
+        info.count += 1;
+        m_owner.push_back(static_cast<unsigned>(owner));
+        m_key.push_back(key);
+        m_serial.push_back(serial);
+        m_elapsed.push_back(0);
+        m_duration.push_back(duration.count());
+        m_startValue.push_back(startValue);
+        m_finishValue.push_back(finishValue);
+        m_value.push_back(startValue);
+    } else {            // replace interpolator running on that key
+        const auto idx = static_cast<std::size_t>(slot);
+        m_serial[idx] = serial;
+        m_elapsed[idx] = 0;
+        m_duration[idx] = duration.count();
+        m_startValue[idx] = startValue;
+        m_finishValue[idx] = finishValue;
+        m_value[idx] = startValue;
+    }
+    return serial;
+}
+
+bool InterpolatorEngine::running(const RenderTarget * target, unsigned key, serial_type serial) const
+{
+    return findSlot(target, key, serial) >= 0;
+}
 
-    lua_pop(lua, 1);                                                // pop(registry)
-    CHECK_TOP(lua, 0);
-}
-
-RGBAColor Interpolator::value() const
-{
-    using ct = RGBAColor::channel_type;
-    return {
-        ct(int(startValue.red) +
-           (int(finishValue.red) - int(startValue.red))
-           * int(elapsed.count()) / int(duration.count())),
-        ct(int(startValue.green) +
-           (int(finishValue.green) - int(startValue.green))
-           * int(elapsed.count()) / int(duration.count())),
-        ct(int(startValue.blue) +
-           (int(finishValue.blue) - int(startValue.blue))
-           * int(elapsed.count()) / int(duration.count())),
-        ct(int(startValue.alpha) +
-           (int(finishValue.alpha) - int(startValue.alpha))
-           * int(elapsed.count()) / int(duration.count()))
-    };
+void InterpolatorEngine::stop(const RenderTarget * target, unsigned key, serial_type serial)
+{
+    auto slot = findSlot(target, key, serial);
+    if (slot >= 0) { remove(static_cast<std::size_t>(slot)); }
+}
+
+/** Advance all interpolators and write their colors into targets.
+ * Interpolators that reach their duration write their finish value and are removed.
+ */
+void InterpolatorEngine::step(milliseconds elapsed)
+{
+    const auto size = m_serial.size();
+    const auto delta = elapsed.count();
+
+    // Advance and compute colors. Plain loops over parallel arrays, so they vectorize.
+    for (std::size_t idx = 0; idx < size; ++idx) {
+        m_elapsed[idx] = std::min(m_elapsed[idx] + delta, m_duration[idx]);
+    }
+    for (std::size_t idx = 0; idx < size; ++idx) {
+        const float ratio = static_cast<float>(m_elapsed[idx]) / static_cast<float>(m_duration[idx]);
+        const auto & from = m_startValue[idx];
+        const auto & to = m_finishValue[idx];
+        const auto lerp = [ratio](RGBAColor::channel_type a, RGBAColor::channel_type b) {
+            return static_cast<RGBAColor::channel_type>(
+                static_cast<float>(a) + (static_cast<float>(b) - static_cast<float>(a)) * ratio
+            );
+        };
+        m_value[idx] = RGBAColor(lerp(from.red, to.red), lerp(from.green, to.green),
+                                 lerp(from.blue, to.blue), lerp(from.alpha, to.alpha));
+    }
+
+    // Write colors into targets
+    for (std::size_t idx = 0; idx < size; ++idx) {
+        (*m_targets[m_owner[idx]].target)[m_key[idx]] = m_value[idx];
+    }
+
+    // Remove finished interpolators, backwards so moved slots are already processed
+    for (auto idx = size; idx > 0; --idx) {
+        if (m_elapsed[idx - 1] >= m_duration[idx - 1]) { remove(idx - 1); }
+    }
+}
+
+/// Stops all interpolators, releasing all targets
+void InterpolatorEngine::clear()
+{
+    for (auto & info : m_targets) {
+        if (info.target) { m_released.push_back(info.ref); }
+    }
+    m_targets.clear();
+    m_owner.clear();
+    m_key.clear();
+    m_serial.clear();
+    m_elapsed.clear();
+    m_duration.clear();
+    m_startValue.clear();
+    m_finishValue.clear();
+    m_value.clear();
+}
+
+int InterpolatorEngine::findTarget(const RenderTarget * target) const
+{
+    if (!target) { return -1; }
+    auto it = std::find_if(m_targets.begin(), m_targets.end(),
+                           [target](const auto & item) { return item.target == target; });
+    return it != m_targets.end() ? static_cast<int>(it - m_targets.begin()) : -1;
+}
+
+int InterpolatorEngine::findSlot(const RenderTarget * target, unsigned key, serial_type serial) const
+{
+    if (serial == 0) { return -1; }
+    auto owner = findTarget(target);
+    if (owner < 0) { return -1; }
+    const auto & slots = m_targets[static_cast<std::size_t>(owner)].slots;
+    if (key >= slots.size()) { return -1; }
+    auto slot = slots[key];
+    if (slot < 0 || m_serial[static_cast<std::size_t>(slot)] != serial) { return -1; }
+    return slot;
+}
+
+/// Removes an interpolator, moving last one into its slot to keep arrays packed
+void InterpolatorEngine::remove(std::size_t slot)
+{
+    auto & info = m_targets[m_owner[slot]];
+    info.slots[m_key[slot]] = -1;
+    if (--info.count == 0) {
+        m_released.push_back(info.ref);
+        info.target = nullptr;
+        info.slots.clear();
+    }
+
+    const auto last = m_serial.size() - 1;
+    if (slot != last) {
+        m_owner[slot] = m_owner[last];
+        m_key[slot] = m_key[last];
+        m_serial[slot] = m_serial[last];
+        m_elapsed[slot] = m_elapsed[last];
+        m_duration[slot] = m_duration[last];
+        m_startValue[slot] = m_startValue[last];
+        m_finishValue[slot] = m_finishValue[last];
+        m_value[slot] = m_value[last];
+        m_targets[m_owner[slot]].slots[m_key[slot]] = static_cast<int>(slot);
+    }
+    m_owner.pop_back();
+    m_key.pop_back();
+    m_serial.pop_back();
+    m_elapsed.pop_back();
+    m_duration.pop_back();
+    m_startValue.pop_back();
+    m_finishValue.pop_back();
+    m_value.pop_back();
 }
 
 /****************************************************************************/
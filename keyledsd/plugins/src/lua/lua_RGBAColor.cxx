@@ -33,194 +33,229 @@ namespace keyleds::lua {
 
 /****************************************************************************/
 
+static_assert(sizeof(ScriptColor) == 4 * sizeof(lua_Number),
+              "script colors must match the FFI declaration");
+
+#ifdef LUAJIT_VERSION
+static void * const constructorToken = const_cast<void **>(&constructorToken);
+static void * const checkToken = const_cast<void **>(&checkToken);
+static constexpr int luaTypeCData = 10;     ///< lua_type() of FFI objects, not exported by LuaJIT
+
+/// Defines FFI colors - (ffi) => (constructor, check)
+/// Arithmetic creates new colors, which compiled traces sink instead of allocating.
+static const char colorFactoryCode[] = R"lua(
+local ffi = ...
+local error, format, type = error, string.format, type
+local istype = ffi.istype
+ffi.cdef[[
+typedef struct { double red, green, blue, alpha; } keyleds_script_color;
+]]
+local color
+local function checkColor(value, n)
+    if not istype(color, value) then error(format("bad argument #%d (bad type)", n), 3) end
+end
+local function checkNumber(value, n)
+    if type(value) ~= "number" then error(format("bad argument #%d (number expected)", n), 3) end
+end
+color = ffi.metatype("keyleds_script_color", {
+    __add = function(a, b)
+        checkColor(a, 1); checkColor(b, 2)
+        local k = b.alpha
+        return color(a.red + k * b.red, a.green + k * b.green, a.blue + k * b.blue, a.alpha)
+    end,
+    __sub = function(a, b)
+        checkColor(a, 1); checkColor(b, 2)
+        local k = b.alpha
+        return color(a.red - k * b.red, a.green - k * b.green, a.blue - k * b.blue, a.alpha)
+    end,
+    __mul = function(a, k)
+        checkColor(a, 1); checkNumber(k, 2)
+        return color(a.red * k, a.green * k, a.blue * k, a.alpha)
+    end,
+    __div = function(a, k)
+        checkColor(a, 1); checkNumber(k, 2)
+        return color(a.red / k, a.green / k, a.blue / k, a.alpha)
+    end,
+    __eq = function(a, b)   -- also invoked when comparing against other types
+        return istype(color, a) and istype(color, b) and
+               a.red == b.red and a.green == b.green and a.blue == b.blue and a.alpha == b.alpha
+    end,
+    __tostring = function(a)
+        return format("color(%.3f, %.3f, %.3f, %.3f)", a.red, a.green, a.blue, a.alpha)
+    end,
+})
+return color, function(value) return istype(color, value) end
+)lua";
+
+#else
 static constexpr std::array<const char *, 4> keys = {{ "red", "green", "blue", "alpha" }};
 
-static int indexForKey(lua_State * lua, const char * key)
+static lua_Number & channelForKey(lua_State * lua, ScriptColor & color, const char * key)
 {
     static_assert(keys.size() < std::numeric_limits<int>::max(), "key number must fit an int");
+    lua_Number ScriptColor::* const channels[] = {
+        &ScriptColor::red, &ScriptColor::green, &ScriptColor::blue, &ScriptColor::alpha
+    };
     auto it = std::find_if(keys.begin(), keys.end(),
                            [&](auto item) { return std::strcmp(item, key) == 0; });
-    if (it != keys.end()) {
-        return static_cast<int>(it - keys.begin() + 1);
-    }
-    return luaL_error(lua, badKeyErrorMessage, key);
+    if (it == keys.end()) { luaL_error(lua, badKeyErrorMessage, key); }
+    return color.*channels[it - keys.begin()];
 }
 
-static int add(lua_State * lua)
+static ScriptColor & checkColor(lua_State * lua, int index)
 {
-    if (!lua_is<RGBAColor>(lua, 1)) { luaL_argerror(lua, 1, badTypeErrorMessage); }
-    if (!lua_is<RGBAColor>(lua, 2)) { luaL_argerror(lua, 2, badTypeErrorMessage); }
-
-    lua_rawgeti(lua, 2, 4);
-    auto multiplier = lua_tonumber(lua, -1);
-
-    lua_createtable(lua, 4, 0);
-    luaL_getmetatable(lua, metatable<RGBAColor>::name);
-    lua_setmetatable(lua, -2);
+    if (!lua_iscolor(lua, index)) { luaL_argerror(lua, index, badTypeErrorMessage); }
+    return lua_to<ScriptColor>(lua, index);
+}
 
-    for (int i = 1; i <= 3; ++i) {
-        lua_rawgeti(lua, 1, i);
-        lua_rawgeti(lua, 2, i);
-        lua_pushnumber(lua, lua_tonumber(lua, -2) + multiplier * lua_tonumber(lua, -1));
-        lua_rawseti(lua, -4, i);
-        lua_pop(lua, 2);
-    }
-    lua_rawgeti(lua, 1, 4);
-    lua_rawseti(lua, -2, 4);
+static int add(lua_State * lua)
+{
+    const auto & a = checkColor(lua, 1);
+    const auto & b = checkColor(lua, 2);
+    lua_pushcolor(lua, a.red + b.alpha * b.red, a.green + b.alpha * b.green,
+                  a.blue + b.alpha * b.blue, a.alpha);
     return 1;
 }
 
 static int div(lua_State * lua)
 {
-    if (!lua_is<RGBAColor>(lua, 1)) { luaL_argerror(lua, 1, badTypeErrorMessage); }
+    const auto & a = checkColor(lua, 1);
     auto divisor = luaL_checknumber(lua, 2);
-
-    lua_createtable(lua, 4, 0);
-    luaL_getmetatable(lua, metatable<RGBAColor>::name);
-    lua_setmetatable(lua, -2);
-
-    for (int i = 1; i <= 3; ++i) {
-        lua_rawgeti(lua, 1, i);
-        lua_pushnumber(lua, lua_tonumber(lua, -1) / divisor);
-        lua_rawseti(lua, -3, i);
-        lua_pop(lua, 1);
-    }
-    lua_rawgeti(lua, 1, 4);
-    lua_rawseti(lua, -2, 4);
+    lua_pushcolor(lua, a.red / divisor, a.green / divisor, a.blue / divisor, a.alpha);
     return 1;
 }
 
 static int equal(lua_State * lua)
 {
-    for (int i = 1; i <= 4; ++i) {
-        lua_rawgeti(lua, 1, i);
-        lua_rawgeti(lua, 2, i);
-        if (lua_tonumber(lua, -2) != lua_tonumber(lua, -1)) {
-            lua_pushboolean(lua, false);
-            return 1;
-        }
-        lua_pop(lua, 2);
-    }
-    lua_pushboolean(lua, true);
+    const auto & a = lua_to<ScriptColor>(lua, 1);
+    const auto & b = lua_to<ScriptColor>(lua, 2);
+    lua_pushboolean(lua, a.red == b.red && a.green == b.green &&
+                         a.blue == b.blue && a.alpha == b.alpha);
     return 1;
 }
 
 static int index(lua_State * lua)
 {
-    lua_rawgeti(lua, 1, indexForKey(lua, luaL_checkstring(lua, 2)));
+    lua_pushnumber(lua, channelForKey(lua, lua_to<ScriptColor>(lua, 1), luaL_checkstring(lua, 2)));
     return 1;
 }
 
 static int mul(lua_State * lua)
 {
-    if (!lua_is<RGBAColor>(lua, 1)) { luaL_argerror(lua, 1, badTypeErrorMessage); }
+    const auto & a = checkColor(lua, 1);
     auto multiplier = luaL_checknumber(lua, 2);
-
-    lua_createtable(lua, 4, 0);
-    luaL_getmetatable(lua, metatable<RGBAColor>::name);
-    lua_setmetatable(lua, -2);
-
-    for (int i = 1; i <= 3; ++i) {
-        lua_rawgeti(lua, 1, i);
-        lua_pushnumber(lua, lua_tonumber(lua, -1) * multiplier);
-        lua_rawseti(lua, -3, i);
-        lua_pop(lua, 1);
-    }
-    lua_rawgeti(lua, 1, 4);
-    lua_rawseti(lua, -2, 4);
+    lua_pushcolor(lua, a.red * multiplier, a.green * multiplier, a.blue * multiplier, a.alpha);
     return 1;
 }
 
 static int newIndex(lua_State * lua)
 {
-    lua_rawseti(lua, 1, indexForKey(lua, luaL_checkstring(lua, 2)));
-    return 1;
+    auto & channel = channelForKey(lua, lua_to<ScriptColor>(lua, 1), luaL_checkstring(lua, 2));
+    channel = luaL_checknumber(lua, 3);
+    return 0;
 }
 
 static int sub(lua_State * lua)
 {
-    if (!lua_is<RGBAColor>(lua, 1)) { luaL_argerror(lua, 1, badTypeErrorMessage); }
-    if (!lua_is<RGBAColor>(lua, 2)) { luaL_argerror(lua, 2, badTypeErrorMessage); }
-
-    lua_rawgeti(lua, 2, 4);
-    auto multiplier = lua_tonumber(lua, -1);
-
-    lua_createtable(lua, 4, 0);
-    luaL_getmetatable(lua, metatable<RGBAColor>::name);
-    lua_setmetatable(lua, -2);
-
-    for (int i = 1; i <= 3; ++i) {
-        lua_rawgeti(lua, 1, i);
-        lua_rawgeti(lua, 2, i);
-        lua_pushnumber(lua, lua_tonumber(lua, -2) - multiplier * lua_tonumber(lua, -1));
-        lua_rawseti(lua, -4, i);
-        lua_pop(lua, 2);
-    }
-    lua_rawgeti(lua, 1, 4);
-    lua_rawseti(lua, -2, 4);
+    const auto & a = checkColor(lua, 1);
+    const auto & b = checkColor(lua, 2);
+    lua_pushcolor(lua, a.red - b.alpha * b.red, a.green - b.alpha * b.green,
+                  a.blue - b.alpha * b.blue, a.alpha);
     return 1;
 }
 
 static int toString(lua_State * lua)
 {
+    const auto & a = lua_to<ScriptColor>(lua, 1);
     std::ostringstream buffer;
     buffer <<std::fixed <<std::setprecision(3);
-    buffer <<"color(";
-    lua_rawgeti(lua, 1, 1); buffer <<lua_tonumber(lua, -1) <<", ";
-    lua_rawgeti(lua, 1, 2); buffer <<lua_tonumber(lua, -1) <<", ";
-    lua_rawgeti(lua, 1, 3); buffer <<lua_tonumber(lua, -1) <<", ";
-    lua_rawgeti(lua, 1, 4); buffer <<lua_tonumber(lua, -1) <<")";
+    buffer <<"color(" <<a.red <<", " <<a.green <<", " <<a.blue <<", " <<a.alpha <<")";
     lua_pushstring(lua, buffer.str().c_str());
     return 1;
 }
+#endif
 
 /****************************************************************************/
 
-void lua_push(lua_State * lua, RGBAColor value)
+/// Sets up color support, FFI-based if running LuaJIT
+void openColors(lua_State * lua)
 {
+#ifdef LUAJIT_VERSION
     SAVE_TOP(lua);
-    lua_createtable(lua, 4, 0);
-    luaL_getmetatable(lua, metatable<RGBAColor>::name);
-    lua_setmetatable(lua, -2);
-    lua_pushnumber(lua, lua_Number(value.red) / 255.0);
-    lua_rawseti(lua, -2, 1);
-    lua_pushnumber(lua, lua_Number(value.green) / 255.0);
-    lua_rawseti(lua, -2, 2);
-    lua_pushnumber(lua, lua_Number(value.blue) / 255.0);
-    lua_rawseti(lua, -2, 3);
-    lua_pushnumber(lua, lua_Number(value.alpha) / 255.0);
-    lua_rawseti(lua, -2, 4);
-    CHECK_TOP(lua, +1);
+    if (luaL_loadbuffer(lua, colorFactoryCode, sizeof(colorFactoryCode) - 1, "=colors") != 0) {
+        lua_error(lua);
+    }                                                       // push(chunk)
+    lua_pushffi(lua);                                       // push(ffi)
+    lua_call(lua, 1, 2);                                    // pop(chunk, ffi) push(ctor, check)
+    lua_pushlightuserdata(lua, checkToken);
+    lua_insert(lua, -2);
+    lua_rawset(lua, LUA_REGISTRYINDEX);                     // pop(check)
+    lua_pushlightuserdata(lua, constructorToken);
+    lua_insert(lua, -2);
+    lua_rawset(lua, LUA_REGISTRYINDEX);                     // pop(ctor)
+    CHECK_TOP(lua, 0);
+#else
+    static_cast<void>(lua);
+#endif
 }
 
-RGBAColor lua_tocolor(lua_State * lua, int index)
+void lua_push(lua_State * lua, RGBAColor value)
+{
+    lua_pushcolor(lua, lua_Number(value.red) / 255.0, lua_Number(value.green) / 255.0,
+                  lua_Number(value.blue) / 255.0, lua_Number(value.alpha) / 255.0);
+}
+
+void lua_pushcolor(lua_State * lua, lua_Number red, lua_Number green,
+                   lua_Number blue, lua_Number alpha)
 {
     SAVE_TOP(lua);
-    lua_rawgeti(lua, index, 1);
-    lua_rawgeti(lua, index, 2);
-    lua_rawgeti(lua, index, 3);
-    lua_rawgeti(lua, index, 4);
-
-    if (!lua_isnumber(lua, -4) || !lua_isnumber(lua, -3) ||
-        !lua_isnumber(lua, -2) || !lua_isnumber(lua, -1)) {
-        luaL_argerror(lua, 2, badTypeErrorMessage);
-    }
+#ifdef LUAJIT_VERSION
+    lua_pushlightuserdata(lua, constructorToken);
+    lua_rawget(lua, LUA_REGISTRYINDEX);
+    lua_pushnumber(lua, red);
+    lua_pushnumber(lua, green);
+    lua_pushnumber(lua, blue);
+    lua_pushnumber(lua, alpha);
+    lua_call(lua, 4, 1);
+#else
+    lua_push(lua, ScriptColor{red, green, blue, alpha});
+#endif
+    CHECK_TOP(lua, +1);
+}
 
-    static constexpr unsigned channel_max = std::numeric_limits<RGBAColor::channel_type>::max();
-    auto result = RGBAColor(
-        RGBAColor::channel_type(std::min(channel_max, unsigned(256.0 * lua_tonumber(lua, -4)))),
-        RGBAColor::channel_type(std::min(channel_max, unsigned(256.0 * lua_tonumber(lua, -3)))),
-        RGBAColor::channel_type(std::min(channel_max, unsigned(256.0 * lua_tonumber(lua, -2)))),
-        RGBAColor::channel_type(std::min(channel_max, unsigned(256.0 * lua_tonumber(lua, -1))))
-    );
-    lua_pop(lua, 4);
-    CHECK_TOP(lua, 0);
+bool lua_iscolor(lua_State * lua, int index)
+{
+#ifdef LUAJIT_VERSION
+    if (lua_type(lua, index) != luaTypeCData) { return false; }
+    if (index < 0 && index > LUA_REGISTRYINDEX) { index = lua_gettop(lua) + index + 1; }
+    lua_pushlightuserdata(lua, checkToken);
+    lua_rawget(lua, LUA_REGISTRYINDEX);
+    lua_pushvalue(lua, index);
+    lua_call(lua, 1, 1);
+    bool result = lua_toboolean(lua, -1) != 0;
+    lua_pop(lua, 1);
     return result;
+#else
+    return lua_is<ScriptColor>(lua, index);
+#endif
+}
+
+RGBAColor lua_tocolor(lua_State * lua, int index)
+{
+    // FFI structs and userdata alike have the pointer point at the color itself
+    const auto & color = *static_cast<const ScriptColor *>(lua_topointer(lua, index));
+    const auto toChannel = [](lua_Number value) {
+        value *= 256.0;
+        if (!isFinite(value) || value <= 0.0) { return RGBAColor::channel_type(0); }
+        return RGBAColor::channel_type(std::min(value, 255.0));
+    };
+    return RGBAColor(toChannel(color.red), toChannel(color.green),
+                     toChannel(color.blue), toChannel(color.alpha));
 }
 
 RGBAColor lua_checkcolor(lua_State * lua, int index)
 {
-    if (!lua_is<RGBAColor>(lua, index)) {
+    if (!lua_iscolor(lua, index)) {
         luaL_argerror(lua, index, badTypeErrorMessage);
         // does not return
     }
@@ -230,8 +265,13 @@ RGBAColor lua_checkcolor(lua_State * lua, int index)
 
 /****************************************************************************/
 
-const char * const metatable<RGBAColor>::name = "LRGBAColor";
-const struct luaL_Reg metatable<RGBAColor>::meta_methods[] = {
+const char * const metatable<ScriptColor>::name = "LRGBAColor";
+#ifdef LUAJIT_VERSION
+const struct luaL_Reg metatable<ScriptColor>::meta_methods[] = {   // FFI metatype is used instead
+    { nullptr,      nullptr}
+};
+#else
+const struct luaL_Reg metatable<ScriptColor>::meta_methods[] = {
     { "__add",      add },
     { "__div",      div },
     { "__eq",       equal },
@@ -242,5 +282,6 @@ const struct luaL_Reg metatable<RGBAColor>::meta_methods[] = {
     { "__tostring", toString },
     { nullptr,      nullptr}
 };
+#endif
 
 } // namespace keyleds::lua
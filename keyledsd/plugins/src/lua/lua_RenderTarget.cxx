@@ -20,7 +20,8 @@
 #include "lua/Environment.h"
 #include "lua/lua_common.h"
 #include <algorithm>
-#include <cassert>
+#include <cstddef>
+#include <cstdint>
 #include <lua.hpp>
 
 using keyleds::KeyDatabase;
@@ -28,8 +29,75 @@ using keyleds::RenderTarget;
 
 namespace keyleds::lua {
 
+static void * const ownerToken = const_cast<void **>(&ownerToken);
+static void * const pixelsToken = const_cast<void **>(&pixelsToken);
+static void * const anchorsToken = const_cast<void **>(&anchorsToken);
+
+static_assert(sizeof(RGBAColor) == 4 && offsetof(RGBAColor, red) == 0 &&
+              offsetof(RGBAColor, green) == 1 && offsetof(RGBAColor, blue) == 2 &&
+              offsetof(RGBAColor, alpha) == 3,
+              "pixel views assume RGBAColor is four bytes in RGBA order");
+
+#ifdef LUAJIT_VERSION
+/// Builds FFI pixel views - (ffi, anchors) => (function(target, data, size) => view)
+static const char pixelsFactoryCode[] = R"lua(
+local ffi, anchors = ...
+local error, huge = error, math.huge
+ffi.cdef[[
+typedef struct { uint8_t red, green, blue, alpha; } keyleds_color;
+typedef struct { keyleds_color * data; uint32_t size; } keyleds_pixels;
+]]
+-- Clamps to 0-255, numbers that are not finite give 0. Conversion drops fractions.
+local function channel(v)
+    if v > 0 and v < huge then return v < 255 and v or 255 end
+    return 0
+end
+local methods = {}
+function methods.get(self, i)
+    if i < 1 or i > self.size then error("pixel index out of range", 2) end
+    local c = self.data[i - 1]
+    return c.red, c.green, c.blue, c.alpha
+end
+function methods.set(self, i, r, g, b, a)
+    if i < 1 or i > self.size then error("pixel index out of range", 2) end
+    local c = self.data[i - 1]
+    c.red, c.green, c.blue, c.alpha = channel(r), channel(g), channel(b), a and channel(a) or 255
+end
+local pixels = ffi.metatype("keyleds_pixels", {
+    __index = methods,
+    __len = function(self) return self.size end,
+})
+local cast = ffi.cast
+return function(target, data, size)
+    local view = pixels(cast("keyleds_color *", data), size)
+    anchors[view] = target
+    return view
+end
+)lua";
+#endif
+
 /****************************************************************************/
 
+/// Pushes the table mapping render target objects to the controller that created them - [0, +1]
+/// It is keyed on the lua object rather than the target address, as addresses get reused
+/// once a controller is gone. Keys are weak, entries remain until the object is finalized.
+static void pushOwnerTable(lua_State * lua)
+{
+    lua_pushlightuserdata(lua, ownerToken);
+    lua_rawget(lua, LUA_REGISTRYINDEX);
+    if (!lua_istable(lua, -1)) {
+        lua_pop(lua, 1);
+        lua_newtable(lua);
+        lua_createtable(lua, 0, 1);
+        lua_pushliteral(lua, "k");
+        lua_setfield(lua, -2, "__mode");
+        lua_setmetatable(lua, -2);
+        lua_pushlightuserdata(lua, ownerToken);
+        lua_pushvalue(lua, -2);
+        lua_rawset(lua, LUA_REGISTRYINDEX);
+    }
+}
+
 static int toTargetIndex(lua_State * lua, int idx) // 0-based
 {
     if (lua_is<const KeyDatabase::Key *>(lua, idx)) {
@@ -39,17 +107,8 @@ static int toTargetIndex(lua_State * lua, int idx) // 0-based
         return static_cast<int>(lua_tointeger(lua, idx) - 1);
     }
     if (lua_isstring(lua, idx)) {
-        size_t size;
-        const char * keyName = lua_tolstring(lua, idx, &size);
-
-        lua_getglobal(lua, "keyleds");
-        lua_getfield(lua, -1, "db");
-        if (!lua_is<const KeyDatabase *>(lua, -1)) {
-            return luaL_error(lua, "keyleds.db is not a valid database");
-        }
-
-        auto * db = lua_to<const KeyDatabase *>(lua, -1);
-        lua_pop(lua, 2);
+        const char * keyName = lua_tostring(lua, idx);
+        const auto * db = Environment(lua).keyDatabase();
 
         auto it = db->findName(keyName);
         if (it != db->end()) {
@@ -60,6 +119,44 @@ static int toTargetIndex(lua_State * lua, int idx) // 0-based
     return luaL_argerror(lua, idx, badTypeErrorMessage);
 }
 
+/// Invokes func with the 0-based target index of every key in a key group or
+/// a sequence of keys, indices and key names. Unknown keys are skipped.
+template <typename Func>
+static void forEachKey(lua_State * lua, int idx, const RenderTarget & target, Func func)
+{
+    if (lua_is<const KeyDatabase::KeyGroup *>(lua, idx)) {
+        const auto * group = lua_to<const KeyDatabase::KeyGroup *>(lua, idx);
+        std::size_t position = 0;
+        for (const auto & key : *group) {
+            func(position++, key.index);
+        }
+        return;
+    }
+    if (!lua_istable(lua, idx)) {
+        luaL_argerror(lua, idx, badTypeErrorMessage);
+        return;
+    }
+
+    const auto size = lua_objlen(lua, idx);
+    for (std::size_t position = 0; position < size; ++position) {
+        lua_rawgeti(lua, idx, static_cast<int>(position + 1));
+        int index = toTargetIndex(lua, -1);
+        lua_pop(lua, 1);
+        if (index >= 0 && static_cast<unsigned>(index) < target.size()) {
+            func(position, static_cast<std::size_t>(index));
+        }
+    }
+}
+
+/// Returns the number of entries forEachKey would iterate over, including skipped keys
+static std::size_t keyCount(lua_State * lua, int idx)
+{
+    if (lua_is<const KeyDatabase::KeyGroup *>(lua, idx)) {
+        return lua_to<const KeyDatabase::KeyGroup *>(lua, idx)->size();
+    }
+    return lua_objlen(lua, idx);
+}
+
 /****************************************************************************/
 
 static int blend(lua_State * lua)
@@ -95,6 +192,42 @@ static int fill(lua_State * lua)
     return 0;
 }
 
+static int fillRange(lua_State * lua)     // (target, first, last, color) => ()
+{
+    auto * to = lua_check<RenderTarget *>(lua, 1);
+    if (!to) { return luaL_argerror(lua, 1, noLongerExistsErrorMessage); }
+    auto first = std::max(luaL_checkinteger(lua, 2), lua_Integer(1));
+    auto last = std::min(luaL_checkinteger(lua, 3), static_cast<lua_Integer>(to->size()));
+    auto color = lua_checkcolor(lua, 4);
+
+    if (first <= last) {
+        std::fill(to->begin() + (first - 1), to->begin() + last, color);
+    }
+    return 0;
+}
+
+static int gradient(lua_State * lua)      // (target, keys, from, to) => ()
+{
+    auto * to = lua_check<RenderTarget *>(lua, 1);
+    if (!to) { return luaL_argerror(lua, 1, noLongerExistsErrorMessage); }
+    const auto colorA = lua_checkcolor(lua, 3);
+    const auto colorB = lua_checkcolor(lua, 4);
+
+    const auto count = keyCount(lua, 2);
+    const auto steps = static_cast<unsigned>(count > 1 ? count - 1 : 1);
+    const auto mix = [steps](unsigned a, unsigned b, unsigned step) {
+        return static_cast<RGBAColor::channel_type>((a * (steps - step) + b * step) / steps);
+    };
+    forEachKey(lua, 2, *to, [&](std::size_t position, std::size_t index) {
+        const auto step = static_cast<unsigned>(position);
+        (*to)[index] = RGBAColor(mix(colorA.red, colorB.red, step),
+                                 mix(colorA.green, colorB.green, step),
+                                 mix(colorA.blue, colorB.blue, step),
+                                 mix(colorA.alpha, colorB.alpha, step));
+    });
+    return 0;
+}
+
 static int multiply(lua_State * lua)
 {
     using keyleds::multiply;
@@ -108,6 +241,33 @@ static int multiply(lua_State * lua)
     return 0;
 }
 
+static int set(lua_State * lua)           // (target, keys, color) => ()
+{
+    auto * to = lua_check<RenderTarget *>(lua, 1);
+    if (!to) { return luaL_argerror(lua, 1, noLongerExistsErrorMessage); }
+    const auto color = lua_checkcolor(lua, 3);
+
+    forEachKey(lua, 2, *to, [&](std::size_t, std::size_t index) { (*to)[index] = color; });
+    return 0;
+}
+
+static int setMany(lua_State * lua)       // (target, keys, colors) => ()
+{
+    auto * to = lua_check<RenderTarget *>(lua, 1);
+    if (!to) { return luaL_argerror(lua, 1, noLongerExistsErrorMessage); }
+    luaL_checktype(lua, 3, LUA_TTABLE);
+
+    forEachKey(lua, 2, *to, [&](std::size_t position, std::size_t index) {
+        lua_rawgeti(lua, 3, static_cast<int>(position + 1));
+        if (!lua_iscolor(lua, -1)) {
+            luaL_error(lua, "bad color at position %d", static_cast<int>(position + 1));
+        }
+        (*to)[index] = lua_tocolor(lua, -1);
+        lua_pop(lua, 1);
+    });
+    return 0;
+}
+
 static int create(lua_State * lua)
 {
     auto * controller = Environment(lua).controller();
@@ -116,7 +276,13 @@ static int create(lua_State * lua)
     auto * target = controller->createRenderTarget();
     std::fill(target->begin(), target->end(), RGBAColor(0, 0, 0, 0));
 
-    lua_push(lua, target);
+    // Remember owner, as the collector may run while another effect is active
+    lua_push(lua, target);                                  // push(object)
+    pushOwnerTable(lua);                                    // push(owners)
+    lua_pushvalue(lua, -2);
+    lua_pushlightuserdata(lua, controller);
+    lua_rawset(lua, -3);
+    lua_pop(lua, 1);                                        // pop(owners)
     return 1;
 }
 
@@ -127,10 +293,18 @@ static int destroy(lua_State * lua)
     auto * target = lua_to<RenderTarget *>(lua, 1);
     if (!target) { return 0; }                  // object marked as gone already
 
-    auto * controller = Environment(lua).controller();
-    assert(controller);
-
-    controller->destroyRenderTarget(target);
+    pushOwnerTable(lua);                        // push(owners)
+    lua_pushvalue(lua, 1);
+    lua_rawget(lua, -2);                        // push(owner)
+    auto * controller = static_cast<Environment::Controller *>(lua_touserdata(lua, -1));
+    lua_pop(lua, 1);                            // pop(owner)
+    if (controller) {                           // target is not script-created otherwise
+        controller->destroyRenderTarget(target);
+        lua_pushvalue(lua, 1);
+        lua_pushnil(lua);
+        lua_rawset(lua, -3);
+    }
+    lua_pop(lua, 1);                            // pop(owners)
 
     lua_to<RenderTarget *>(lua, 1) = nullptr;   // mark object as gone
     return 0;
@@ -185,6 +359,145 @@ static int newIndex(lua_State * lua)
     return 0;
 }
 
+/** Returns a view on the colors of a target created with `RenderTarget:new()`.
+ * Views give raw access to colors as integers in 0-255 range. They keep the
+ * target alive, and their accesses are bounds checked. On LuaJIT, loops over
+ * views compile to plain memory accesses unless the effect sets jit to no.
+ */
+static int pixels(lua_State * lua)
+{
+    auto * target = lua_to<RenderTarget *>(lua, 1);
+    if (!target) { return luaL_error(lua, noLongerExistsErrorMessage); }
+
+    // Only script-created targets live as long as the userdata, others may disappear under the view
+    pushOwnerTable(lua);                                    // push(owners)
+    lua_pushvalue(lua, 1);
+    lua_rawget(lua, -2);                                    // push(owner)
+    bool owned = !lua_isnil(lua, -1);
+    lua_pop(lua, 2);                                        // pop(owners, owner)
+    if (!owned) { return luaL_error(lua, "pixels() requires a target created with RenderTarget:new()"); }
+
+#ifdef LUAJIT_VERSION
+    lua_pushlightuserdata(lua, pixelsToken);
+    lua_rawget(lua, LUA_REGISTRYINDEX);                     // push(factory)
+    lua_pushvalue(lua, 1);
+    lua_pushlightuserdata(lua, target->data());
+    lua_pushinteger(lua, static_cast<lua_Integer>(target->size()));
+    lua_call(lua, 3, 1);                                    // pop(factory, args) push(view)
+#else
+    lua_push(lua, RenderTargetPixels{target->data(), static_cast<unsigned>(target->size())});
+    lua_pushlightuserdata(lua, anchorsToken);
+    lua_rawget(lua, LUA_REGISTRYINDEX);                     // push(anchors)
+    lua_pushvalue(lua, -2);
+    lua_pushvalue(lua, 1);
+    lua_rawset(lua, -3);                                    // anchors[view] = target
+    lua_pop(lua, 1);                                        // pop(anchors)
+#endif
+    return 1;
+}
+
+/****************************************************************************/
+// Pixel view fallback, same interface as FFI views
+
+static RGBAColor & checkPixel(lua_State * lua)
+{
+    auto & view = lua_check<RenderTargetPixels>(lua, 1);
+    auto index = luaL_checknumber(lua, 2);
+    if (!(index >= 1 && index <= view.size)) { luaL_error(lua, "pixel index out of range"); }
+    return view.data[static_cast<unsigned>(index) - 1];
+}
+
+/// Converts a channel value the same way FFI views do
+static uint8_t toChannel(lua_State * lua, int index)
+{
+    const auto value = luaL_checknumber(lua, index);
+    if (!isFinite(value) || value <= 0) { return 0; }
+    return static_cast<uint8_t>(std::min(value, lua_Number(255)));
+}
+
+static int pixelsGet(lua_State * lua)
+{
+    const auto & color = checkPixel(lua);
+    lua_pushinteger(lua, color.red);
+    lua_pushinteger(lua, color.green);
+    lua_pushinteger(lua, color.blue);
+    lua_pushinteger(lua, color.alpha);
+    return 4;
+}
+
+static int pixelsSet(lua_State * lua)
+{
+    auto & color = checkPixel(lua);
+    color.red = toChannel(lua, 3);
+    color.green = toChannel(lua, 4);
+    color.blue = toChannel(lua, 5);
+    color.alpha = lua_isnoneornil(lua, 6) ? 255 : toChannel(lua, 6);
+    return 0;
+}
+
+static int pixelsIndex(lua_State * lua)
+{
+    if (lua_handleMethodIndex(lua, 2, metatable<RenderTargetPixels>::methods)) { return 1; }
+    return lua_keyError(lua, 2);
+}
+
+static int pixelsLen(lua_State * lua)
+{
+    lua_pushinteger(lua, static_cast<lua_Integer>(lua_check<RenderTargetPixels>(lua, 1).size));
+    return 1;
+}
+
+/// Sets up pixel views, FFI-based ones if running LuaJIT
+void openPixelAccess(lua_State * lua)
+{
+    SAVE_TOP(lua);
+
+    // Views keep their target alive through a weak-keyed table
+    lua_pushlightuserdata(lua, anchorsToken);
+    lua_newtable(lua);                                      // push(anchors)
+    lua_createtable(lua, 0, 1);
+    lua_pushliteral(lua, "k");
+    lua_setfield(lua, -2, "__mode");
+    lua_setmetatable(lua, -2);
+
+#ifdef LUAJIT_VERSION
+    lua_pushlightuserdata(lua, pixelsToken);
+    if (luaL_loadbuffer(lua, pixelsFactoryCode, sizeof(pixelsFactoryCode) - 1, "=pixels") != 0) {
+        lua_error(lua);
+    }                                                       // push(chunk)
+    lua_pushffi(lua);                                       // push(ffi)
+    lua_pushvalue(lua, -4);                                 // push(anchors)
+    lua_call(lua, 2, 1);                                    // pop(chunk, ffi, anchors) push(factory)
+    lua_rawset(lua, LUA_REGISTRYINDEX);                     // pop(token, factory)
+#endif
+
+    lua_rawset(lua, LUA_REGISTRYINDEX);                     // pop(token, anchors)
+    CHECK_TOP(lua, 0);
+}
+
+/****************************************************************************/
+
+/// Forgets render targets created by controller, which destroys them itself
+/// Their lua objects are marked as gone, so the collector does not free them again.
+void releaseRenderTargets(lua_State * lua, const void * controller)
+{
+    SAVE_TOP(lua);
+    pushOwnerTable(lua);                                    // push(owners)
+    lua_pushnil(lua);
+    while (lua_next(lua, -2) != 0) {                        // push(object, owner)
+        bool owned = lua_touserdata(lua, -1) == controller;
+        lua_pop(lua, 1);                                    // pop(owner)
+        if (owned) {
+            lua_to<RenderTarget *>(lua, -1) = nullptr;
+            lua_pushvalue(lua, -1);
+            lua_pushnil(lua);
+            lua_rawset(lua, -4);            // clearing existing fields is allowed while iterating
+        }
+    }
+    lua_pop(lua, 1);                                        // pop(owners)
+    CHECK_TOP(lua, 0);
+}
+
 /****************************************************************************/
 
 const char * const metatable<RenderTarget *>::name = "RenderTarget";
@@ -192,8 +505,13 @@ const struct luaL_Reg metatable<RenderTarget *>::methods[] = {
     { "blend",      blend },
     { "copy",       copy },
     { "fill",       fill },
+    { "fillRange",  fillRange },
+    { "gradient",   gradient },
     { "multiply",   multiply },
     { "new",        create },
+    { "pixels",     pixels },
+    { "set",        set },
+    { "setMany",    setMany },
     { nullptr,      nullptr }
 };
 const struct luaL_Reg metatable<RenderTarget *>::meta_methods[] = {
@@ -204,4 +522,16 @@ const struct luaL_Reg metatable<RenderTarget *>::meta_methods[] = {
     { nullptr,      nullptr}
 };
 
+const char * const metatable<RenderTargetPixels>::name = "RenderTargetPixels";
+const struct luaL_Reg metatable<RenderTargetPixels>::methods[] = {
+    { "get",        pixelsGet },
+    { "set",        pixelsSet },
+    { nullptr,      nullptr }
+};
+const struct luaL_Reg metatable<RenderTargetPixels>::meta_methods[] = {
+    { "__index",    pixelsIndex },
+    { "__len",      pixelsLen },
+    { nullptr,      nullptr}
+};
+
 } // namespace keyleds::lua
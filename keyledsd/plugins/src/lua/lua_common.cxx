@@ -16,6 +16,7 @@
  */
 #include "lua/lua_common.h"
 
+#include <cstdint>
 #include <cstring>
 #include <lua.hpp>
 
@@ -54,6 +55,35 @@ int lua_keyError(lua_State * lua, int index)
     return luaL_error(lua, badKeyErrorMessage, lua_tostring(lua, -1));
 }
 
+bool isFinite(double value)
+{
+    // Fast math lets the compiler assume numbers are finite, and drop any
+    // floating point check for it, so look at the exponent bits instead.
+    static_assert(sizeof(value) == sizeof(uint64_t), "double must be IEEE 754 binary64");
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return (bits & 0x7ff0000000000000u) != 0x7ff0000000000000u;
+}
+
+#ifdef LUAJIT_VERSION
+static void * const ffiToken = const_cast<void **>(&ffiToken);
+
+void lua_pushffi(lua_State * lua)
+{
+    // Opening ffi again would reset all C types, along with their metatypes
+    lua_pushlightuserdata(lua, ffiToken);
+    lua_rawget(lua, LUA_REGISTRYINDEX);
+    if (lua_isnil(lua, -1)) {
+        lua_pop(lua, 1);
+        lua_pushcfunction(lua, luaopen_ffi);
+        lua_call(lua, 0, 1);
+        lua_pushlightuserdata(lua, ffiToken);
+        lua_pushvalue(lua, -2);
+        lua_rawset(lua, LUA_REGISTRYINDEX);
+    }
+}
+#endif
+
 /****************************************************************************/
 
 } // namespace keyleds::lua
@@ -35,8 +35,8 @@ void detail::registerType(lua_State * lua, const char * name,
     luaL_newmetatable(lua, name);
     luaL_register(lua, nullptr, metaMethods);
 
-    // metatable["__metatable"] = nil   -- makes metatable invisible to lua
-    lua_pushnil(lua);
+    // metatable["__metatable"] = false -- makes metatable invisible to lua
+    lua_pushboolean(lua, false);
     lua_setfield(lua, -2, "__metatable");
 
     lua_pop(lua, 1);
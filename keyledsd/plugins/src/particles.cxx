@@ -0,0 +1,302 @@
+/* Keyleds -- Gaming keyboard tool
+ * Copyright (C) 2017 Julien Hartmann, juli1.hartmann@gmail.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "keyledsd/PluginHelper.h"
+#include "keyledsd/tools/accelerated.h"
+#include "keyledsd/tools/utils.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <random>
+#include <vector>
+
+using namespace std::literals::chrono_literals;
+
+static constexpr unsigned maxParticles = 16384;
+static constexpr unsigned gridColumns = 256;    // horizontal resolution of key lookup grid
+static constexpr float pi = 3.14159265358979f;
+static constexpr auto white = keyleds::RGBAColor{255, 255, 255, 255};
+
+/****************************************************************************/
+
+namespace keyleds::plugin {
+
+class ParticlesEffect final : public SimpleEffect
+{
+    using KeyGroup = KeyDatabase::KeyGroup;
+    static constexpr uint32_t noKey = std::numeric_limits<uint32_t>::max();
+
+    /// Particle state. Each attribute has its own array, so motion can be vectorized.
+    struct Particles
+    {
+        std::vector<float>      x, y;       ///< position, in layout units
+        std::vector<float>      vx, vy;     ///< velocity, in layout units per second
+        std::vector<float>      life;       ///< remaining lifetime, in seconds
+        std::vector<float>      fade;       ///< inverse of total lifetime
+        std::vector<RGBAColor>  color;      ///< color at birth
+        std::size_t             size = 0;   ///< number of live particles, all at front
+    };
+
+public:
+    explicit ParticlesEffect(EffectService & service)
+     : m_keyDB(service.keyDB()),
+       m_colors(getConfig<std::vector<RGBAColor>>(service, "colors")
+                .value_or(std::vector<RGBAColor>{white})),
+       m_keys(getConfig<KeyGroup>(service, "group")),
+       m_capacity(std::clamp(getConfig<unsigned>(service, "number").value_or(1024u),
+                             1u, maxParticles)),
+       m_rate(float(getConfig<unsigned>(service, "rate").value_or(0u))),
+       m_burst(getConfig<unsigned>(service, "burst").value_or(m_rate > 0.0f ? 0u : 16u)),
+       m_lifetime(std::max(getConfig<milliseconds>(service, "lifetime").value_or(1s), milliseconds(1))),
+       m_direction(float(getConfig<unsigned>(service, "direction").value_or(0u) % 360u) * pi / 180.0f),
+       m_spread(float(std::min(getConfig<unsigned>(service, "spread").value_or(360u), 360u)) * pi / 180.0f),
+       m_x0(float(m_keyDB.bounds().x0)), m_y0(float(m_keyDB.bounds().y0)),
+       m_x1(float(m_keyDB.bounds().x1)), m_y1(float(m_keyDB.bounds().y1)),
+       // Speeds are given in thousandths of keyboard width per second, like ripple's width
+       m_speed(float(getConfig<unsigned>(service, "speed").value_or(500u)) * (m_x1 - m_x0) / 1000.0f),
+       m_gravity(float(getConfig<unsigned>(service, "gravity").value_or(0u)) * (m_x1 - m_x0) / 1000.0f),
+       m_gridRows(std::max(unsigned(std::ceil(float(gridColumns) * (m_y1 - m_y0) / (m_x1 - m_x0))), 1u)),
+       m_grid(buildGrid(m_keyDB, gridColumns, m_gridRows)),
+       m_sums(m_keyDB.size(), {{0.0f, 0.0f, 0.0f, 0.0f}}),
+       m_buffer(m_keyDB.size())
+    {
+        for (auto * array : { &m_particles.x, &m_particles.y, &m_particles.vx, &m_particles.vy,
+                              &m_particles.life, &m_particles.fade }) {
+            array->resize(m_capacity);
+        }
+        m_particles.color.resize(m_capacity);
+        m_touched.reserve(m_keyDB.size());
+    }
+
+    static ParticlesEffect * create(EffectService & service)
+    {
+        const auto & bounds = service.keyDB().bounds();
+        if (!(bounds.x0 < bounds.x1 && bounds.y0 < bounds.y1)) {
+            service.log(logging::info::value, "effect requires a valid layout");
+            return nullptr;
+        }
+        return new ParticlesEffect(service);
+    }
+
+    void render(milliseconds elapsed, RenderTarget & target) override
+    {
+        const float dt = float(elapsed.count()) / 1000.0f;
+        move(dt);
+
+        // Continuous emission, from random keys of the group, dropping what the pool cannot hold
+        m_pending = std::min(m_pending + m_rate * dt, float(m_capacity - m_particles.size));
+        while (m_pending >= 1.0f) {
+            spawn(randomKey());
+            m_pending -= 1.0f;
+        }
+
+        splat();
+        if (m_touched.empty()) { return; }
+        blend(target, m_buffer, m_touched.data(), m_touched.size());
+    }
+
+    void handleKeyEvent(const KeyDatabase::Key & key, bool press) override
+    {
+        if (!press || m_burst == 0) { return; }
+        if (m_keys && std::find(m_keys->begin(), m_keys->end(), key) == m_keys->end()) { return; }
+        for (unsigned idx = 0; idx < m_burst; ++idx) { spawn(key); }
+    }
+
+private:
+    /// Advances all particles, and removes those that died or left the keyboard
+    void move(float dt)
+    {
+        auto & p = m_particles;
+        tools::integrate(p.x.data(), p.vx.data(), 0.0f, dt, p.size);
+        tools::integrate(p.y.data(), p.vy.data(), m_gravity, dt, p.size);
+
+        for (std::size_t idx = 0; idx < p.size; ++idx) { p.life[idx] -= dt; }
+
+        std::size_t idx = 0;
+        while (idx < p.size) {
+            if (p.life[idx] > 0.0f && p.x[idx] >= m_x0 && p.x[idx] < m_x1
+                                   && p.y[idx] >= m_y0 && p.y[idx] < m_y1) {
+                ++idx;
+                continue;
+            }
+            // Dead particle: last one takes its slot, order does not matter
+            --p.size;
+            p.x[idx] = p.x[p.size];
+            p.y[idx] = p.y[p.size];
+            p.vx[idx] = p.vx[p.size];
+            p.vy[idx] = p.vy[p.size];
+            p.life[idx] = p.life[p.size];
+            p.fade[idx] = p.fade[p.size];
+            p.color[idx] = p.color[p.size];
+        }
+    }
+
+    /// Adds the light of each particle to the key under it, then resolves key colors
+    void splat()
+    {
+        auto & p = m_particles;
+        const float scaleX = float(gridColumns) / (m_x1 - m_x0);
+        const float scaleY = float(m_gridRows) / (m_y1 - m_y0);
+
+        m_touched.clear();
+        for (std::size_t idx = 0; idx < p.size; ++idx) {
+            const auto column = std::min(unsigned((p.x[idx] - m_x0) * scaleX), gridColumns - 1);
+            const auto row = std::min(unsigned((p.y[idx] - m_y0) * scaleY), m_gridRows - 1);
+            const auto key = m_grid[row * gridColumns + column];
+            if (key == noKey) { continue; }
+
+            const auto & color = p.color[idx];
+            const float weight = float(color.alpha) * std::min(p.life[idx] * p.fade[idx], 1.0f);
+            if (weight <= 0.0f) { continue; }
+            auto & sum = m_sums[key];
+            if (sum[3] == 0.0f) { m_touched.push_back(key); }
+            sum[0] += float(color.red) * weight;
+            sum[1] += float(color.green) * weight;
+            sum[2] += float(color.blue) * weight;
+            sum[3] += weight;
+        }
+
+        // Particles on a key add up: its color is their average, its opacity their total
+        for (std::size_t idx = 0; idx < m_touched.size(); ++idx) {
+            auto & sum = m_sums[m_touched[idx]];
+            m_buffer[idx] = RGBAColor(
+                RGBAColor::channel_type(sum[0] / sum[3]),
+                RGBAColor::channel_type(sum[1] / sum[3]),
+                RGBAColor::channel_type(sum[2] / sum[3]),
+                RGBAColor::channel_type(std::min(sum[3], 255.0f))
+            );
+            sum = {{0.0f, 0.0f, 0.0f, 0.0f}};
+        }
+    }
+
+    /// Creates a particle on given key, unless all particles are in use
+    void spawn(const KeyDatabase::Key & key)
+    {
+        auto & p = m_particles;
+        if (p.size >= m_capacity) { return; }
+        const auto & rect = key.position;
+        if (rect.x1 <= rect.x0 || rect.y1 <= rect.y0) { return; }
+
+        auto unit = std::uniform_real_distribution<float>(0.0f, 1.0f);
+        const auto idx = p.size++;
+        p.x[idx] = float(rect.x0) + unit(m_random) * float(rect.x1 - rect.x0);
+        p.y[idx] = float(rect.y0) + unit(m_random) * float(rect.y1 - rect.y0);
+
+        // Angles go clockwise from upwards, and layout y axis points down
+        const float angle = m_direction + (unit(m_random) - 0.5f) * m_spread;
+        const float speed = m_speed * (0.5f + 0.5f * unit(m_random));
+        p.vx[idx] = std::sin(angle) * speed;
+        p.vy[idx] = -std::cos(angle) * speed;
+
+        const float lifetime = float(m_lifetime.count()) / 1000.0f * (0.5f + 0.5f * unit(m_random));
+        p.life[idx] = lifetime;
+        p.fade[idx] = 1.0f / lifetime;
+
+        if (m_colors.empty()) {
+            auto channel = std::uniform_int_distribution<unsigned>(0, 255);
+            p.color[idx] = RGBAColor(RGBAColor::channel_type(channel(m_random)),
+                                     RGBAColor::channel_type(channel(m_random)),
+                                     RGBAColor::channel_type(channel(m_random)), 255);
+        } else {
+            auto pick = std::uniform_int_distribution<std::size_t>(0, m_colors.size() - 1);
+            p.color[idx] = m_colors[pick(m_random)];
+        }
+    }
+
+    const KeyDatabase::Key & randomKey()
+    {
+        if (m_keys && !m_keys->empty()) {
+            auto pick = std::uniform_int_distribution<KeyGroup::size_type>(0, m_keys->size() - 1);
+            return (*m_keys)[pick(m_random)];
+        }
+        auto pick = std::uniform_int_distribution<KeyDatabase::size_type>(0, m_keyDB.size() - 1);
+        return m_keyDB[pick(m_random)];
+    }
+
+    /// Maps grid cells to the key under their center, or the nearest within half a cell
+    static std::vector<uint32_t> buildGrid(const KeyDatabase & keyDB, unsigned columns, unsigned rows)
+    {
+        const auto bounds = keyDB.bounds();
+        const float cellWidth = float(bounds.x1 - bounds.x0) / float(columns);
+        const float cellHeight = float(bounds.y1 - bounds.y0) / float(rows);
+        const auto cellX = [&](unsigned column) { return float(bounds.x0) + (float(column) + 0.5f) * cellWidth; };
+        const auto cellY = [&](unsigned row) { return float(bounds.y0) + (float(row) + 0.5f) * cellHeight; };
+
+        auto grid = std::vector<uint32_t>(std::size_t(columns) * rows, noKey);
+        for (const auto & key : keyDB) {
+            const auto & rect = key.position;
+            for (unsigned row = 0; row < rows; ++row) {
+                if (cellY(row) < float(rect.y0) || cellY(row) > float(rect.y1)) { continue; }
+                for (unsigned column = 0; column < columns; ++column) {
+                    if (cellX(column) < float(rect.x0) || cellX(column) > float(rect.x1)) { continue; }
+                    grid[row * columns + column] = uint32_t(key.index);
+                }
+            }
+        }
+
+        // Cells in gaps in between keys go to the nearest one
+        const float reach = std::max(cellWidth, cellHeight) / 2.0f;
+        for (unsigned row = 0; row < rows; ++row) {
+            for (unsigned column = 0; column < columns; ++column) {
+                auto & cell = grid[row * columns + column];
+                if (cell != noKey) { continue; }
+                const float x = cellX(column), y = cellY(row);
+                float best = reach * reach;
+                for (const auto & key : keyDB) {
+                    const auto & rect = key.position;
+                    if (rect.x1 <= rect.x0 || rect.y1 <= rect.y0) { continue; }
+                    const float dx = std::max({float(rect.x0) - x, 0.0f, x - float(rect.x1)});
+                    const float dy = std::max({float(rect.y0) - y, 0.0f, y - float(rect.y1)});
+                    if (dx * dx + dy * dy <= best) {
+                        best = dx * dx + dy * dy;
+                        cell = uint32_t(key.index);
+                    }
+                }
+            }
+        }
+        return grid;
+    }
+
+private:
+    const KeyDatabase &             m_keyDB;        ///< keys of the device, for grid and emission
+    const std::vector<RGBAColor>    m_colors;       ///< list of colors to choose from
+    const std::optional<KeyGroup>   m_keys;         ///< keys that emit particles
+    const std::size_t               m_capacity;     ///< maximum number of live particles
+    const float                     m_rate;         ///< particles emitted per second
+    const unsigned                  m_burst;        ///< particles emitted per key press
+    const milliseconds              m_lifetime;     ///< maximum particle lifetime
+    const float                     m_direction;    ///< emission direction, in radians
+    const float                     m_spread;       ///< emission cone angle, in radians
+    const float                     m_x0, m_y0, m_x1, m_y1; ///< keyboard bounds
+    const float                     m_speed;        ///< maximum emission speed, in units per second
+    const float                     m_gravity;      ///< downwards acceleration, in units per second²
+    const unsigned                  m_gridRows;     ///< vertical resolution of key lookup grid
+    const std::vector<uint32_t>     m_grid;         ///< key index under each cell, or noKey
+
+    Particles                       m_particles;    ///< all particle state
+    float                           m_pending = 0.0f; ///< fraction of a particle due for emission
+    std::vector<std::array<float, 4>> m_sums;       ///< weighted color sums and total weight, per key
+    std::vector<uint32_t>           m_touched;      ///< index of keys with particles this frame
+    RenderTarget                    m_buffer;       ///< color of each touched key
+    std::minstd_rand                m_random;       ///< drives emission
+};
+
+KEYLEDSD_SIMPLE_EFFECT("particles", ParticlesEffect);
+
+} // namespace keyleds::plugin
@@ -0,0 +1,247 @@
+/* Keyleds -- Gaming keyboard tool
+ * Copyright (C) 2017 Julien Hartmann, juli1.hartmann@gmail.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "keyledsd/PluginHelper.h"
+#include "keyledsd/tools/FrameFile.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std::literals::chrono_literals;
+namespace frame_file = keyleds::tools::frame_file;
+
+/****************************************************************************/
+
+namespace keyleds::plugin {
+
+/** Read-only memory mapping of a frame file
+ *
+ * Validates the header once, then gives direct access to names and frames.
+ * Frames are never copied: pages are loaded on demand and shared with the
+ * page cache.
+ */
+class FrameFile final
+{
+public:
+    /// Maps given file, returns an empty object and sets error on failure
+    static FrameFile open(const std::string & path, std::string & error)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            error = "cannot open " + path + ": " + std::strerror(errno);
+            return {};
+        }
+        struct stat info;
+        if (::fstat(fd, &info) < 0 || info.st_size < off_t(sizeof(frame_file::Header))) {
+            ::close(fd);
+            error = path + " is not a frame file";
+            return {};
+        }
+        const auto size = std::size_t(info.st_size);
+        void * data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED) {
+            error = "cannot map " + path + ": " + std::strerror(errno);
+            return {};
+        }
+
+        auto file = FrameFile(static_cast<const uint8_t *>(data), size);
+        if (!file.validate()) {
+            error = path + " is not a valid frame file";
+            return {};
+        }
+        return file;
+    }
+
+    FrameFile() = default;
+    FrameFile(FrameFile && other) noexcept
+     : m_data(other.m_data), m_size(other.m_size) { other.m_data = nullptr; }
+    FrameFile & operator=(FrameFile && other) noexcept
+     { std::swap(m_data, other.m_data); std::swap(m_size, other.m_size); return *this; }
+    ~FrameFile() { if (m_data) { ::munmap(const_cast<uint8_t *>(m_data), m_size); } }
+
+    explicit operator bool() const noexcept { return m_data != nullptr; }
+    const frame_file::Header & header() const
+        { return *reinterpret_cast<const frame_file::Header *>(m_data); }
+    const char * names() const
+        { return reinterpret_cast<const char *>(m_data + sizeof(frame_file::Header)); }
+    const RGBAColor * frame(std::size_t idx) const
+    {
+        return reinterpret_cast<const RGBAColor *>(
+            m_data + sizeof(frame_file::Header) + header().namesSize
+        ) + idx * header().stride;
+    }
+
+private:
+    FrameFile(const uint8_t * data, std::size_t size) : m_data(data), m_size(size) {}
+
+    bool validate() const
+    {
+        const auto & head = header();
+        if (std::memcmp(head.magic, frame_file::magic, sizeof(head.magic)) != 0 ||
+            head.version != frame_file::version) { return false; }
+        if (head.keyCount == 0 || head.frameCount == 0 || head.frameDuration == 0) { return false; }
+        if (head.stride < head.keyCount || head.stride % frame_file::align(1, sizeof(RGBAColor)) != 0 ||
+            head.namesSize % frame_file::alignment != 0) { return false; }
+
+        const auto frameSize = uint64_t(head.stride) * sizeof(RGBAColor);
+        if (sizeof(frame_file::Header) + uint64_t(head.namesSize)
+            + uint64_t(head.frameCount) * frameSize > m_size) { return false; }
+
+        // Names section must hold keyCount NUL-terminated strings
+        const char * names = this->names();
+        return std::count(names, names + head.namesSize, '\0') >= std::ptrdiff_t(head.keyCount);
+    }
+
+private:
+    const uint8_t * m_data = nullptr;   ///< start of mapping
+    std::size_t     m_size = 0;         ///< size of mapping, in bytes
+};
+
+/****************************************************************************/
+
+/** Pre-rendered animation effect
+ *
+ * Plays back frames from a frame file, as written by keyledsd-animation.
+ * Frames are blended straight from the file mapping. When interpolation is
+ * enabled, in-between frames are computed into a small buffer instead.
+ */
+class PlaybackEffect final : public SimpleEffect
+{
+    /// A sequence of consecutive keys in file that all exist on device
+    struct Run final
+    {
+        uint32_t    first;      ///< index of first key in file
+        uint32_t    count;      ///< number of keys
+    };
+
+public:
+    PlaybackEffect(EffectService & service, FrameFile && file)
+     : m_file(std::move(file)),
+       m_frameDuration(getConfig<milliseconds>(service, "duration")
+                        .value_or(milliseconds(m_file.header().frameDuration))),
+       m_interpolate(getConfig<bool>(service, "interpolate").value_or(true)),
+       m_loop(getConfig<bool>(service, "loop").value_or(true)),
+       m_totalDuration(m_frameDuration * m_file.header().frameCount),
+       m_indices(m_file.header().keyCount, 0),
+       m_buffer(m_file.header().stride)
+    {
+        const auto & keyDB = service.keyDB();
+        const char * name = m_file.names();
+        for (uint32_t idx = 0; idx < m_file.header().keyCount; ++idx) {
+            auto it = *name != '\0' ? keyDB.findName(name) : keyDB.end();
+            if (it != keyDB.end()) {
+                m_indices[idx] = uint32_t(it->index);
+                if (!m_runs.empty() && m_runs.back().first + m_runs.back().count == idx) {
+                    ++m_runs.back().count;
+                } else {
+                    m_runs.push_back(Run{idx, 1});
+                }
+            }
+            name += std::strlen(name) + 1;
+        }
+    }
+
+    static PlaybackEffect * create(EffectService & service)
+    {
+        auto path = getConfig<std::string>(service, "file");
+        if (!path) {
+            service.log(logging::error::value, "file must be set to a frame file");
+            return nullptr;
+        }
+        std::string error;
+        auto file = FrameFile::open(*path, error);
+        if (!file) {
+            service.log(logging::error::value, error.c_str());
+            return nullptr;
+        }
+        if (getConfig<milliseconds>(service, "duration").value_or(1ms) == 0ms) {
+            service.log(logging::error::value, "duration must not be zero");
+            return nullptr;
+        }
+
+        auto effect = new PlaybackEffect(service, std::move(file));
+        if (effect->m_runs.empty()) {
+            service.log(logging::error::value, "no key in frame file matches device");
+            delete effect;
+            return nullptr;
+        }
+        return effect;
+    }
+
+    void render(milliseconds elapsed, RenderTarget & target) override
+    {
+        const auto frameCount = m_file.header().frameCount;
+        const auto lastFrame = m_frameDuration * (frameCount - 1);
+
+        m_time += elapsed;
+        if (m_loop) {
+            m_time %= m_totalDuration;
+        } else {
+            m_time = std::min(m_time, lastFrame);
+        }
+
+        const auto frame = m_time / m_frameDuration;
+        const auto phase = m_time % m_frameDuration;
+        const RGBAColor * colors = m_file.frame(frame);
+        if (m_interpolate && phase > 0ms) {
+            const auto next = (frame + 1) % frameCount;
+            interpolate(colors, m_file.frame(next), phase.count() * 256 / m_frameDuration.count());
+            colors = m_buffer.data();
+        }
+
+        for (const auto & run : m_runs) {
+            blend(target, colors + run.first, m_indices.data() + run.first, run.count);
+        }
+    }
+
+private:
+    /// Computes a frame in between a and b, weight going from 0 (a) to 256 (b)
+    void interpolate(const RGBAColor * a, const RGBAColor * b, unsigned weight)
+    {
+        const auto * from = reinterpret_cast<const uint8_t *>(a);
+        const auto * to = reinterpret_cast<const uint8_t *>(b);
+        auto * out = reinterpret_cast<uint8_t *>(m_buffer.data());
+        const auto length = m_file.header().keyCount * sizeof(RGBAColor);
+        for (std::size_t idx = 0; idx < length; ++idx) {
+            out[idx] = uint8_t((from[idx] * (256 - weight) + to[idx] * weight) >> 8);
+        }
+    }
+
+private:
+    const FrameFile         m_file;             ///< mapped frame file
+    const milliseconds      m_frameDuration;    ///< time each frame is shown
+    const bool              m_interpolate;      ///< whether to fade from one frame to the next
+    const bool              m_loop;             ///< whether to restart after last frame
+    const milliseconds      m_totalDuration;    ///< time it takes to play all frames
+
+    std::vector<uint32_t>   m_indices;          ///< device key index of each key in file
+    std::vector<Run>        m_runs;             ///< keys of file that exist on device
+    std::vector<RGBAColor>  m_buffer;           ///< interpolated frame
+    milliseconds            m_time = 0ms;       ///< position in animation
+};
+
+KEYLEDSD_SIMPLE_EFFECT("playback", PlaybackEffect);
+
+} // namespace keyleds::plugin
@@ -0,0 +1,145 @@
+/* Keyleds -- Gaming keyboard tool
+ * Copyright (C) 2017 Julien Hartmann, juli1.hartmann@gmail.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "keyledsd/PluginHelper.h"
+#include "keyledsd/tools/utils.h"
+#include <algorithm>
+#include <cmath>
+#include <optional>
+#include <vector>
+
+using namespace std::literals::chrono_literals;
+
+static constexpr auto white = keyleds::RGBAColor{255, 255, 255, 255};
+
+/****************************************************************************/
+
+namespace keyleds::plugin {
+
+class RippleEffect final : public SimpleEffect
+{
+    using KeyGroup = KeyDatabase::KeyGroup;
+
+    struct Ripple
+    {
+        const KeyDatabase::Key *    origin; ///< Key the ring expands from, null if slot is free
+        milliseconds                age;    ///< How long ago the ring was spawned
+    };
+
+public:
+    explicit RippleEffect(EffectService & service, milliseconds duration)
+     : m_keyDB(service.keyDB()),
+       m_color(getConfig<RGBAColor>(service, "color").value_or(white)),
+       m_keys(getConfig<KeyGroup>(service, "group")),
+       m_speed(float(m_keyDB.bounds().x1 - m_keyDB.bounds().x0) / float(duration.count())),
+       m_halfWidth(float(m_keyDB.bounds().x1 - m_keyDB.bounds().x0)
+                   * float(getConfig<unsigned>(service, "width").value_or(150u)) / 2000.0f),
+       m_reach(std::hypot(float(m_keyDB.bounds().x1 - m_keyDB.bounds().x0),
+                          float(m_keyDB.bounds().y1 - m_keyDB.bounds().y0)) + m_halfWidth),
+       m_ripples(std::clamp(getConfig<unsigned>(service, "number").value_or(8u), 1u, 64u),
+                 Ripple{nullptr, 0ms}),
+       m_buffer(m_keyDB.size())
+    {
+        auto transparent = m_color;
+        transparent.alpha = 0;
+        std::fill(m_buffer.begin(), m_buffer.end(), transparent);
+    }
+
+    static RippleEffect * create(EffectService & service)
+    {
+        const auto & bounds = service.keyDB().bounds();
+        if (!(bounds.x0 < bounds.x1 && bounds.y0 < bounds.y1)) {
+            service.log(logging::info::value, "effect requires a valid layout");
+            return nullptr;
+        }
+        auto duration = getConfig<milliseconds>(service, "duration").value_or(1s);
+        if (duration < 100ms) {
+            service.log(logging::error::value, "minimum value for duration is 100ms");
+            return nullptr;
+        }
+        return new RippleEffect(service, duration);
+    }
+
+    void render(milliseconds elapsed, RenderTarget & target) override
+    {
+        bool active = false;
+        for (auto & ripple : m_ripples) {
+            if (!ripple.origin) { continue; }
+            ripple.age += elapsed;
+            if (front(ripple) >= m_reach) {
+                ripple.origin = nullptr;
+            } else {
+                active = true;
+            }
+        }
+        if (!active) { return; }
+
+        if (m_keys) {
+            for (const auto & key : *m_keys) { m_buffer[key.index].alpha = intensity(key); }
+        } else {
+            for (const auto & key : m_keyDB) { m_buffer[key.index].alpha = intensity(key); }
+        }
+        blend(target, m_buffer);
+    }
+
+    void handleKeyEvent(const KeyDatabase::Key & key, bool press) override
+    {
+        if (!press) { return; }
+
+        // Reuse a free slot, or replace the oldest ring if pool is full
+        auto it = std::max_element(m_ripples.begin(), m_ripples.end(),
+                                   [](const auto & a, const auto & b) {
+                                       return (a.origin ? a.age : milliseconds::max())
+                                            < (b.origin ? b.age : milliseconds::max());
+                                   });
+        *it = Ripple{&key, 0ms};
+    }
+
+private:
+    /// Distance from origin the ring has reached
+    float front(const Ripple & ripple) const { return m_speed * float(ripple.age.count()); }
+
+    /// Alpha value of a key, from the brightest ring passing over it
+    RGBAColor::channel_type intensity(const KeyDatabase::Key & key) const
+    {
+        float level = 0.0f;
+        for (const auto & ripple : m_ripples) {
+            if (!ripple.origin) { continue; }
+            auto position = front(ripple);
+            auto offset = std::abs(float(m_keyDB.distance(*ripple.origin, key)) - position);
+            if (offset >= m_halfWidth) { continue; }
+
+            // Rings are brightest at their center line, and fade as they expand
+            level = std::max(level, (1.0f - offset / m_halfWidth) * (1.0f - position / m_reach));
+        }
+        return RGBAColor::channel_type(float(m_color.alpha) * level);
+    }
+
+private:
+    const KeyDatabase &             m_keyDB;    ///< device keys, with precomputed distances
+    const RGBAColor                 m_color;    ///< color of rings at their brightest
+    const std::optional<KeyGroup>   m_keys;     ///< what keys the effect applies to
+    const float                     m_speed;    ///< how fast rings expand, in layout units per ms
+    const float                     m_halfWidth;///< half the thickness of rings, in layout units
+    const float                     m_reach;    ///< distance at which rings vanish
+
+    std::vector<Ripple>             m_ripples;  ///< fixed pool of rings, allocated once
+    RenderTarget                    m_buffer;   ///< this plugin's rendered state
+};
+
+KEYLEDSD_SIMPLE_EFFECT("ripple", RippleEffect);
+
+} // namespace keyleds::plugin
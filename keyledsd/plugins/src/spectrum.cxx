@@ -0,0 +1,445 @@
+/* Keyleds -- Gaming keyboard tool
+ * Copyright (C) 2017 Julien Hartmann, juli1.hartmann@gmail.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "keyledsd/PluginHelper.h"
+#include "keyledsd/tools/utils.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstring>
+#include <endian.h>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std::literals::chrono_literals;
+
+static constexpr unsigned fftSize = 1024;           // samples per analysis window
+static constexpr unsigned hopSize = fftSize / 2;    // new samples per analysis, windows overlap
+static constexpr unsigned maxBands = 64;
+static constexpr float minFrequency = 40.0f;        // lower edge of first band, in Hz
+static constexpr float maxFrequency = 16000.0f;     // upper edge of last band, in Hz
+static constexpr float floorDecibels = -60.0f;      // level shown as an empty bar
+static constexpr float fallSpeed = 1.5f;            // bar height lost per second when quiet
+static constexpr auto green = keyleds::RGBAColor{0, 255, 0, 255};
+static constexpr auto yellow = keyleds::RGBAColor{255, 255, 0, 255};
+static constexpr auto red = keyleds::RGBAColor{255, 0, 0, 255};
+
+static_assert(fftSize >= 4 && (fftSize & (fftSize - 1)) == 0, "fftSize must be a power of two");
+
+/****************************************************************************/
+
+namespace keyleds::plugin {
+
+/** Power spectrum of real signals
+ *
+ * Computes a real FFT of size N through a complex FFT of size N/2, with
+ * even samples in the real part and odd samples in the imaginary part.
+ */
+class RealFFT final
+{
+    using complex = std::complex<float>;
+public:
+    explicit RealFFT(unsigned size)
+     : m_half(size / 2), m_reversed(m_half), m_twiddles(m_half), m_data(m_half)
+    {
+        unsigned bits = 0;
+        while ((1u << bits) < m_half) { ++bits; }
+        for (unsigned idx = 0; idx < m_half; ++idx) {
+            unsigned reversed = 0;
+            for (unsigned bit = 0; bit < bits; ++bit) {
+                reversed |= ((idx >> bit) & 1u) << (bits - 1 - bit);
+            }
+            m_reversed[idx] = reversed;
+        }
+        for (unsigned idx = 0; idx < m_half; ++idx) {
+            m_twiddles[idx] = std::polar(1.0f, -2.0f * float(M_PI) * float(idx) / float(size));
+        }
+    }
+
+    /// Squared magnitudes of bins 0 to N/2, from N real samples
+    void power(const float * input, float * output)
+    {
+        for (unsigned idx = 0; idx < m_half; ++idx) {
+            m_data[m_reversed[idx]] = complex(input[2 * idx], input[2 * idx + 1]);
+        }
+
+        // Iterative radix-2 butterflies, twiddles of size len are every N/len entries
+        for (unsigned len = 2; len <= m_half; len *= 2) {
+            const unsigned stride = 2 * m_half / len;
+            for (unsigned base = 0; base < m_half; base += len) {
+                for (unsigned idx = 0; idx < len / 2; ++idx) {
+                    auto even = m_data[base + idx];
+                    auto odd = m_data[base + idx + len / 2] * m_twiddles[idx * stride];
+                    m_data[base + idx] = even + odd;
+                    m_data[base + idx + len / 2] = even - odd;
+                }
+            }
+        }
+
+        // Split interleaved result into spectrum of the real signal
+        output[0] = std::norm(m_data[0].real() + m_data[0].imag());
+        output[m_half] = std::norm(m_data[0].real() - m_data[0].imag());
+        for (unsigned idx = 1; idx < m_half; ++idx) {
+            auto value = m_data[idx];
+            auto mirror = std::conj(m_data[m_half - idx]);
+            auto even = (value + mirror) * 0.5f;
+            auto odd = (value - mirror) * complex(0.0f, -0.5f);
+            output[idx] = std::norm(even + m_twiddles[idx] * odd);
+        }
+    }
+
+private:
+    const unsigned          m_half;         ///< size of complex transform
+    std::vector<unsigned>   m_reversed;     ///< bit-reversed permutation of indices
+    std::vector<complex>    m_twiddles;     ///< exp(-2iπk/N) for k < N/2
+    std::vector<complex>    m_data;         ///< transform workspace
+};
+
+/****************************************************************************/
+
+/** Background audio analysis
+ *
+ * Reads signed 16-bit little-endian PCM from a file descriptor on its own
+ * thread, and publishes band levels through a lock-free buffer exchange. Regular
+ * files are read at the sample rate and looped, so recordings can stand in
+ * for a live source.
+ */
+class SpectrumAnalyzer final
+{
+    using levels_type = std::array<float, maxBands>;
+    using clock = std::chrono::steady_clock;
+    static constexpr unsigned freshFlag = 4;    ///< set in m_shared when it holds unread levels
+public:
+    /// Takes ownership of both the PCM source and the wakeup pipe
+    SpectrumAnalyzer(int fd, const int (&wakeup)[2], unsigned rate, unsigned channels, unsigned bands)
+     : m_fd(fd), m_wakeup{wakeup[0], wakeup[1]}, m_rate(rate), m_channels(channels), m_bands(bands),
+       m_paced(isRegularFile(fd)),
+       m_edges(computeEdges(rate, bands)),
+       m_window(fftSize), m_history(fftSize, 0.0f), m_samples(fftSize),
+       m_power(fftSize / 2 + 1), m_fft(fftSize)
+    {
+        for (unsigned idx = 0; idx < fftSize; ++idx) {
+            m_window[idx] = 0.5f - 0.5f * std::cos(2.0f * float(M_PI) * float(idx) / float(fftSize));
+        }
+        for (auto & slot : m_slots) { slot.fill(0.0f); }
+        m_thread = std::thread(&SpectrumAnalyzer::run, this);
+    }
+
+    ~SpectrumAnalyzer()
+    {
+        char byte = 0;
+        while (::write(m_wakeup[1], &byte, 1) < 0 && errno == EINTR) {}
+        m_thread.join();
+        ::close(m_wakeup[0]);
+        ::close(m_wakeup[1]);
+        ::close(m_fd);
+    }
+
+    /// Latest published levels, from 0 to 1, one per band. Only call from one thread.
+    const float * levels()
+    {
+        if (m_shared.load(std::memory_order_relaxed) & freshFlag) {
+            m_front = m_shared.exchange(m_front, std::memory_order_acq_rel) & ~freshFlag;
+        }
+        return m_slots[m_front].data();
+    }
+
+private:
+    void run()
+    {
+        std::vector<int16_t> frames(hopSize * m_channels);
+        auto nextHop = clock::now();
+        const auto hopDuration = std::chrono::duration_cast<clock::duration>(
+            std::chrono::duration<float>(float(hopSize) / float(m_rate))
+        );
+
+        for (;;) {
+            if (m_paced) {
+                if (!sleepUntil(nextHop)) { return; }
+                nextHop = std::max(nextHop + hopDuration, clock::now() - 4 * hopDuration);
+            }
+            if (!readFully(reinterpret_cast<char *>(frames.data()), frames.size() * sizeof(int16_t))) {
+                return;
+            }
+            analyze(frames);
+        }
+    }
+
+    void analyze(const std::vector<int16_t> & frames)
+    {
+        // Slide history and append new samples, downmixed to mono
+        std::copy(m_history.begin() + hopSize, m_history.end(), m_history.begin());
+        const float scale = 1.0f / (32768.0f * float(m_channels));
+        for (unsigned idx = 0; idx < hopSize; ++idx) {
+            int sum = 0;
+            for (unsigned channel = 0; channel < m_channels; ++channel) {
+                sum += int16_t(le16toh(uint16_t(frames[idx * m_channels + channel])));
+            }
+            m_history[fftSize - hopSize + idx] = float(sum) * scale;
+        }
+
+        for (unsigned idx = 0; idx < fftSize; ++idx) { m_samples[idx] = m_history[idx] * m_window[idx]; }
+        m_fft.power(m_samples.data(), m_power.data());
+
+        // A full-scale sine peaks at N/4 once windowed, use that as 0dB
+        constexpr float reference = 16.0f / (float(fftSize) * float(fftSize));
+        const float fall = fallSpeed * float(hopSize) / float(m_rate);
+        auto & levels = m_slots[m_back];
+        for (unsigned band = 0; band < m_bands; ++band) {
+            auto peak = *std::max_element(m_power.begin() + m_edges[band],
+                                          m_power.begin() + m_edges[band + 1]);
+            auto decibels = 10.0f * std::log10(peak * reference + 1e-12f);
+            auto level = std::clamp(1.0f - decibels / floorDecibels, 0.0f, 1.0f);
+            m_current[band] = std::max(level, m_current[band] - fall);
+        }
+        std::copy(m_current.begin(), m_current.end(), levels.begin());
+        m_back = m_shared.exchange(m_back | freshFlag, std::memory_order_acq_rel) & ~freshFlag;
+    }
+
+    /// Reads exactly size bytes, waiting for data as needed. Returns false when stopping.
+    bool readFully(char * buffer, std::size_t size)
+    {
+        while (size > 0) {
+            auto nread = ::read(m_fd, buffer, size);
+            if (nread > 0) {
+                buffer += nread;
+                size -= std::size_t(nread);
+                continue;
+            }
+            if (nread < 0 && errno == EINTR) { continue; }
+            if (nread == 0 && m_paced) {
+                // End of recording, loop around and back off if it is empty
+                if (::lseek(m_fd, 0, SEEK_SET) < 0 || !sleepUntil(clock::now() + 100ms)) { return false; }
+                continue;
+            }
+            if (nread == 0) {
+                // No writer on pipe, it will show up as readable when one connects
+                if (!sleepUntil(clock::now() + 100ms)) { return false; }
+                continue;
+            }
+            if (errno != EAGAIN) {
+                sleepUntil(clock::time_point::max());   // broken source, idle until stopped
+                return false;
+            }
+            struct pollfd fds[] = { {m_fd, POLLIN, 0}, {m_wakeup[0], POLLIN, 0} };
+            if (::poll(fds, 2, -1) < 0 && errno != EINTR) { return false; }
+            if (fds[1].revents) { return false; }
+        }
+        return true;
+    }
+
+    /// Waits until given time point. Returns false if stop was requested meanwhile.
+    bool sleepUntil(clock::time_point when)
+    {
+        for (;;) {
+            auto now = clock::now();
+            int timeout = -1;
+            if (when != clock::time_point::max()) {
+                if (when <= now) { return true; }
+                timeout = int(std::chrono::ceil<std::chrono::milliseconds>(when - now).count());
+            }
+            struct pollfd fds = { m_wakeup[0], POLLIN, 0 };
+            auto ret = ::poll(&fds, 1, timeout);
+            if (ret > 0) { return false; }
+            if (ret < 0 && errno != EINTR) { return false; }
+        }
+    }
+
+    static bool isRegularFile(int fd)
+    {
+        struct stat info;
+        return ::fstat(fd, &info) == 0 && S_ISREG(info.st_mode);
+    }
+
+    /// FFT bin boundaries of bands, spaced logarithmically
+    static std::vector<unsigned> computeEdges(unsigned rate, unsigned bands)
+    {
+        const auto bins = fftSize / 2 + 1;
+        const auto top = std::min(maxFrequency, float(rate) / 2.0f);
+        std::vector<unsigned> edges(bands + 1);
+        for (unsigned band = 0; band <= bands; ++band) {
+            auto frequency = minFrequency * std::pow(top / minFrequency, float(band) / float(bands));
+            edges[band] = std::min(unsigned(std::lround(frequency * fftSize / float(rate))), bins - 1);
+        }
+        for (unsigned band = 0; band < bands; ++band) {   // each band gets at least one bin
+            edges[band + 1] = std::clamp(edges[band + 1], edges[band] + 1, bins);
+            edges[band] = std::min(edges[band], bins - 1);
+        }
+        return edges;
+    }
+
+private:
+    const int                   m_fd;           ///< PCM source, owned
+    const int                   m_wakeup[2];    ///< pipe signaling analysis thread to stop, owned
+    const unsigned              m_rate;         ///< samples per second
+    const unsigned              m_channels;     ///< interleaved channels per frame
+    const unsigned              m_bands;        ///< number of bands actually used
+    const bool                  m_paced;       ///< read at sample rate rather than when data comes
+    const std::vector<unsigned> m_edges;        ///< first FFT bin of each band, plus end
+    std::vector<float>          m_window;       ///< Hann window coefficients
+    std::vector<float>          m_history;      ///< last fftSize mono samples
+    std::vector<float>          m_samples;      ///< windowed samples
+    std::vector<float>          m_power;        ///< squared magnitude of FFT bins
+    RealFFT                     m_fft;
+    levels_type                 m_current = {}; ///< analysis thread's view of levels
+
+    std::array<levels_type, 3>  m_slots;        ///< front, back and shared level buffers
+    std::atomic<unsigned>       m_shared = 1;   ///< slot available for exchange, with freshFlag
+    unsigned                    m_back = 0;     ///< slot owned by analysis thread
+    unsigned                    m_front = 2;    ///< slot owned by render thread
+
+    std::thread                 m_thread;
+};
+
+/****************************************************************************/
+
+class SpectrumEffect final : public SimpleEffect
+{
+    using KeyGroup = KeyDatabase::KeyGroup;
+
+    /// Precomputed placement of a key in the bar graph
+    struct Cell
+    {
+        KeyDatabase::Key::index_type    index;  ///< key index in render targets
+        unsigned                        band;   ///< band shown by the key's column
+        float                           bottom; ///< level at which key starts lighting up
+        float                           scale;  ///< inverse of key height, in levels
+    };
+
+public:
+    SpectrumEffect(EffectService & service, int fd, const int (&wakeup)[2],
+                   unsigned rate, unsigned channels)
+     : m_buffer(service.keyDB().size())
+    {
+        const auto & keyDB = service.keyDB();
+        const auto bands = std::clamp(getConfig<unsigned>(service, "bands").value_or(20u), 1u, maxBands);
+        auto colors = getConfig<std::vector<RGBAColor>>(service, "colors")
+                      .value_or(std::vector<RGBAColor>{green, yellow, red});
+        if (colors.empty()) { colors.push_back(green); }
+        const auto keys = getConfig<KeyGroup>(service, "group");
+
+        // Bars grow upwards, layout y axis points downwards
+        const auto bounds = keyDB.bounds();
+        const auto height = float(bounds.y1 - bounds.y0);
+        auto addKey = [&](const KeyDatabase::Key & key) {
+            auto center = keyDB.center(key);
+            auto bottom = float(bounds.y1 - key.position.y1) / height;
+            auto top = float(bounds.y1 - key.position.y0) / height;
+            m_cells.push_back(Cell{
+                key.index,
+                std::min(unsigned(center.x * float(bands)), bands - 1),
+                bottom,
+                1.0f / std::max(top - bottom, 1e-3f)
+            });
+            m_buffer[key.index] = sample(colors, 1.0f - center.y);
+        };
+        std::fill(m_buffer.begin(), m_buffer.end(), RGBAColor{0, 0, 0, 0});
+        if (keys) {
+            for (const auto & key : *keys) { addKey(key); }
+        } else {
+            for (const auto & key : keyDB) { addKey(key); }
+        }
+        m_alphas.reserve(m_cells.size());
+        for (const auto & cell : m_cells) { m_alphas.push_back(m_buffer[cell.index].alpha); }
+
+        m_analyzer.emplace(fd, wakeup, rate, channels, bands);
+    }
+
+    static SpectrumEffect * create(EffectService & service)
+    {
+        const auto & bounds = service.keyDB().bounds();
+        if (!(bounds.x0 < bounds.x1 && bounds.y0 < bounds.y1)) {
+            service.log(logging::info::value, "effect requires a valid layout");
+            return nullptr;
+        }
+        auto source = getConfig<std::string>(service, "source");
+        if (!source || source->empty()) {
+            service.log(logging::error::value, "source must be set to a PCM file or FIFO");
+            return nullptr;
+        }
+        auto rate = getConfig<unsigned>(service, "rate").value_or(44100u);
+        auto channels = getConfig<unsigned>(service, "channels").value_or(2u);
+        if (rate < 8000 || rate > 192000 || channels < 1 || channels > 8) {
+            service.log(logging::error::value, "unsupported rate or channel count");
+            return nullptr;
+        }
+
+        int fd = ::open(source->c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0) {
+            auto msg = "cannot open " + *source + ": " + std::strerror(errno);
+            service.log(logging::error::value, msg.c_str());
+            return nullptr;
+        }
+        int wakeup[2];
+        if (::pipe2(wakeup, O_CLOEXEC | O_NONBLOCK) < 0) {
+            ::close(fd);
+            service.log(logging::error::value, "cannot create pipe");
+            return nullptr;
+        }
+        return new SpectrumEffect(service, fd, wakeup, rate, channels);
+    }
+
+    void render(milliseconds, RenderTarget & target) override
+    {
+        const auto * levels = m_analyzer->levels();
+        for (std::size_t idx = 0; idx < m_cells.size(); ++idx) {
+            const auto & cell = m_cells[idx];
+            auto fill = std::clamp((levels[cell.band] - cell.bottom) * cell.scale, 0.0f, 1.0f);
+            m_buffer[cell.index].alpha = RGBAColor::channel_type(float(m_alphas[idx]) * fill);
+        }
+        blend(target, m_buffer);
+    }
+
+private:
+    /// Interpolates a list of colors, position going from 0 to 1
+    static RGBAColor sample(const std::vector<RGBAColor> & colors, float position)
+    {
+        auto scaled = std::clamp(position, 0.0f, 1.0f) * float(colors.size() - 1);
+        auto first = std::min(std::size_t(scaled), colors.size() - 1);
+        auto second = std::min(first + 1, colors.size() - 1);
+        auto ratio = scaled - float(first);
+        auto mix = [ratio](auto a, auto b) {
+            return RGBAColor::channel_type(float(a) * (1.0f - ratio) + float(b) * ratio);
+        };
+        return RGBAColor{
+            mix(colors[first].red, colors[second].red),
+            mix(colors[first].green, colors[second].green),
+            mix(colors[first].blue, colors[second].blue),
+            mix(colors[first].alpha, colors[second].alpha)
+        };
+    }
+
+private:
+    RenderTarget                            m_buffer;   ///< this plugin's rendered state
+    std::vector<Cell>                       m_cells;    ///< keys the effect applies to
+    std::vector<RGBAColor::channel_type>    m_alphas;   ///< full alpha of each cell's color
+    std::optional<SpectrumAnalyzer>         m_analyzer; ///< started once cells are ready
+};
+
+KEYLEDSD_SIMPLE_EFFECT("spectrum", SpectrumEffect);
+
+} // namespace keyleds::plugin
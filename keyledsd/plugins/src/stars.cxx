@@ -17,14 +17,13 @@
 #include "keyledsd/PluginHelper.h"
 #include "keyledsd/tools/utils.h"
 #include <algorithm>
+#include <cstdint>
 #include <optional>
 #include <random>
 #include <vector>
 
 using namespace std::literals::chrono_literals;
 
-static constexpr auto transparent = keyleds::RGBAColor{0, 0, 0, 0};
-
 /****************************************************************************/
 
 namespace keyleds::plugin {
@@ -46,15 +45,15 @@ public:
        m_colors(getConfig<std::vector<RGBAColor>>(service, "colors")
                 .value_or(std::vector<RGBAColor>{{255u, 255u, 255u, 255u}})),
        m_duration(getConfig<milliseconds>(service, "duration").value_or(1s)),
-       m_keys(getConfig<KeyGroup>(service, "group")),
-       m_buffer(*service.createRenderTarget())
+       m_keys(getConfig<KeyGroup>(service, "group"))
     {
         auto number = std::clamp(getConfig<KeyDatabase::size_type>(service, "number").value_or(8),
                                  KeyDatabase::size_type{1u}, service.keyDB().size());
         m_stars.resize(number);
 
         // Get ready
-        std::fill(m_buffer.begin(), m_buffer.end(), transparent);
+        m_buffer = RenderTarget(number);
+        m_indices.resize(number);
 
         for (std::size_t idx = 0; idx < m_stars.size(); ++idx) {
             auto & star = m_stars[idx];
@@ -65,25 +64,25 @@ public:
 
     void render(milliseconds elapsed, RenderTarget & target) override
     {
-        for (auto & star : m_stars) {
+        for (std::size_t idx = 0; idx < m_stars.size(); ++idx) {
+            auto & star = m_stars[idx];
             star.age += elapsed;
             if (star.age >= m_duration) { rebirth(star); }
-            m_buffer[star.key->index] = RGBAColor(
+            m_buffer[idx] = RGBAColor(
                 star.color.red,
                 star.color.green,
                 star.color.blue,
                 RGBAColor::channel_type(star.color.alpha * (m_duration - star.age) / m_duration)
             );
+            m_indices[idx] = uint32_t(star.key->index);
         }
 
-        blend(target, m_buffer);
+        // Only keys holding a star are touched, the rest of the keyboard is left alone
+        blend(target, m_buffer, m_indices.data(), m_indices.size());
     }
 
     void rebirth(Star & star)
     {
-        if (star.key != nullptr) {
-            m_buffer[star.key->index] = transparent;
-        }
         if (m_keys) {
             using distribution = std::uniform_int_distribution<KeyGroup::size_type>;
             star.key = &(*m_keys)[distribution(0, m_keys->size() - 1)(m_random)];
@@ -113,7 +112,8 @@ private:
     const milliseconds              m_duration; ///< how long stars stay alive
     const std::optional<KeyGroup>   m_keys;     ///< what keys the effect applies to.
 
-    RenderTarget &          m_buffer;           ///< this plugin's rendered state
+    RenderTarget            m_buffer;           ///< current color of each star
+    std::vector<uint32_t>   m_indices;          ///< key index of each star
     std::minstd_rand        m_random;           ///< picks stars when they are reborn
     std::vector<Star>       m_stars;            ///< all the star objects
 };
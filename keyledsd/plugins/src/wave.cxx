@@ -20,6 +20,7 @@
 #include <cassert>
 #include <cmath>
 #include <cstddef>
+#include <cstdint>
 #include <optional>
 #include <string>
 
@@ -41,16 +42,16 @@ class WaveEffect final : public SimpleEffect
     using KeyGroup = KeyDatabase::KeyGroup;
 public:
     explicit WaveEffect(EffectService & service, milliseconds period)
-     : m_service(service),
-       m_period(period),
+     : m_period(period),
        m_keys(getConfig<KeyGroup>(service, "group")),
-       m_phases(computePhases(service.keyDB(), m_keys,
+       m_buffer(m_keys ? RenderTarget(m_keys->size()) : RenderTarget(service.keyDB().size())),
+       m_indices(computeIndices(m_keys)),
+       m_phases(computePhases(service.keyDB(), m_keys, m_buffer.capacity(),
                 getConfig<unsigned long>(service, "length").value_or(1000u),
                 float(getConfig<unsigned long>(service, "direction").value_or(0)))),
        m_colors(generateColorTable(
            getConfig<std::vector<RGBAColor>>(service, "colors").value_or(std::vector<RGBAColor>{})
-       )),
-       m_buffer(*service.createRenderTarget())
+       ))
     {
         std::fill(m_buffer.begin(), m_buffer.end(), transparent);
     }
@@ -75,31 +76,39 @@ public:
         m_time += elapsed;
         if (m_time >= m_period) { m_time -= m_period; }
 
-        auto t = accuracy * m_time / m_period;
+        if (m_buffer.capacity() == 0) { return; }
+        auto t = uint32_t(accuracy * m_time / m_period);
 
-        if (m_keys) {
-            assert(m_keys->size() == m_phases.size());
-            for (KeyGroup::size_type idx = 0; idx < m_keys->size(); ++idx) {
-                auto tphi = (t >= m_phases[idx] ? 0 : accuracy) + t - m_phases[idx];
+        assert(m_phases.size() == m_buffer.capacity());
+        tools::sample_table(reinterpret_cast<uint8_t *>(m_buffer.data()),
+                            reinterpret_cast<const uint8_t *>(m_colors.data()),
+                            m_phases.data(), t, accuracy - 1, m_buffer.capacity());
 
-                m_buffer[(*m_keys)[idx].index] = m_colors[tphi];
-            }
+        if (m_keys) {
+            blend(target, m_buffer, m_indices.data(), m_indices.size());
         } else {
-            const auto & keyDB = m_service.keyDB();
-            assert(keyDB.size() == m_phases.size());
-            for (KeyDatabase::size_type idx = 0; idx < keyDB.size(); ++idx) {
-                auto tphi = (t >= m_phases[idx] ? 0 : accuracy) + t - m_phases[idx];
-
-                m_buffer[keyDB[idx].index] = m_colors[tphi];
-            }
+            blend(target, m_buffer);
         }
-        blend(target, m_buffer);
     }
 
 private:
-    static std::vector<unsigned>
+    /// Target slot of each buffer entry, only used when effect is limited to a key group
+    static std::vector<uint32_t>
+    computeIndices(const std::optional<KeyGroup> & keys)
+    {
+        auto indices = std::vector<uint32_t>();
+        if (keys) {
+            indices.reserve(keys->size());
+            for (const auto & key : *keys) { indices.push_back(uint32_t(key.index)); }
+        }
+        return indices;
+    }
+
+    /// Phase of each buffer entry. Group keys are packed in group order, while
+    /// whole keyboard renders use target slots directly. Padding entries get a null phase.
+    static std::vector<uint32_t>
     computePhases(const KeyDatabase & keyDB, const std::optional<KeyGroup> & keys,
-                  const unsigned long length, const float direction)
+                  std::size_t capacity, const unsigned long length, const float direction)
     {
         auto freqX = length > 0
                    ? 1000.0f / float(length) * std::sin(2.0f * pi / 360.0f * direction)
@@ -107,28 +116,23 @@ private:
         auto freqY = length > 0
                    ? 1000.0f / float(length) * std::cos(2.0f * pi / 360.0f * direction)
                    : 0.0f;
-        auto bounds = keyDB.bounds();
-
         auto keyPhase = [&](const auto & key) {
-            auto x = (key.position.x0 + key.position.x1) / 2u;
-            auto y = (key.position.y0 + key.position.y1) / 2u;
+            auto center = keyDB.center(key);
 
             // Reverse Y axis as keyboard layout uses top<down
-            auto xpos = float(x - bounds.x0) / float(bounds.x1 - bounds.x0);
-            auto ypos = 1.0f - float(y - bounds.x0) / float(bounds.x1 - bounds.x0);
+            auto xpos = center.x;
+            auto ypos = 1.0f - center.y;
 
             auto phase = std::fmod(freqX * xpos + freqY * ypos, 1.0f);
             if (phase < 0.0f) { phase += 1.0f; }
-            return unsigned(phase * accuracy);
+            return uint32_t(phase * accuracy);
         };
 
-        auto phases = std::vector<unsigned>();
+        auto phases = std::vector<uint32_t>(capacity, 0);
         if (keys) {
-            phases.resize(keys->size());
             std::transform(keys->begin(), keys->end(), phases.begin(), keyPhase);
         } else {
-            phases.resize(keyDB.size());
-            std::transform(keyDB.begin(), keyDB.end(), phases.begin(), keyPhase);
+            for (const auto & key : keyDB) { phases[key.index] = keyPhase(key); }
         }
         return phases;
     }
@@ -158,14 +162,15 @@ private:
     }
 
 private:
-    const EffectService &           m_service;
     const milliseconds              m_period;   ///< total duration of a cycle.
     const std::optional<KeyGroup>   m_keys;     ///< what keys the effect applies to.
-    const std::vector<unsigned>     m_phases;   ///< one per key in m_keys or one per key in m_buffer.
-                                                ///< From 0 (no phase shift) to 1000 (2*pi shift)
+    RenderTarget                    m_buffer;   ///< this plugin's rendered state, one entry per
+                                                ///< key in m_keys or one per slot of target
+    const std::vector<uint32_t>     m_indices;  ///< target slot of each entry, when using m_keys
+    const std::vector<uint32_t>     m_phases;   ///< one per entry of m_buffer, padding included.
+                                                ///< From 0 (no phase shift) to accuracy (2*pi shift)
     const std::vector<RGBAColor>    m_colors;   ///< pre-computed color samples.
 
-    RenderTarget &                  m_buffer;   ///< this plugin's rendered state
     milliseconds                    m_time = 0ms; ///< time since beginning of current cycle.
 };
 
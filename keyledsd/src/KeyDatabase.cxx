@@ -42,6 +42,7 @@ static std::size_t relationIndex(const KeyDatabase::Key & a, const KeyDatabase::
 KEYLEDSD_EXPORT KeyDatabase::KeyDatabase(key_list keys)
  : m_keys(std::move(keys)),
    m_bounds(::keyleds::bounds(m_keys.cbegin(), m_keys.cend())),
+   m_centers(computeCenters(m_keys, m_bounds)),
    m_relations(computeRelations(m_keys))
 {
 #ifndef NDEBUG
@@ -105,6 +106,24 @@ KeyDatabase::relation_list KeyDatabase::computeRelations(const key_list & keys)
     return result;
 }
 
+KeyDatabase::point_list KeyDatabase::computeCenters(const key_list & keys, const Rect & bounds)
+{
+    // Degenerate layouts put all keys in the middle rather than dividing by zero
+    auto scale = [](position_type value, position_type low, position_type high) {
+        return high > low ? (float(value) / 2.0f - float(low)) / float(high - low) : 0.5f;
+    };
+
+    KeyDatabase::point_list result;
+    result.reserve(keys.size());
+    for (const auto & key : keys) {
+        result.push_back(Point{
+            scale(key.position.x0 + key.position.x1, bounds.x0, bounds.x1),
+            scale(key.position.y0 + key.position.y1, bounds.y0, bounds.y1)
+        });
+    }
+    return result;
+}
+
 /****************************************************************************/
 
 KEYLEDSD_EXPORT KeyDatabase::KeyGroup::KeyGroup(std::string name, key_list keys)
@@ -24,6 +24,8 @@ using keyleds::RenderTarget;
 
 static_assert(std::is_pod<keyleds::RGBAColor>::value, "RGBAColor must be a POD type");
 static_assert(sizeof(keyleds::RGBAColor) == 4, "RGBAColor must be tightly packed");
+static_assert(std::is_pod<keyleds::RGBA64Color>::value, "RGBA64Color must be a POD type");
+static_assert(sizeof(keyleds::RGBA64Color) == 8, "RGBA64Color must be tightly packed");
 
 // 16 is minimum for SSE2, 32 for AVX2
 static constexpr auto alignBytes = static_cast<std::align_val_t>(32);
@@ -46,17 +48,49 @@ KEYLEDSD_EXPORT RenderTarget::RenderTarget(size_type size)
    m_colors(new (operator new[](m_capacity * sizeof(RGBAColor), alignBytes)) RGBAColor[m_size])
 {}
 
+KEYLEDSD_EXPORT RenderTarget::RenderTarget(size_type size, Precision precision)
+ : RenderTarget(size)
+{
+    if (precision == Precision::High) {
+        // Value-initialized, so wide colors never hold garbage below narrow ones
+        m_wideColors = new (operator new[](m_capacity * sizeof(RGBA64Color), alignBytes))
+                       RGBA64Color[m_capacity]();
+    }
+}
+
 KEYLEDSD_EXPORT RenderTarget::~RenderTarget()
 {
     std::destroy(begin(), end());
     operator delete[](m_colors, alignBytes);
+    if (m_wideColors) {
+        std::destroy(m_wideColors, m_wideColors + m_capacity);
+        operator delete[](m_wideColors, alignBytes);
+    }
+}
+
+KEYLEDSD_EXPORT void RenderTarget::syncWide() noexcept
+{
+    if (!m_wideColors) { return; }
+    auto * wide = reinterpret_cast<uint16_t *>(m_wideColors);
+    const auto * narrow = reinterpret_cast<const uint8_t *>(m_colors);
+
+    for (size_type idx = 0; idx < 4 * m_capacity; ++idx) {
+        if ((wide[idx] >> 8) != narrow[idx]) {
+            wide[idx] = static_cast<uint16_t>(narrow[idx] * 257);
+        }
+    }
 }
 
 KEYLEDSD_EXPORT void RenderTarget::clear() noexcept
 {
     std::destroy(begin(), end());
     operator delete[](m_colors, alignBytes);
+    if (m_wideColors) {
+        std::destroy(m_wideColors, m_wideColors + m_capacity);
+        operator delete[](m_wideColors, alignBytes);
+    }
     m_size = 0;
     m_capacity = 0;
     m_colors = nullptr;
+    m_wideColors = nullptr;
 }
@@ -0,0 +1,318 @@
+/* Keyleds -- Gaming keyboard tool
+ * Copyright (C) 2017 Julien Hartmann, juli1.hartmann@gmail.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/** Frame file converter
+ *
+ * Rasterizes a sequence of images onto the keys of a layout, and writes the
+ * result as a frame file for the playback effect. Images are stretched over
+ * the bounding box of all keys, and each key gets the average color of the
+ * pixels it covers.
+ *
+ * Images are read in netpbm format, which most tools can write, eg:
+ *     convert animation.gif -coalesce frame-%03d.pam
+ */
+#include "keyledsd/device/LayoutDescription.h"
+#include "keyledsd/logging.h"
+#include "keyledsd/tools/FrameFile.h"
+#include "keyledsd/tools/utils.h"
+#include "keyleds.h"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <clocale>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using keyleds::device::LayoutDescription;
+namespace frame_file = keyleds::tools::frame_file;
+
+/****************************************************************************/
+// Command line parsing
+
+class Options final
+{
+public:
+    std::string                 layoutPath;
+    std::string                 outputPath;
+    unsigned                    frameDuration = 100;
+    std::vector<std::string>    framePaths;
+
+    static std::optional<Options> parse(int & argc, char * argv[])
+    {
+        Options options;
+        int opt;
+        ::opterr = 0;
+        while ((opt = ::getopt(argc, argv, ":d:hl:o:")) >= 0) {
+            switch(opt) {
+            case 'd': {
+                auto value = keyleds::tools::parseNumber(optarg);
+                if (!value || *value == 0 || *value > 0xffffffffu) {
+                    std::cerr <<argv[0] <<": invalid frame duration '" <<optarg <<"'\n";
+                    return std::nullopt;
+                }
+                options.frameDuration = unsigned(*value);
+                break;
+            }
+            case 'l': options.layoutPath = optarg; break;
+            case 'o': options.outputPath = optarg; break;
+            case 'h':
+                std::cout <<"Usage: " <<argv[0] <<" [-d duration] [-h] -l layout -o path frame...\n";
+                return std::nullopt;
+            case ':':
+                std::cerr <<argv[0] <<": option -- '" <<char(::optopt) <<"' requires an argument\n";
+                return std::nullopt;
+            default:
+                std::cerr <<argv[0] <<": invalid option -- '" <<char(::optopt) <<"'\n";
+                return std::nullopt;
+            }
+        }
+        if (options.layoutPath.empty() || options.outputPath.empty() || ::optind >= argc) {
+            std::cerr <<"Usage: " <<argv[0] <<" [-d duration] [-h] -l layout -o path frame...\n";
+            return std::nullopt;
+        }
+        options.framePaths.assign(argv + ::optind, argv + argc);
+        return options;
+    }
+};
+
+/****************************************************************************/
+// Image loading
+
+/// A decoded image, with 8-bit RGBA pixels
+struct Image final
+{
+    unsigned                width;
+    unsigned                height;
+    std::vector<uint8_t>    pixels;     ///< 4 bytes per pixel, in rows from top
+};
+
+/// Reads a binary PPM (P6) or PAM (P7) image with 8-bit channels
+static Image loadImage(const std::string & path)
+{
+    auto file = std::ifstream(path, std::ios::binary);
+    if (!file) { throw std::runtime_error("cannot open " + path); }
+
+    std::string magic;
+    unsigned width = 0, height = 0, depth = 3, maxval = 0;
+    file >>magic;
+    if (magic == "P6") {
+        // Header is 3 whitespace-separated numbers, possibly with comments
+        std::array<unsigned *, 3> values = {{ &width, &height, &maxval }};
+        for (auto * value : values) {
+            while ((file >>std::ws).peek() == '#') {
+                file.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+            }
+            file >>*value;
+        }
+        file.get();     // single whitespace before data
+    } else if (magic == "P7") {
+        // Header is a list of lines, finished by ENDHDR
+        std::string line;
+        while (std::getline(file, line) && line != "ENDHDR") {
+            auto stream = std::istringstream(line);
+            std::string key, value;
+            stream >>key >>value;
+            if (key == "WIDTH") { width = unsigned(std::stoul(value)); }
+            else if (key == "HEIGHT") { height = unsigned(std::stoul(value)); }
+            else if (key == "DEPTH") { depth = unsigned(std::stoul(value)); }
+            else if (key == "MAXVAL") { maxval = unsigned(std::stoul(value)); }
+        }
+    } else {
+        throw std::runtime_error(path + " is not a PPM or PAM image");
+    }
+    if (!file || width == 0 || height == 0 || maxval != 255 || (depth != 3 && depth != 4)) {
+        throw std::runtime_error(path + ": unsupported image, must be RGB or RGBA with 8-bit channels");
+    }
+
+    auto data = std::vector<uint8_t>(std::size_t(width) * height * depth);
+    if (!file.read(reinterpret_cast<char *>(data.data()), std::streamsize(data.size()))) {
+        throw std::runtime_error(path + ": truncated image");
+    }
+
+    auto image = Image{width, height, std::vector<uint8_t>(std::size_t(width) * height * 4)};
+    for (std::size_t idx = 0; idx < std::size_t(width) * height; ++idx) {
+        std::copy_n(&data[idx * depth], 3, &image.pixels[idx * 4]);
+        image.pixels[idx * 4 + 3] = depth == 4 ? data[idx * depth + 3] : 255;
+    }
+    return image;
+}
+
+/****************************************************************************/
+// Rasterizing
+
+/// A key, as it will be written to file
+struct Key final
+{
+    std::string             name;
+    LayoutDescription::Rect position;
+};
+
+/// Loads a layout from a path, or by name from keyledsd data directory
+static LayoutDescription loadLayout(const std::string & path)
+{
+    try {
+        if (auto file = std::ifstream(path, std::ios::binary); file) {
+            return LayoutDescription::parse(file);
+        }
+        return LayoutDescription::loadFile(path);
+    } catch (std::exception & error) {
+        throw std::runtime_error("cannot load layout " + path + ": " + error.what());
+    }
+}
+
+/// Lists layout keys that can be addressed by name, with the name keyledsd gives them
+static std::vector<Key> listKeys(const LayoutDescription & layout)
+{
+    std::vector<Key> keys;
+    for (const auto & key : layout.keys) {
+        if (std::find(layout.spurious.begin(), layout.spurious.end(),
+                      std::make_pair(key.block, key.code)) != layout.spurious.end()) { continue; }
+        if (key.position.x1 <= key.position.x0 || key.position.y1 <= key.position.y0) { continue; }
+
+        auto name = key.name;
+        if (name.empty()) {
+            auto keyCode = keyleds_translate_scancode(keyleds_block_id_t(key.block), uint8_t(key.code));
+            const char * keyName = keyleds_lookup_string(keyleds_keycode_names, keyCode);
+            if (keyName == nullptr) { continue; }
+            name = keyName;
+        }
+        if (std::any_of(keys.begin(), keys.end(), [&](const auto & k) { return k.name == name; })) {
+            continue;
+        }
+        keys.push_back(Key{std::move(name), key.position});
+    }
+    return keys;
+}
+
+/// Computes the color of each key, as the average of image pixels it covers
+static void rasterize(const Image & image, const std::vector<Key> & keys,
+                      const LayoutDescription::Rect & bounds, uint8_t * out)
+{
+    const auto boundsWidth = uint64_t(bounds.x1 - bounds.x0);
+    const auto boundsHeight = uint64_t(bounds.y1 - bounds.y0);
+
+    for (const auto & key : keys) {
+        // Pixel range covered by the key, at least one pixel
+        auto px0 = unsigned((key.position.x0 - bounds.x0) * image.width / boundsWidth);
+        auto py0 = unsigned((key.position.y0 - bounds.y0) * image.height / boundsHeight);
+        auto px1 = unsigned(((key.position.x1 - bounds.x0) * image.width + boundsWidth - 1) / boundsWidth);
+        auto py1 = unsigned(((key.position.y1 - bounds.y0) * image.height + boundsHeight - 1) / boundsHeight);
+        px0 = std::min(px0, image.width - 1);
+        py0 = std::min(py0, image.height - 1);
+        px1 = std::clamp(px1, px0 + 1, image.width);
+        py1 = std::clamp(py1, py0 + 1, image.height);
+
+        // Colors are weighted by alpha, so transparent pixels do not darken keys
+        uint64_t red = 0, green = 0, blue = 0, alpha = 0;
+        for (unsigned y = py0; y < py1; ++y) {
+            const uint8_t * pixel = &image.pixels[(std::size_t(y) * image.width + px0) * 4];
+            for (unsigned x = px0; x < px1; ++x, pixel += 4) {
+                red += uint64_t(pixel[0]) * pixel[3];
+                green += uint64_t(pixel[1]) * pixel[3];
+                blue += uint64_t(pixel[2]) * pixel[3];
+                alpha += pixel[3];
+            }
+        }
+        const auto count = uint64_t(px1 - px0) * (py1 - py0);
+        out[0] = alpha > 0 ? uint8_t(red / alpha) : 0;
+        out[1] = alpha > 0 ? uint8_t(green / alpha) : 0;
+        out[2] = alpha > 0 ? uint8_t(blue / alpha) : 0;
+        out[3] = uint8_t(alpha / count);
+        out += 4;
+    }
+}
+
+/****************************************************************************/
+
+int main(int argc, char * argv[])
+{
+    ::setlocale(LC_NUMERIC, "C");
+
+    const auto options = Options::parse(argc, argv);
+    if (!options) { return 1; }
+
+    auto logPolicy = new keyleds::logging::FilePolicy(STDERR_FILENO, keyleds::logging::warning::value);
+    keyleds::logging::Configuration::instance().setPolicy(logPolicy);
+
+    try {
+        const auto keys = listKeys(loadLayout(options->layoutPath));
+        if (keys.empty()) { throw std::runtime_error("layout has no usable key"); }
+        auto bounds = keys.front().position;
+        for (const auto & key : keys) {
+            bounds.x0 = std::min(bounds.x0, key.position.x0);
+            bounds.y0 = std::min(bounds.y0, key.position.y0);
+            bounds.x1 = std::max(bounds.x1, key.position.x1);
+            bounds.y1 = std::max(bounds.y1, key.position.y1);
+        }
+
+        // Build header and name section
+        std::string names;
+        for (const auto & key : keys) { names.append(key.name).push_back('\0'); }
+        names.resize(frame_file::align(names.size()), '\0');
+
+        frame_file::Header header;
+        std::copy(std::begin(frame_file::magic), std::end(frame_file::magic), header.magic);
+        header.version = frame_file::version;
+        header.keyCount = uint32_t(keys.size());
+        header.frameCount = uint32_t(options->framePaths.size());
+        header.frameDuration = options->frameDuration;
+        header.stride = uint32_t(frame_file::align(keys.size(), 4));
+        header.namesSize = uint32_t(names.size());
+
+        // Write next to the target then move it over, as keyledsd may have the file mapped
+        // and rewriting it in place would pull pages from under the running effect.
+        const auto tempPath = options->outputPath + ".tmp";
+        auto output = std::ofstream(tempPath, std::ios::binary | std::ios::trunc);
+        if (!output) { throw std::runtime_error("cannot open " + tempPath); }
+        try {
+            output.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            output.write(names.data(), std::streamsize(names.size()));
+
+            // Frames
+            auto frame = std::vector<uint8_t>(std::size_t(header.stride) * 4, 0);
+            for (const auto & path : options->framePaths) {
+                rasterize(loadImage(path), keys, bounds, frame.data());
+                output.write(reinterpret_cast<const char *>(frame.data()), std::streamsize(frame.size()));
+            }
+            output.close();
+            if (!output) { throw std::runtime_error("cannot write " + tempPath); }
+            if (std::rename(tempPath.c_str(), options->outputPath.c_str()) != 0) {
+                throw std::runtime_error("cannot replace " + options->outputPath + ": "
+                                         + std::strerror(errno));
+            }
+        } catch (...) {
+            std::remove(tempPath.c_str());
+            throw;
+        }
+
+        std::cout <<options->outputPath <<": " <<header.frameCount <<" frames of "
+                  <<header.keyCount <<" keys\n";
+    } catch (std::exception & error) {
+        std::cerr <<argv[0] <<": " <<error.what() <<'\n';
+        return 1;
+    }
+    return 0;
+}
@@ -19,14 +19,15 @@
 #include "config.h"
 #include "keyleds.h"
 #include "keyledsd/logging.h"
-#include <algorithm>
 #include <cassert>
 #include <cerrno>
+#include <cstddef>
 #include <cstdlib>
 #include <iomanip>
 #include <memory>
 #include <sstream>
 #include <string>
+#include <type_traits>
 
 LOGGING("device");
 
@@ -52,6 +53,14 @@ template <typename T, typename deleter = keyleds_deleter<T>>
 using keyleds_ptr = std::unique_ptr<T, deleter>;
 
 
+// Directives are handed to libkeyleds as is
+static_assert(std::is_standard_layout_v<keyleds::device::Device::ColorDirective>);
+static_assert(sizeof(keyleds::device::Device::ColorDirective) == sizeof(struct keyleds_key_color));
+static_assert(offsetof(keyleds::device::Device::ColorDirective, id) == offsetof(keyleds_key_color, id));
+static_assert(offsetof(keyleds::device::Device::ColorDirective, red) == offsetof(keyleds_key_color, red));
+static_assert(offsetof(keyleds::device::Device::ColorDirective, green) == offsetof(keyleds_key_color, green));
+static_assert(offsetof(keyleds::device::Device::ColorDirective, blue) == offsetof(keyleds_key_color, blue));
+
 static constexpr char InterfaceProtocolAttr[] = "bInterfaceProtocol";
 static constexpr unsigned ApplicationInterfaceProtocol = 0;
 static constexpr char DeviceVendorAttr[] = "idVendor";
@@ -143,13 +152,8 @@ void Logitech::fillColor(const KeyBlock & block, const RGBColor color)
 void Logitech::setColors(const KeyBlock & block, const ColorDirective colors[], size_type size)
 {
     assert(size > 0);
-    struct keyleds_key_color buffer[size];
-    std::transform(colors, colors + size, buffer,
-                   [](const auto & color) -> struct keyleds_key_color
-                   { return { color.id, color.red, color.green, color.blue }; });
-
     if (!keyleds_set_leds(m_device.get(), KEYLEDS_TARGET_DEFAULT, keyleds_block_id_t(block.id()),
-                          buffer, size)) {
+                          reinterpret_cast<const struct keyleds_key_color *>(colors), size)) {
         throw error(keyleds_get_error_str(), keyleds_get_errno());
     }
 }
@@ -158,15 +162,11 @@ void Logitech::getColors(const KeyBlock & block, ColorDirective colors[])
 {
     if (block.keys().empty()) { return; }
 
-    struct keyleds_key_color buffer[block.keys().size()];
-
     if (!keyleds_get_leds(m_device.get(), KEYLEDS_TARGET_DEFAULT, keyleds_block_id_t(block.id()),
-                          buffer, 0, static_cast<unsigned>(block.keys().size()))) {
+                          reinterpret_cast<struct keyleds_key_color *>(colors),
+                          0, static_cast<unsigned>(block.keys().size()))) {
         throw error(keyleds_get_error_str(), keyleds_get_errno());
     }
-    std::transform(buffer, buffer + block.keys().size(), colors,
-                   [](const auto & color) -> ColorDirective
-                   { return { color.id, color.red, color.green, color.blue }; });
 }
 
 void Logitech::commitColors()
@@ -21,6 +21,7 @@
 #include <algorithm>
 #include <cassert>
 #include <cerrno>
+#include <cstdlib>
 #include <fstream>
 #include <istream>
 #include <system_error>
@@ -51,6 +52,8 @@ class ConfigurationParser final : public tools::StackYAMLParser
     class StringMappingBuildState;
     class KeyGroupListState;
     class ColorMappingBuildState;
+    class CorrectionState;
+    class CorrectionListState;
     class EffectState;
     class EffectListState;
     class EffectGroupState;
@@ -228,6 +231,88 @@ private:
 };
 
 
+/// Configuration builder state: within a device output correction
+class ConfigurationParser::CorrectionState final : public MappingState
+{
+public:
+    using value_type = Configuration::Correction;
+public:
+    explicit CorrectionState(std::string device) { m_value.device = std::move(device); }
+    void print(std::ostream & out) const override { out <<"correction(" <<m_value.device <<')'; }
+
+    void scalarEntry(StackYAMLParser & parser, std::string_view key,
+                     std::string_view value, std::string_view anchor) override
+    {
+        auto & builder = parser.as<ConfigurationParser>();
+        if (key == "gamma") {
+            m_value.gamma = parseNumber(builder, value);
+            if (m_value.gamma <= 0.0f) { throw builder.makeError("gamma must be positive"); }
+        } else if (key == "brightness") {
+            m_value.brightness = parseNumber(builder, value);
+            if (m_value.brightness < 0.0f || m_value.brightness > 1.0f) {
+                throw builder.makeError("brightness must be between 0 and 1");
+            }
+        } else if (key == "white-balance") {
+            auto color = RGBColor::parse(std::string(value));
+            if (!color) { throw builder.makeError("invalid color definition"); }
+            m_value.whiteBalance = *color;
+        } else if (key == "dithering") {
+            m_value.dithering = parseBoolean(builder, value);
+        } else {
+            MappingState::scalarEntry(parser, key, value, anchor);
+        }
+    }
+
+    value_type &&   result() { return std::move(m_value); }
+
+private:
+    static bool parseBoolean(ConfigurationParser & builder, std::string_view value)
+    {
+        if (value == "true" || value == "yes" || value == "on") { return true; }
+        if (value == "false" || value == "no" || value == "off") { return false; }
+        throw builder.makeError("invalid boolean");
+    }
+
+    static float parseNumber(ConfigurationParser & builder, std::string_view value)
+    {
+        auto str = std::string(value);
+        char * end;
+        auto result = std::strtof(str.c_str(), &end);
+        if (str.empty() || *end != '\0') { throw builder.makeError("invalid number"); }
+        return result;
+    }
+
+private:
+    value_type      m_value;
+};
+
+/// Configuration builder state: within the device correction map
+class ConfigurationParser::CorrectionListState final : public MappingState
+{
+public:
+    using value_type = Configuration::correction_list;
+public:
+    void print(std::ostream & out) const override { out <<"correction-map"; }
+
+    std::unique_ptr<State>
+    mappingEntry(StackYAMLParser &, std::string_view key, std::string_view) override
+    {
+        return std::make_unique<CorrectionState>(std::string(key));
+    }
+
+    void subStateEnd(StackYAMLParser & parser, State & state) override
+    {
+        m_value.emplace_back(state.as<CorrectionState>().result());
+        MappingState::subStateEnd(parser, state);
+    }
+
+    value_type &&   result() { return std::move(m_value); }
+
+private:
+    value_type      m_value;
+};
+
+
 /// Configuration builder state: within a plugin configuration
 class ConfigurationParser::EffectState final : public MappingState
 {
@@ -495,7 +580,8 @@ private:
 class ConfigurationParser::RootState final : public MappingState
 {
     enum class SubState {
-        None, Plugins, PluginPaths, CustomColors, Devices, KeyGroups, EffectGroups, Profiles
+        None, Plugins, PluginPaths, CustomColors, Devices, Corrections, KeyGroups,
+        EffectGroups, Profiles
     };
 public:
     using value_type = Configuration;
@@ -527,6 +613,10 @@ public:
             m_currentSubState = SubState::Devices;
             return std::make_unique<StringMappingBuildState>();
         }
+        if (key == "corrections") {
+            m_currentSubState = SubState::Corrections;
+            return std::make_unique<CorrectionListState>();
+        }
         if (key == "groups") {
             m_currentSubState = SubState::KeyGroups;
             return std::make_unique<KeyGroupListState>();
@@ -567,6 +657,9 @@ public:
         case SubState::Devices:
             m_value.devices = state.as<StringMappingBuildState>().result();
             break;
+        case SubState::Corrections:
+            m_value.corrections = state.as<CorrectionListState>().result();
+            break;
         case SubState::KeyGroups:
             m_value.keyGroups = state.as<KeyGroupListState>().result();
             break;
@@ -71,10 +71,20 @@ void DeviceManager::setConfiguration(const Configuration * conf)
 
     m_configuration = conf;
     m_name = getDeviceName(*conf, m_serial);
+
+    auto cit = std::find_if(conf->corrections.begin(), conf->corrections.end(),
+                            [this](const auto & item) { return item.device == m_name ||
+                                                               item.device == m_serial; });
+    if (cit != conf->corrections.end()) {
+        m_renderLoop.setCorrection(*cit);
+    } else {
+        m_renderLoop.setCorrection({});
+    }
 }
 
 void DeviceManager::setContext(const string_map & context)
 {
+    m_context = context;
     m_activeEffects = loadEffects(context);
     DEBUG("enabling ", m_activeEffects.size(), " effects for loop ", &m_renderLoop);
 
@@ -122,6 +132,71 @@ void DeviceManager::setPaused(bool val)
     m_renderLoop.setPaused(val);
 }
 
+DeviceManager::dev_list DeviceManager::effectFiles() const
+{
+    dev_list result;
+    for (const auto & group : m_effectGroups) {
+        for (const auto & loaded : group.effects) {
+            for (const auto & path : loaded.files) {
+                if (std::find(result.begin(), result.end(), path) == result.end()) {
+                    result.push_back(path);
+                }
+            }
+        }
+    }
+    return result;
+}
+
+std::vector<DeviceManager::EffectStatistics> DeviceManager::effectStatistics()
+{
+    std::vector<EffectStatistics> result;
+    auto lock = m_renderLoop.lock();
+    for (const auto & group : m_effectGroups) {
+        for (const auto & loaded : group.effects) {
+            result.push_back({group.name, loaded.configuration->name,
+                              loaded.effect->statistics()});
+        }
+    }
+    return result;
+}
+
+void DeviceManager::reloadEffects(const std::string & path)
+{
+    for (auto & group : m_effectGroups) {
+        for (auto & loaded : group.effects) {
+            if (std::find(loaded.files.begin(), loaded.files.end(), path) == loaded.files.end()) {
+                continue;
+            }
+            NOTICE("reloading effect ", loaded.configuration->name, " on device ", m_serial);
+
+            // Build the new instance while the old one keeps rendering
+            auto replacement = createEffect(*loaded.configuration, group.keyGroups);
+            if (!replacement.effect) {
+                ERROR("reloading effect ", loaded.configuration->name,
+                      " failed, keeping current instance");
+                continue;
+            }
+
+            auto * oldEffect = loaded.effect.get();
+            auto * newEffect = replacement.effect.get();
+            bool active = std::find(m_activeEffects.begin(), m_activeEffects.end(),
+                                    oldEffect) != m_activeEffects.end();
+
+            auto lock = m_renderLoop.lock();
+            if (active) {
+                newEffect->handleContextChange(m_context);
+                std::replace(m_activeEffects.begin(), m_activeEffects.end(), oldEffect, newEffect);
+                auto & renderers = m_renderLoop.renderers();
+                std::replace(renderers.begin(), renderers.end(),
+                             static_cast<Renderer *>(oldEffect), static_cast<Renderer *>(newEffect));
+            }
+            // Keep files from previous instance so a failed reload can be retried
+            if (replacement.files.empty()) { replacement.files = loaded.files; }
+            std::swap(loaded, replacement);
+        }   // replacement now holds the old instance, which gets destroyed here
+    }
+}
+
 /// Applies the configuration to a string_map, matching profiles and resolving
 /// effect names. Returns the list of Effect entries in the configuration that
 /// should be loaded for the context. Returned list references Configuration
@@ -188,7 +263,7 @@ std::vector<keyleds::plugin::Effect *> DeviceManager::loadEffects(const string_m
         const auto & loadedEffectGroup = getEffectGroup(*effectGroup);
         const auto & effects = loadedEffectGroup.effects;
         std::transform(effects.begin(), effects.end(), std::back_inserter(effectPtrs),
-                       [](const auto & ptr) { return ptr.get(); });
+                       [](const auto & loaded) { return loaded.effect.get(); });
     }
     return effectPtrs;
 }
@@ -211,23 +286,30 @@ const detail::EffectGroup & DeviceManager::getEffectGroup(const Configuration::E
                    std::back_inserter(keyGroups), group_from_conf);
 
     // Load effects
-    std::vector<EffectManager::effect_ptr> effects;
+    std::vector<detail::LoadedEffect> effects;
     for (const auto & effectConf : conf.effects) {
-        auto effect = m_effectManager.createEffect(
-            effectConf.name, std::make_unique<EffectService>(
-                *this, *m_configuration, effectConf, keyGroups
-            )
-        );
-        if (!effect) {
-            ERROR("plugin for effect ", effectConf.name, " not found");
-            continue;
-        }
-        INFO("loaded plugin effect ", effectConf.name);
-        effects.emplace_back(std::move(effect));
+        auto loaded = createEffect(effectConf, keyGroups);
+        if (!loaded.effect) { continue; }
+        effects.emplace_back(std::move(loaded));
     }
 
-    m_effectGroups.push_back({conf.name, std::move(effects)});
+    m_effectGroups.push_back({conf.name, std::move(keyGroups), std::move(effects)});
     return m_effectGroups.back();
 }
 
+detail::LoadedEffect DeviceManager::createEffect(const Configuration::Effect & conf,
+                                                 const std::vector<KeyDatabase::KeyGroup> & keyGroups)
+{
+    auto service = std::make_unique<EffectService>(*this, *m_configuration, conf, keyGroups);
+    const auto & serviceRef = *service;    // owned by the effect once created
+
+    auto effect = m_effectManager.createEffect(conf.name, std::move(service));
+    if (!effect) {
+        ERROR("plugin for effect ", conf.name, " not found");
+        return { &conf, {}, nullptr };
+    }
+    INFO("loaded plugin effect ", conf.name);
+    return { &conf, serviceRef.files(), std::move(effect) };
+}
+
 } // namespace keyleds::service
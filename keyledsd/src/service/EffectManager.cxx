@@ -90,6 +90,8 @@ EffectManager::effect_deleter::effect_deleter(EffectManager * manager, PluginTra
 {}
 
 EffectManager::effect_deleter::effect_deleter(effect_deleter &&) noexcept = default;
+EffectManager::effect_deleter &
+EffectManager::effect_deleter::operator=(effect_deleter &&) noexcept = default;
 
 EffectManager::effect_deleter::~effect_deleter() = default;
 
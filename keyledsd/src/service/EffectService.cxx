@@ -93,6 +93,9 @@ const std::string & EffectService::getFile(const std::string & name)
         if (file) {
             m_fileData.assign(std::istreambuf_iterator<char>(file->stream),
                               std::istreambuf_iterator<char>());
+            if (std::find(m_files.begin(), m_files.end(), file->path) == m_files.end()) {
+                m_files.push_back(std::move(file->path));
+            }
         }
     }
     return m_fileData;
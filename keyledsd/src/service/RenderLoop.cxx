@@ -22,6 +22,7 @@
 #include <cassert>
 #include <cerrno>
 #include <chrono>
+#include <cmath>
 #include <exception>
 #include <numeric>
 #include <thread>
@@ -38,23 +39,66 @@ struct commitDelay {    // Delay between sending color data and commit command.
     static constexpr std::chrono::microseconds max = 8ms;
 };
 
+// Temporal dithering: keys are dithered for that many frames after they last changed,
+// then settle on their rounded value so static keys do not need updates.
+static constexpr uint8_t ditherPeriod = 16;
+static constexpr std::array<uint8_t, 8> ditherPattern = {16, 144, 80, 208, 48, 176, 112, 240};
+static constexpr uint8_t roundingBias = 128;
+
+/// Fills a correction table for one channel
+/// @param table The table to fill. Maps rendered channel values to device channel
+///              values, in 8.8 fixed point. Last entry repeats the previous one
+///              so lookups can interpolate without bound checks.
+/// @param gamma Exponent applied to normalized intensities.
+/// @param max Device value that represents full intensity.
+static void buildOutputTable(std::array<uint16_t, 257> & table, float gamma, float max)
+{
+    for (std::size_t idx = 0; idx < 256; ++idx) {
+        auto value = 256.0f * max * std::pow(static_cast<float>(idx) / 255.0f, gamma);
+        table[idx] = static_cast<uint16_t>(std::clamp(std::lround(value), 0l, 255l * 256l));
+    }
+    table[256] = table[255];
+}
+
+/// Looks up a wide channel value in a correction table, interpolating between entries
+static inline uint16_t lookup(const std::array<uint16_t, 257> & table, uint16_t value)
+{
+    const unsigned pos = (value * 256u + 128u) / 257u;  // rescale to 8.8 table index
+    const unsigned idx = pos >> 8, frac = pos & 0xff;
+    const int delta = table[idx + 1] - table[idx];
+    return static_cast<uint16_t>(table[idx] + ((delta * static_cast<int>(frac)) >> 8));
+}
+
+/// Converts a fixed-point output value into a device value
+static inline uint8_t quantize(uint16_t value, uint8_t bias)
+{
+    return static_cast<uint8_t>((value + bias) >> 8);
+}
+
 /****************************************************************************/
 
 RenderLoop::RenderLoop(device::Device & device, unsigned fps)
     : AnimationLoop(fps),
       m_device(device),
       m_commitDelay(commitDelay::initial),
-      m_forceRefresh(false)
+      m_forceRefresh(false),
+      m_correctionChanged(true),
+      m_dithering(false),
+      m_frame(0)
 {
     auto nb = std::accumulate(m_device.blocks().begin(), m_device.blocks().end(), std::size_t{0},
                               [](auto val, auto & block) { return val + block.keys().size(); });
-    m_state = RenderTarget(nb);
-    m_buffer = RenderTarget(nb);
+    m_state = RenderTarget(nb, RenderTarget::Precision::High);
+    m_buffer = RenderTarget(nb, RenderTarget::Precision::High);
 
     // Ensure no allocation happens in render()
     auto max = std::accumulate(m_device.blocks().begin(), m_device.blocks().end(), std::size_t{0},
                                [](auto val, auto & block) { return std::max(val, block.keys().size()); });
     m_directives.reserve(max);
+
+    m_outputTables.resize(m_device.blocks().size());
+    m_output.resize(nb);
+    m_ditherFrames.resize(nb);
 }
 
 RenderLoop::~RenderLoop() = default;
@@ -67,6 +111,43 @@ std::unique_lock<std::mutex> RenderLoop::lock()
     return std::unique_lock<std::mutex>(m_mRenderers);
 }
 
+/** Set output correction.
+ * Settings are applied at next render, and force a full refresh so
+ * changes are visible even on keys that do not change.
+ * @param correction New settings.
+ */
+void RenderLoop::setCorrection(const Configuration::Correction & correction)
+{
+    m_correction = correction;
+    m_correctionChanged = true;
+}
+
+/** Rebuild output tables.
+ * Combines current correction settings with the maximum values each block
+ * declares.
+ */
+void RenderLoop::applyCorrection()
+{
+    assert(m_outputTables.size() == m_device.blocks().size());
+    const auto & blocks = m_device.blocks();
+    const auto factor = m_correction.brightness / 255.0f;
+
+    for (std::size_t idx = 0; idx < blocks.size(); ++idx) {
+        const auto & max = blocks[idx].maxValues();
+        const auto & white = m_correction.whiteBalance;
+        auto & table = m_outputTables[idx];
+        buildOutputTable(table.red, m_correction.gamma,
+                         factor * static_cast<float>(max.red * white.red) / 255.0f);
+        buildOutputTable(table.green, m_correction.gamma,
+                         factor * static_cast<float>(max.green * white.green) / 255.0f);
+        buildOutputTable(table.blue, m_correction.gamma,
+                         factor * static_cast<float>(max.blue * white.blue) / 255.0f);
+    }
+    m_dithering = m_correction.dithering;
+    m_correctionChanged = false;
+    forceRefresh();
+}
+
 /** Rendering method
  * Invoked on a regular basis as long as the animation is not paused.
  * @param elapsed Time since last invocation.
@@ -78,11 +159,13 @@ bool RenderLoop::render(milliseconds elapsed)
     bool hasRenderers;
     {
         std::lock_guard<std::mutex> lock(m_mRenderers);
+        if (m_correctionChanged) { applyCorrection(); }
         hasRenderers = !m_renderers.empty();
         for (const auto & effect : m_renderers) {
             effect->render(elapsed, m_buffer);
         }
     }
+    m_buffer.syncWide();    // pick up colors renderers wrote directly
 
     if (hasRenderers) {
         m_device.flush();   // Ensure another program using the device did not fill
@@ -91,22 +174,40 @@ bool RenderLoop::render(milliseconds elapsed)
         // Compute diff between old LED state and new LED state
         bool forceRefresh = m_forceRefresh.exchange(false, std::memory_order_relaxed);
         bool hasChanges = false;
-        auto oldKeyIt = m_state.cbegin();
-        auto newKeyIt = m_buffer.cbegin();
+        const auto * oldKeyIt = m_state.wideData();
+        const auto * newKeyIt = m_buffer.wideData();
+        auto tableIt = m_outputTables.cbegin();
+        std::size_t keyIdx = 0;
+        const auto frame = m_frame++;
 
         for (const auto & block : m_device.blocks()) {
+            const auto & table = *tableIt++;
 
-            // Look for changed lights within current block
+            // Look for changed lights within current block, correcting them on the fly
             const size_t numBlockKeys = block.keys().size();
             m_directives.clear();
-            for (size_t kIdx = 0; kIdx < numBlockKeys; ++kIdx) {
+            for (size_t kIdx = 0; kIdx < numBlockKeys; ++kIdx, ++keyIdx, ++oldKeyIt, ++newKeyIt) {
+                auto & ditherFrames = m_ditherFrames[keyIdx];
                 if (forceRefresh || *oldKeyIt != *newKeyIt) {
-                    m_directives.push_back({
-                        block.keys()[kIdx], newKeyIt->red, newKeyIt->green, newKeyIt->blue
-                    });
+                    ditherFrames = m_dithering ? ditherPeriod : 0;
+                } else if (ditherFrames > 0) {
+                    --ditherFrames;     // still settling, fall through to update it
+                } else {
+                    continue;
+                }
+
+                const auto bias = ditherFrames > 0
+                                ? ditherPattern[(frame + 5 * keyIdx) % ditherPattern.size()]
+                                : roundingBias;
+                const auto color = RGBColor{
+                    quantize(lookup(table.red, newKeyIt->red), bias),
+                    quantize(lookup(table.green, newKeyIt->green), bias),
+                    quantize(lookup(table.blue, newKeyIt->blue), bias)
+                };
+                if (forceRefresh || color != m_output[keyIdx]) {
+                    m_directives.push_back({block.keys()[kIdx], color.red, color.green, color.blue});
+                    m_output[keyIdx] = color;
                 }
-                ++oldKeyIt;
-                ++newKeyIt;
             }
 
             // If some lights have changed within current block, send directives to device
@@ -130,6 +231,19 @@ bool RenderLoop::render(milliseconds elapsed)
     return true;
 }
 
+/** Idle method
+ * Invoked once a frame was sent to the device, lets renderers use the time
+ * left until next frame.
+ * @param deadline When next frame is due.
+ */
+void RenderLoop::idle(clock::time_point deadline)
+{
+    std::lock_guard<std::mutex> lock(m_mRenderers);
+    for (const auto & effect : m_renderers) {
+        effect->idle(deadline);
+    }
+}
+
 /** Main render loop loop.
  * Handle error recovery around AnimationLoop::run().
  */
@@ -141,7 +255,9 @@ void RenderLoop::run()
         ERROR("device error: ", error.what());
         return;
     }
+    m_state.syncWide();
     std::copy(m_state.cbegin(), m_state.cend(), m_buffer.begin());
+    m_buffer.syncWide();
 
     try {
         for (;;) {
@@ -171,6 +287,7 @@ void RenderLoop::run()
                 }
 
                 if (!success) { throw; }
+                forceRefresh();     // device state is unknown after an error
             }
         }
     } catch (device::Device::error & error) {
@@ -181,6 +298,8 @@ void RenderLoop::run()
 }
 
 /** Read current state of all device lights
+ * Values are read as the device reports them, output correction is not
+ * reverted. Setting the correction forces a full refresh anyway.
  * @param [out] state Buffer into which color values will be written.
  */
 void RenderLoop::getDeviceState(RenderTarget & state)
@@ -188,11 +307,10 @@ void RenderLoop::getDeviceState(RenderTarget & state)
     auto kit = state.begin();
 
     for (const auto & block : m_device.blocks()) {
-        std::vector<device::Device::ColorDirective> colors(block.keys().size());
-        m_device.getColors(block, colors.data());
+        m_directives.resize(block.keys().size());   // within reserved capacity
+        m_device.getColors(block, m_directives.data());
 
-        assert(block.keys().size() == colors.size());
-        for (const auto & color : colors) {
+        for (const auto & color : m_directives) {
             kit->red = color.red;
             kit->green = color.green;
             kit->blue = color.blue;
@@ -23,16 +23,26 @@
 #include "keyledsd/service/DeviceManager.h"
 #include "keyledsd/service/DisplayManager.h"
 #include "keyledsd/tools/XWindow.h"
+#include <algorithm>
 #include <cassert>
 #include <functional>
 #include <optional>
 #include <sstream>
+#include <system_error>
 #include <uv.h>
 
 LOGGING("service");
 
 using keyleds::service::Service;
 
+// Editors saving by renaming trigger the self events, the watch then follows the old file
+static constexpr auto effectFileEvents = keyleds::tools::FileWatcher::Event(
+    keyleds::tools::FileWatcher::Event::CloseWrite | keyleds::tools::FileWatcher::Event::MoveSelf
+    | keyleds::tools::FileWatcher::Event::DeleteSelf
+);
+// Time given to editors for putting the new file in place, in milliseconds
+static constexpr uint64_t renewDelay = 100;
+
 /****************************************************************************/
 
 static void merge(std::vector<std::pair<std::string, std::string>> & lhs,
@@ -82,7 +92,8 @@ Service::Service(EffectManager & effectManager, tools::FileWatcher & fileWatcher
       m_fileWatcher(fileWatcher),
       m_configuration(std::move(configuration)),
       m_loop(loop),
-      m_deviceWatcher(loop)
+      m_deviceWatcher(loop),
+      m_renewTimer(std::make_unique<uv_timer_t>())
 {
     using namespace std::placeholders;
     connect(m_deviceWatcher.deviceAdded, this, std::bind(&Service::onDeviceAdded, this, _1));
@@ -91,10 +102,18 @@ Service::Service(EffectManager & effectManager, tools::FileWatcher & fileWatcher
         m_configuration.path, FileWatcher::Event::CloseWrite,
         std::bind(&Service::onConfigurationFileChanged, this, _1)
     );
+    uv_timer_init(&m_loop, m_renewTimer.get());
+    m_renewTimer->data = this;
     DEBUG("created");
 }
 
-Service::~Service() = default;
+Service::~Service()
+{
+    // The actual closing is aysnchronous, so we defer deletion in a callback
+    uv_close(reinterpret_cast<uv_handle_t *>(m_renewTimer.release()), [](uv_handle_t * ptr) {
+        delete reinterpret_cast<uv_timer_t *>(ptr);
+    });
+}
 
 /****************************************************************************/
 
@@ -145,6 +164,7 @@ void Service::setContext(const string_map & context)
     merge(m_context, context);
     INFO("setContext ", ::to_string(m_context));
     for (auto & device : m_devices) { device->setContext(m_context); }
+    updateEffectFileWatches();  // context changes can load new effects
 }
 
 void Service::handleGenericEvent(const string_map & context)
@@ -195,6 +215,26 @@ void Service::onConfigurationFileChanged(FileWatcher::Event event)
     }
 }
 
+void Service::onEffectFileChanged(const std::string & path, FileWatcher::Event event)
+{
+    if ((event & (FileWatcher::Event::MoveSelf | FileWatcher::Event::DeleteSelf
+                  | FileWatcher::Event::Ignored)) != 0) {
+        // Editors swapping in the file leave the watch on the old one. We are running
+        // from that watch's callback, which must not be destroyed, so renew it later.
+        if (std::find(m_replacedEffectFiles.begin(), m_replacedEffectFiles.end(), path)
+            == m_replacedEffectFiles.end()) {
+            m_replacedEffectFiles.push_back(path);
+        }
+        uv_timer_start(m_renewTimer.get(), [](uv_timer_t * handle) {
+            static_cast<Service *>(handle->data)->renewEffectFileWatches();
+        }, renewDelay, 0);
+        return;
+    }
+
+    NOTICE("reloading effects using ", path);
+    for (auto & device : m_devices) { device->reloadEffects(path); }
+}
+
 void Service::onDeviceAdded(const tools::device::Description & description)
 {
     INFO("device added: ", description.devNode());
@@ -216,6 +256,7 @@ void Service::onDeviceAdded(const tools::device::Description & description)
 
         manager->setPaused(false);
         m_devices.emplace_back(std::move(manager));
+        updateEffectFileWatches();
 
     } catch (device::Device::error & error) {
         if (error.expected()) {
@@ -240,9 +281,78 @@ void Service::onDeviceRemoved(const tools::device::Description & description)
         NOTICE("removing device ", manager->serial());
 
         deviceManagerRemoved.emit(*manager);
+        manager.reset();
+        updateEffectFileWatches();
 
         if (m_devices.empty() && m_autoQuit) {
             uv_stop(&m_loop);
         }
     }
 }
+
+void Service::updateEffectFileWatches()
+{
+    std::vector<std::string> paths;
+    for (const auto & device : m_devices) {
+        for (auto & path : device->effectFiles()) {
+            if (std::find(paths.begin(), paths.end(), path) == paths.end()) {
+                paths.push_back(std::move(path));
+            }
+        }
+    }
+
+    // Drop watches no longer needed. Watches still needed are kept as is, as
+    // inotify hands out the same watch for the same file: re-subscribing then
+    // destroying the old subscription would remove it.
+    m_effectFileSubs.erase(
+        std::remove_if(m_effectFileSubs.begin(), m_effectFileSubs.end(),
+                       [&paths](const auto & item) {
+                           return std::find(paths.begin(), paths.end(), item.first) == paths.end();
+                       }),
+        m_effectFileSubs.end()
+    );
+
+    for (auto & path : paths) {
+        auto it = std::find_if(m_effectFileSubs.begin(), m_effectFileSubs.end(),
+                               [&path](const auto & item) { return item.first == path; });
+        if (it != m_effectFileSubs.end()) { continue; }
+        try {
+            auto sub = m_fileWatcher.subscribe(
+                path, effectFileEvents,
+                std::bind(&Service::onEffectFileChanged, this, path, std::placeholders::_1)
+            );
+            DEBUG("watching effect file ", path);
+            m_effectFileSubs.emplace_back(std::move(path), std::move(sub));
+        } catch (std::system_error & error) {
+            ERROR("cannot watch ", path, ": ", error.what());
+        }
+    }
+}
+
+void Service::renewEffectFileWatches()
+{
+    const auto paths = std::move(m_replacedEffectFiles);
+    m_replacedEffectFiles.clear();
+
+    for (const auto & path : paths) {
+        auto it = std::find_if(m_effectFileSubs.begin(), m_effectFileSubs.end(),
+                               [&path](const auto & item) { return item.first == path; });
+        if (it == m_effectFileSubs.end()) { continue; }    // no longer needed
+
+        // Drop old watch first, as inotify hands out the same one if file was not replaced
+        it->second = FileWatcher::subscription();
+        try {
+            it->second = m_fileWatcher.subscribe(
+                path, effectFileEvents,
+                std::bind(&Service::onEffectFileChanged, this, path, std::placeholders::_1)
+            );
+        } catch (std::system_error & error) {
+            ERROR("cannot watch ", path, ": ", error.what());
+            m_effectFileSubs.erase(it);
+            continue;
+        }
+
+        NOTICE("reloading effects using ", path);
+        for (auto & device : m_devices) { device->reloadEffects(path); }
+    }
+}
@@ -125,6 +125,33 @@ static int setPaused(sd_bus *, const char *, const char *, const char *,
     return 0;
 }
 
+static int getEffects(sd_bus *, const char *, const char *, const char *,
+                      sd_bus_message * reply, void * userdata, sd_bus_error *)
+{
+    int ret;
+    auto adapter = static_cast<DeviceManagerAdapter *>(userdata);
+
+    ret = sd_bus_message_open_container(reply, SD_BUS_TYPE_ARRAY, "(ssa{ss})");
+    if (ret < 0) { return ret; }
+    for (const auto & stats : adapter->device().effectStatistics()) {
+        ret = sd_bus_message_open_container(reply, SD_BUS_TYPE_STRUCT, "ssa{ss}");
+        if (ret < 0) { return ret; }
+        ret = sd_bus_message_append(reply, "ss", stats.group.c_str(), stats.effect.c_str());
+        if (ret < 0) { return ret; }
+        ret = sd_bus_message_open_container(reply, SD_BUS_TYPE_ARRAY, "{ss}");
+        if (ret < 0) { return ret; }
+        for (const auto & value : stats.values) {
+            ret = sd_bus_message_append(reply, "{ss}", value.first.c_str(), value.second.c_str());
+            if (ret < 0) { return ret; }
+        }
+        ret = sd_bus_message_close_container(reply);
+        if (ret < 0) { return ret; }
+        ret = sd_bus_message_close_container(reply);
+        if (ret < 0) { return ret; }
+    }
+    return sd_bus_message_close_container(reply);
+}
+
 static constexpr sd_bus_vtable interfaceVtable[] = {
     SD_BUS_VTABLE_START(0),
     SD_BUS_PROPERTY("sysPath", "s", getSysPath, 0, 0),
@@ -136,6 +163,8 @@ static constexpr sd_bus_vtable interfaceVtable[] = {
     SD_BUS_PROPERTY("firmware", "s", getFirmware, 0, 0),
     SD_BUS_PROPERTY("keys", "a(qs(qqqq))", getKeys, 0, 0),
     SD_BUS_WRITABLE_PROPERTY("paused", "b", getPaused, setPaused, 0, 0),
+    SD_BUS_PROPERTY("effects", "a(ssa{ss})", getEffects, 0,
+                    SD_BUS_VTABLE_PROPERTY_EMITS_NO_SIGNAL),
     SD_BUS_VTABLE_END
 };
 
@@ -85,3 +85,272 @@ KEYLEDSD_EXPORT void multiply(uint8_t * restrict dst, const uint8_t * restrict s
 KEYLEDSD_EXPORT void multiply(uint8_t * restrict dst, const uint8_t * restrict src, size_t length)
     { multiply_plain(dst, src, length); }
 #endif
+
+/****************************************************************************/
+/* blend_wide */
+
+#ifdef HAVE_BUILTIN_CPU_SUPPORTS
+static USED void (*resolve_blend_wide(void))(uint16_t * restrict wide, uint8_t * restrict dst,
+                                             const uint8_t * restrict src, size_t length)
+{
+#  if defined __GNUC__ && !defined __clang__
+    __builtin_cpu_init();
+#  endif
+#  ifdef KEYLEDSD_USE_AVX2
+    if (__builtin_cpu_supports("avx2")) { return blend_wide_avx2; }
+#  endif
+#  ifdef KEYLEDSD_USE_SSE2
+    if (__builtin_cpu_supports("sse2")) { return blend_wide_sse2; }
+#  endif
+    return blend_wide_plain;
+}
+
+#  ifdef HAVE_IFUNC_ATTRIBUTE
+KEYLEDSD_EXPORT void blend_wide(uint16_t * restrict wide, uint8_t * restrict dst,
+                                const uint8_t * restrict src, size_t length)
+    __attribute__((ifunc("resolve_blend_wide")));
+#  else
+static void (*resolved_blend_wide)(uint16_t * restrict wide, uint8_t * restrict dst,
+                                   const uint8_t * restrict src, size_t length);
+KEYLEDSD_EXPORT void blend_wide(uint16_t * restrict wide, uint8_t * restrict dst,
+                                const uint8_t * restrict src, size_t length)
+{
+    if (resolved_blend_wide == 0) { resolved_blend_wide = resolve_blend_wide(); }
+    (*resolved_blend_wide)(wide, dst, src, length);
+}
+#  endif
+#else
+KEYLEDSD_EXPORT void blend_wide(uint16_t * restrict wide, uint8_t * restrict dst,
+                                const uint8_t * restrict src, size_t length)
+    { blend_wide_plain(wide, dst, src, length); }
+#endif
+
+/****************************************************************************/
+/* multiply_wide */
+
+#ifdef HAVE_BUILTIN_CPU_SUPPORTS
+static USED void (*resolve_multiply_wide(void))(uint16_t * restrict wide, uint8_t * restrict dst,
+                                                const uint8_t * restrict src, size_t length)
+{
+#  if defined __GNUC__ && !defined __clang__
+    __builtin_cpu_init();
+#  endif
+#  ifdef KEYLEDSD_USE_AVX2
+    if (__builtin_cpu_supports("avx2")) { return multiply_wide_avx2; }
+#  endif
+#  ifdef KEYLEDSD_USE_SSE2
+    if (__builtin_cpu_supports("sse2")) { return multiply_wide_sse2; }
+#  endif
+    return multiply_wide_plain;
+}
+
+#  ifdef HAVE_IFUNC_ATTRIBUTE
+KEYLEDSD_EXPORT void multiply_wide(uint16_t * restrict wide, uint8_t * restrict dst,
+                                   const uint8_t * restrict src, size_t length)
+    __attribute__((ifunc("resolve_multiply_wide")));
+#  else
+static void (*resolved_multiply_wide)(uint16_t * restrict wide, uint8_t * restrict dst,
+                                      const uint8_t * restrict src, size_t length);
+KEYLEDSD_EXPORT void multiply_wide(uint16_t * restrict wide, uint8_t * restrict dst,
+                                   const uint8_t * restrict src, size_t length)
+{
+    if (resolved_multiply_wide == 0) { resolved_multiply_wide = resolve_multiply_wide(); }
+    (*resolved_multiply_wide)(wide, dst, src, length);
+}
+#  endif
+#else
+KEYLEDSD_EXPORT void multiply_wide(uint16_t * restrict wide, uint8_t * restrict dst,
+                                   const uint8_t * restrict src, size_t length)
+    { multiply_wide_plain(wide, dst, src, length); }
+#endif
+
+/****************************************************************************/
+/* blend_color */
+
+#ifdef HAVE_BUILTIN_CPU_SUPPORTS
+static USED void (*resolve_blend_color(void))(uint8_t * restrict dst, const uint8_t * restrict color,
+                                              size_t length)
+{
+#  if defined __GNUC__ && !defined __clang__
+    __builtin_cpu_init();
+#  endif
+#  ifdef KEYLEDSD_USE_AVX2
+    if (__builtin_cpu_supports("avx2")) { return blend_color_avx2; }
+#  endif
+#  ifdef KEYLEDSD_USE_SSE2
+    if (__builtin_cpu_supports("sse2")) { return blend_color_sse2; }
+#  endif
+    return blend_color_plain;
+}
+
+#  ifdef HAVE_IFUNC_ATTRIBUTE
+KEYLEDSD_EXPORT void blend_color(uint8_t * restrict dst, const uint8_t * restrict color, size_t length)
+    __attribute__((ifunc("resolve_blend_color")));
+#  else
+static void (*resolved_blend_color)(uint8_t * restrict dst, const uint8_t * restrict color,
+                                    size_t length);
+KEYLEDSD_EXPORT void blend_color(uint8_t * restrict dst, const uint8_t * restrict color, size_t length)
+{
+    if (resolved_blend_color == 0) { resolved_blend_color = resolve_blend_color(); }
+    (*resolved_blend_color)(dst, color, length);
+}
+#  endif
+#else
+KEYLEDSD_EXPORT void blend_color(uint8_t * restrict dst, const uint8_t * restrict color, size_t length)
+    { blend_color_plain(dst, color, length); }
+#endif
+
+/****************************************************************************/
+/* blend_color_wide */
+
+#ifdef HAVE_BUILTIN_CPU_SUPPORTS
+static USED void (*resolve_blend_color_wide(void))(uint16_t * restrict wide, uint8_t * restrict dst,
+                                                   const uint8_t * restrict color, size_t length)
+{
+#  if defined __GNUC__ && !defined __clang__
+    __builtin_cpu_init();
+#  endif
+#  ifdef KEYLEDSD_USE_AVX2
+    if (__builtin_cpu_supports("avx2")) { return blend_color_wide_avx2; }
+#  endif
+#  ifdef KEYLEDSD_USE_SSE2
+    if (__builtin_cpu_supports("sse2")) { return blend_color_wide_sse2; }
+#  endif
+    return blend_color_wide_plain;
+}
+
+#  ifdef HAVE_IFUNC_ATTRIBUTE
+KEYLEDSD_EXPORT void blend_color_wide(uint16_t * restrict wide, uint8_t * restrict dst,
+                                      const uint8_t * restrict color, size_t length)
+    __attribute__((ifunc("resolve_blend_color_wide")));
+#  else
+static void (*resolved_blend_color_wide)(uint16_t * restrict wide, uint8_t * restrict dst,
+                                         const uint8_t * restrict color, size_t length);
+KEYLEDSD_EXPORT void blend_color_wide(uint16_t * restrict wide, uint8_t * restrict dst,
+                                      const uint8_t * restrict color, size_t length)
+{
+    if (resolved_blend_color_wide == 0) { resolved_blend_color_wide = resolve_blend_color_wide(); }
+    (*resolved_blend_color_wide)(wide, dst, color, length);
+}
+#  endif
+#else
+KEYLEDSD_EXPORT void blend_color_wide(uint16_t * restrict wide, uint8_t * restrict dst,
+                                      const uint8_t * restrict color, size_t length)
+    { blend_color_wide_plain(wide, dst, color, length); }
+#endif
+
+/****************************************************************************/
+/* sample_table */
+
+#ifdef HAVE_BUILTIN_CPU_SUPPORTS
+static USED void (*resolve_sample_table(void))(uint8_t * restrict dst, const uint8_t * restrict table,
+                                               const uint32_t * restrict phases,
+                                               uint32_t offset, uint32_t mask, size_t length)
+{
+#  if defined __GNUC__ && !defined __clang__
+    __builtin_cpu_init();
+#  endif
+#  ifdef KEYLEDSD_USE_AVX2
+    if (__builtin_cpu_supports("avx2")) { return sample_table_avx2; }
+#  endif
+    return sample_table_plain;  /* SSE2 has no gather instruction */
+}
+
+#  ifdef HAVE_IFUNC_ATTRIBUTE
+KEYLEDSD_EXPORT void sample_table(uint8_t * restrict dst, const uint8_t * restrict table,
+                                  const uint32_t * restrict phases,
+                                  uint32_t offset, uint32_t mask, size_t length)
+    __attribute__((ifunc("resolve_sample_table")));
+#  else
+static void (*resolved_sample_table)(uint8_t * restrict dst, const uint8_t * restrict table,
+                                     const uint32_t * restrict phases,
+                                     uint32_t offset, uint32_t mask, size_t length);
+KEYLEDSD_EXPORT void sample_table(uint8_t * restrict dst, const uint8_t * restrict table,
+                                  const uint32_t * restrict phases,
+                                  uint32_t offset, uint32_t mask, size_t length)
+{
+    if (resolved_sample_table == 0) { resolved_sample_table = resolve_sample_table(); }
+    (*resolved_sample_table)(dst, table, phases, offset, mask, length);
+}
+#  endif
+#else
+KEYLEDSD_EXPORT void sample_table(uint8_t * restrict dst, const uint8_t * restrict table,
+                                  const uint32_t * restrict phases,
+                                  uint32_t offset, uint32_t mask, size_t length)
+    { sample_table_plain(dst, table, phases, offset, mask, length); }
+#endif
+
+/****************************************************************************/
+/* accumulate */
+
+#ifdef HAVE_BUILTIN_CPU_SUPPORTS
+static USED void (*resolve_accumulate(void))(uint16_t * restrict sums, const uint8_t * restrict src,
+                                             size_t length)
+{
+#  if defined __GNUC__ && !defined __clang__
+    __builtin_cpu_init();
+#  endif
+#  ifdef KEYLEDSD_USE_AVX2
+    if (__builtin_cpu_supports("avx2")) { return accumulate_avx2; }
+#  endif
+#  ifdef KEYLEDSD_USE_SSE2
+    if (__builtin_cpu_supports("sse2")) { return accumulate_sse2; }
+#  endif
+    return accumulate_plain;
+}
+
+#  ifdef HAVE_IFUNC_ATTRIBUTE
+KEYLEDSD_EXPORT void accumulate(uint16_t * restrict sums, const uint8_t * restrict src, size_t length)
+    __attribute__((ifunc("resolve_accumulate")));
+#  else
+static void (*resolved_accumulate)(uint16_t * restrict sums, const uint8_t * restrict src,
+                                   size_t length);
+KEYLEDSD_EXPORT void accumulate(uint16_t * restrict sums, const uint8_t * restrict src, size_t length)
+{
+    if (resolved_accumulate == 0) { resolved_accumulate = resolve_accumulate(); }
+    (*resolved_accumulate)(sums, src, length);
+}
+#  endif
+#else
+KEYLEDSD_EXPORT void accumulate(uint16_t * restrict sums, const uint8_t * restrict src, size_t length)
+    { accumulate_plain(sums, src, length); }
+#endif
+
+/****************************************************************************/
+/* integrate */
+
+#ifdef HAVE_BUILTIN_CPU_SUPPORTS
+static USED void (*resolve_integrate(void))(float * restrict position, float * restrict velocity,
+                                            float acceleration, float dt, size_t length)
+{
+#  if defined __GNUC__ && !defined __clang__
+    __builtin_cpu_init();
+#  endif
+#  ifdef KEYLEDSD_USE_AVX2
+    if (__builtin_cpu_supports("avx2")) { return integrate_avx2; }
+#  endif
+#  ifdef KEYLEDSD_USE_SSE2
+    if (__builtin_cpu_supports("sse2")) { return integrate_sse2; }
+#  endif
+    return integrate_plain;
+}
+
+#  ifdef HAVE_IFUNC_ATTRIBUTE
+KEYLEDSD_EXPORT void integrate(float * restrict position, float * restrict velocity,
+                               float acceleration, float dt, size_t length)
+    __attribute__((ifunc("resolve_integrate")));
+#  else
+static void (*resolved_integrate)(float * restrict position, float * restrict velocity,
+                                  float acceleration, float dt, size_t length);
+KEYLEDSD_EXPORT void integrate(float * restrict position, float * restrict velocity,
+                               float acceleration, float dt, size_t length)
+{
+    if (resolved_integrate == 0) { resolved_integrate = resolve_integrate(); }
+    (*resolved_integrate)(position, velocity, acceleration, dt, length);
+}
+#  endif
+#else
+KEYLEDSD_EXPORT void integrate(float * restrict position, float * restrict velocity,
+                               float acceleration, float dt, size_t length)
+    { integrate_plain(position, velocity, acceleration, dt, length); }
+#endif
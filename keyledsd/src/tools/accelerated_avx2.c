@@ -16,6 +16,7 @@
  */
 #include <assert.h>
 #include <stdint.h>
+#include <string.h>
 #include <immintrin.h>
 #include "keyledsd/tools/accelerated.h"
 #include "config.h"
@@ -105,3 +106,305 @@ KEYLEDSD_EXPORT void multiply_avx2(uint8_t * restrict dst, const uint8_t * restr
         dstv += 1;
     } while (--length > 0);
 }
+
+/****************************************************************************/
+/* Wide variants: accumulate into 16-bit channels, narrow copy kept updated */
+
+/** Reset wide channels whose narrow value was written directly
+ * @param wide Sixteen 16-bit channels.
+ * @param narrow Same sixteen channels, as 8-bit values zero-extended to 16 bits.
+ * @param expanded Same sixteen channels, as 8-bit values expanded to 16 bits (x * 257).
+ */
+static inline __m256i resync_wide(__m256i wide, __m256i narrow, __m256i expanded)
+{
+    __m256i mask = _mm256_cmpeq_epi16(_mm256_srli_epi16(wide, 8), narrow);
+    return _mm256_blendv_epi8(expanded, wide, mask);
+}
+
+/** Compute (a * wa + b * wb) / 256 on unsigned 16-bit lanes
+ * Products are computed on 32 bits, so weights up to 256 can be used.
+ */
+static inline __m256i weighted_sum_wide(__m256i a, __m256i wa, __m256i b, __m256i wb)
+{
+    __m256i alo = _mm256_mullo_epi16(a, wa), ahi = _mm256_mulhi_epu16(a, wa);
+    __m256i blo = _mm256_mullo_epi16(b, wb), bhi = _mm256_mulhi_epu16(b, wb);
+
+    __m256i sum0 = _mm256_add_epi32(_mm256_unpacklo_epi16(alo, ahi), _mm256_unpacklo_epi16(blo, bhi));
+    __m256i sum1 = _mm256_add_epi32(_mm256_unpackhi_epi16(alo, ahi), _mm256_unpackhi_epi16(blo, bhi));
+
+    return _mm256_packus_epi32(_mm256_srli_epi32(sum0, 8), _mm256_srli_epi32(sum1, 8));
+}
+
+/* AVX2 unpacks work within 128-bit lanes. Narrow colors are loaded with their 64-bit
+ * quarters reordered (0xd8 = 0, 2, 1, 3), so unpacking them lines up with wide colors
+ * loaded in memory order. Packing back to narrow colors applies the same permutation. */
+
+KEYLEDSD_EXPORT void blend_wide_avx2(uint16_t * restrict wide, uint8_t * restrict dst,
+                                     const uint8_t * restrict src, size_t length)
+{
+    assert((uintptr_t)wide % 32 == 0);  // AVX2 requires 32-bytes aligned data
+    assert((uintptr_t)dst % 32 == 0);   // AVX2 requires 32-bytes aligned data
+    assert((uintptr_t)src % 32 == 0);   // AVX2 requires 32-bytes aligned data
+    assert(length != 0);                // allows inverting loop condition
+    assert(length % 8 == 0);            // we'll process entries 8 by 8
+
+    __m256i * restrict widev = (__m256i *)__builtin_assume_aligned(wide, 32);
+    __m256i * restrict dstv = (__m256i *)__builtin_assume_aligned(dst, 32);
+    const __m256i * restrict srcv = (const __m256i *)__builtin_assume_aligned(src, 32);
+
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi16(1);
+    const __m256i max = _mm256_set1_epi16(256);
+
+    length /= 8;
+
+    do {
+        __m256i packed_dst = _mm256_permute4x64_epi64(_mm256_load_si256(dstv), 0xd8);
+        __m256i packed_src = _mm256_permute4x64_epi64(_mm256_load_si256(srcv), 0xd8);
+
+        __m256i wide0 = resync_wide(_mm256_load_si256(widev),
+                                    _mm256_unpacklo_epi8(packed_dst, zero),
+                                    _mm256_unpacklo_epi8(packed_dst, packed_dst));
+        __m256i wide1 = resync_wide(_mm256_load_si256(widev + 1),
+                                    _mm256_unpackhi_epi8(packed_dst, zero),
+                                    _mm256_unpackhi_epi8(packed_dst, packed_dst));
+
+        __m256i src0 = _mm256_unpacklo_epi8(packed_src, zero); /* A3B3G3R3A2B2G2R2A1B1G1R1A0B0G0R0 */
+        __m256i src1 = _mm256_unpackhi_epi8(packed_src, zero); /* A7B7G7R7A6B6G6R6A5B5G5R5A4B4G4R4 */
+
+        __m256i alpha0 = _mm256_shufflelo_epi16(_mm256_shufflehi_epi16(src0, 0xff), 0xff);
+        alpha0 = _mm256_add_epi16(alpha0, _mm256_add_epi16(_mm256_cmpeq_epi16(alpha0, zero), one));
+        __m256i alpha1 = _mm256_shufflelo_epi16(_mm256_shufflehi_epi16(src1, 0xff), 0xff);
+        alpha1 = _mm256_add_epi16(alpha1, _mm256_add_epi16(_mm256_cmpeq_epi16(alpha1, zero), one));
+
+        wide0 = weighted_sum_wide(wide0, _mm256_sub_epi16(max, alpha0),
+                                  _mm256_unpacklo_epi8(packed_src, packed_src), alpha0);
+        wide1 = weighted_sum_wide(wide1, _mm256_sub_epi16(max, alpha1),
+                                  _mm256_unpackhi_epi8(packed_src, packed_src), alpha1);
+
+        _mm256_store_si256(widev, wide0);
+        _mm256_store_si256(widev + 1, wide1);
+        _mm256_store_si256(dstv, _mm256_permute4x64_epi64(
+            _mm256_packus_epi16(_mm256_srli_epi16(wide0, 8), _mm256_srli_epi16(wide1, 8)), 0xd8
+        ));
+        widev += 2;
+        srcv += 1;
+        dstv += 1;
+    } while (--length > 0);
+}
+
+KEYLEDSD_EXPORT void multiply_wide_avx2(uint16_t * restrict wide, uint8_t * restrict dst,
+                                        const uint8_t * restrict src, size_t length)
+{
+    assert((uintptr_t)wide % 32 == 0);  // AVX2 requires 32-bytes aligned data
+    assert((uintptr_t)dst % 32 == 0);   // AVX2 requires 32-bytes aligned data
+    assert((uintptr_t)src % 32 == 0);   // AVX2 requires 32-bytes aligned data
+    assert(length != 0);                // allows inverting loop condition
+    assert(length % 8 == 0);            // we'll process entries 8 by 8
+
+    __m256i * restrict widev = (__m256i *)__builtin_assume_aligned(wide, 32);
+    __m256i * restrict dstv = (__m256i *)__builtin_assume_aligned(dst, 32);
+    const __m256i * restrict srcv = (const __m256i *)__builtin_assume_aligned(src, 32);
+
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi16(1);
+
+    length /= 8;
+
+    do {
+        __m256i packed_dst = _mm256_permute4x64_epi64(_mm256_load_si256(dstv), 0xd8);
+        __m256i packed_src = _mm256_permute4x64_epi64(_mm256_load_si256(srcv), 0xd8);
+
+        __m256i wide0 = resync_wide(_mm256_load_si256(widev),
+                                    _mm256_unpacklo_epi8(packed_dst, zero),
+                                    _mm256_unpacklo_epi8(packed_dst, packed_dst));
+        __m256i wide1 = resync_wide(_mm256_load_si256(widev + 1),
+                                    _mm256_unpackhi_epi8(packed_dst, zero),
+                                    _mm256_unpackhi_epi8(packed_dst, packed_dst));
+
+        __m256i src0 = _mm256_add_epi16(_mm256_unpacklo_epi8(packed_src, zero), one);
+        __m256i src1 = _mm256_add_epi16(_mm256_unpackhi_epi8(packed_src, zero), one);
+
+        wide0 = weighted_sum_wide(wide0, src0, zero, zero);
+        wide1 = weighted_sum_wide(wide1, src1, zero, zero);
+
+        _mm256_store_si256(widev, wide0);
+        _mm256_store_si256(widev + 1, wide1);
+        _mm256_store_si256(dstv, _mm256_permute4x64_epi64(
+            _mm256_packus_epi16(_mm256_srli_epi16(wide0, 8), _mm256_srli_epi16(wide1, 8)), 0xd8
+        ));
+        widev += 2;
+        srcv += 1;
+        dstv += 1;
+    } while (--length > 0);
+}
+
+/****************************************************************************/
+/* Constant color variants: source weights are computed once */
+
+/// Load a single color, repeated in all eight entries
+static inline __m256i broadcast_color(const uint8_t * color)
+{
+    int32_t packed;
+    memcpy(&packed, color, sizeof(packed));
+    return _mm256_set1_epi32(packed);
+}
+
+KEYLEDSD_EXPORT void blend_color_avx2(uint8_t * restrict dst, const uint8_t * restrict color,
+                                      size_t length)
+{
+    assert((uintptr_t)dst % 32 == 0);   // AVX2 requires 32-bytes aligned data
+    assert(length != 0);                // allows inverting loop condition
+    assert(length % 8 == 0);            // we'll process entries 8 by 8
+
+    __m256i * restrict dstv = (__m256i *)__builtin_assume_aligned(dst, 32);
+
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi16(1);
+    const __m256i max = _mm256_set1_epi16(256);
+
+    const __m256i src = _mm256_unpacklo_epi8(broadcast_color(color), zero);
+    __m256i alpha = _mm256_shufflelo_epi16(_mm256_shufflehi_epi16(src, 0xff), 0xff);
+    alpha = _mm256_add_epi16(alpha, _mm256_add_epi16(_mm256_cmpeq_epi16(alpha, zero), one));
+    const __m256i weight = _mm256_sub_epi16(max, alpha);
+    const __m256i weighted_src = _mm256_mullo_epi16(src, alpha);
+
+    length /= 8;
+
+    do {
+        __m256i packed_dst = _mm256_load_si256(dstv);
+
+        __m256i dst0 = _mm256_unpacklo_epi8(packed_dst, zero); /* A3B3G3R3A2B2G2R2A1B1G1R1A0B0G0R0 */
+        __m256i dst1 = _mm256_unpackhi_epi8(packed_dst, zero); /* A7B7G7R7A6B6G6R6A5B5G5R5A4B4G4R4 */
+
+        dst0 = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(dst0, weight), weighted_src), 8);
+        dst1 = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(dst1, weight), weighted_src), 8);
+
+        _mm256_store_si256(dstv, _mm256_packus_epi16(dst0, dst1));
+        dstv += 1;
+    } while (--length > 0);
+}
+
+KEYLEDSD_EXPORT void blend_color_wide_avx2(uint16_t * restrict wide, uint8_t * restrict dst,
+                                           const uint8_t * restrict color, size_t length)
+{
+    assert((uintptr_t)wide % 32 == 0);  // AVX2 requires 32-bytes aligned data
+    assert((uintptr_t)dst % 32 == 0);   // AVX2 requires 32-bytes aligned data
+    assert(length != 0);                // allows inverting loop condition
+    assert(length % 8 == 0);            // we'll process entries 8 by 8
+
+    __m256i * restrict widev = (__m256i *)__builtin_assume_aligned(wide, 32);
+    __m256i * restrict dstv = (__m256i *)__builtin_assume_aligned(dst, 32);
+
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi16(1);
+    const __m256i max = _mm256_set1_epi16(256);
+
+    /* All entries are the same color, so source needs no lane reordering */
+    const __m256i packed_src = broadcast_color(color);
+    const __m256i src = _mm256_unpacklo_epi8(packed_src, packed_src);
+    __m256i alpha = _mm256_shufflelo_epi16(
+        _mm256_shufflehi_epi16(_mm256_unpacklo_epi8(packed_src, zero), 0xff), 0xff
+    );
+    alpha = _mm256_add_epi16(alpha, _mm256_add_epi16(_mm256_cmpeq_epi16(alpha, zero), one));
+    const __m256i weight = _mm256_sub_epi16(max, alpha);
+
+    length /= 8;
+
+    do {
+        __m256i packed_dst = _mm256_permute4x64_epi64(_mm256_load_si256(dstv), 0xd8);
+
+        __m256i wide0 = resync_wide(_mm256_load_si256(widev),
+                                    _mm256_unpacklo_epi8(packed_dst, zero),
+                                    _mm256_unpacklo_epi8(packed_dst, packed_dst));
+        __m256i wide1 = resync_wide(_mm256_load_si256(widev + 1),
+                                    _mm256_unpackhi_epi8(packed_dst, zero),
+                                    _mm256_unpackhi_epi8(packed_dst, packed_dst));
+
+        wide0 = weighted_sum_wide(wide0, weight, src, alpha);
+        wide1 = weighted_sum_wide(wide1, weight, src, alpha);
+
+        _mm256_store_si256(widev, wide0);
+        _mm256_store_si256(widev + 1, wide1);
+        _mm256_store_si256(dstv, _mm256_permute4x64_epi64(
+            _mm256_packus_epi16(_mm256_srli_epi16(wide0, 8), _mm256_srli_epi16(wide1, 8)), 0xd8
+        ));
+        widev += 2;
+        dstv += 1;
+    } while (--length > 0);
+}
+
+/****************************************************************************/
+/* Table sampling */
+
+KEYLEDSD_EXPORT void sample_table_avx2(uint8_t * restrict dst, const uint8_t * restrict table,
+                                       const uint32_t * restrict phases,
+                                       uint32_t offset, uint32_t mask, size_t length)
+{
+    assert((uintptr_t)dst % 32 == 0);   // AVX2 requires 32-bytes aligned data
+    assert(length != 0);                // allows inverting loop condition
+    assert(length % 8 == 0);            // we'll process entries 8 by 8
+
+    __m256i * restrict dstv = (__m256i *)__builtin_assume_aligned(dst, 32);
+    const int * restrict tablev = (const int *)table;
+
+    const __m256i offsetv = _mm256_set1_epi32((int)offset);
+    const __m256i maskv = _mm256_set1_epi32((int)mask);
+
+    length /= 8;
+
+    do {
+        __m256i phase = _mm256_loadu_si256((const __m256i *)phases);
+        __m256i index = _mm256_and_si256(_mm256_sub_epi32(offsetv, phase), maskv);
+
+        _mm256_store_si256(dstv, _mm256_i32gather_epi32(tablev, index, 4));
+        phases += 8;
+        dstv += 1;
+    } while (--length > 0);
+}
+
+/****************************************************************************/
+/* Box filter accumulation */
+
+KEYLEDSD_EXPORT void accumulate_avx2(uint16_t * restrict sums, const uint8_t * restrict src,
+                                     size_t length)
+{
+    for (; length >= 32; length -= 32) {
+        // Widening each half separately avoids crossing lanes
+        __m256i wide0 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)src));
+        __m256i wide1 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(src + 16)));
+        __m256i sum0 = _mm256_loadu_si256((const __m256i *)sums);
+        __m256i sum1 = _mm256_loadu_si256((const __m256i *)(sums + 16));
+
+        _mm256_storeu_si256((__m256i *)sums, _mm256_add_epi16(sum0, wide0));
+        _mm256_storeu_si256((__m256i *)(sums + 16), _mm256_add_epi16(sum1, wide1));
+        sums += 32;
+        src += 32;
+    }
+    if (length > 0) { accumulate_plain(sums, src, length); }
+}
+
+/****************************************************************************/
+/* Particle motion */
+
+KEYLEDSD_EXPORT void integrate_avx2(float * restrict position, float * restrict velocity,
+                                    float acceleration, float dt, size_t length)
+{
+    const __m256 dtv = _mm256_set1_ps(dt);
+    const __m256 offset = _mm256_set1_ps(acceleration * dt * dt / 2.0f);
+    const __m256 boost = _mm256_set1_ps(acceleration * dt);
+
+    for (; length >= 8; length -= 8) {
+        __m256 pos = _mm256_loadu_ps(position);
+        __m256 vel = _mm256_loadu_ps(velocity);
+
+        pos = _mm256_add_ps(_mm256_add_ps(pos, _mm256_mul_ps(vel, dtv)), offset);
+        vel = _mm256_add_ps(vel, boost);
+
+        _mm256_storeu_ps(position, pos);
+        _mm256_storeu_ps(velocity, vel);
+        position += 8;
+        velocity += 8;
+    }
+    if (length > 0) { integrate_plain(position, velocity, acceleration, dt, length); }
+}
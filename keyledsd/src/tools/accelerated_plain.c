@@ -16,6 +16,7 @@
  */
 #include <assert.h>
 #include <stdint.h>
+#include <string.h>
 #include "keyledsd/tools/accelerated.h"
 #include "config.h"
 
@@ -59,3 +60,192 @@ KEYLEDSD_EXPORT void multiply_plain(uint8_t * restrict a, const uint8_t * restri
         b += 4;
     } while (--length > 0);
 }
+
+/// Returns wide value for a channel, resetting it if narrow value was written directly
+static inline uint32_t wide_value(uint16_t wide, uint8_t narrow)
+{
+    return (wide >> 8) == narrow ? wide : (uint32_t)narrow * 257;
+}
+
+KEYLEDSD_EXPORT void blend_wide_plain(uint16_t * restrict w, uint8_t * restrict a,
+                                      const uint8_t * restrict b, size_t length)
+{
+    assert((uintptr_t)w % 8 == 0);    // Not a requirement, but lets compiler optimize stuff
+    assert((uintptr_t)a % 8 == 0);    // Not a requirement, but lets compiler optimize stuff
+    assert((uintptr_t)b % 8 == 0);    // Not a requirement, but lets compiler optimize stuff
+    assert(length != 0);              // allows inverting loop condition
+
+    w = (uint16_t * restrict)__builtin_assume_aligned(w, 8);
+    a = (uint8_t * restrict)__builtin_assume_aligned(a, 8);
+    b = (const uint8_t * restrict)__builtin_assume_aligned(b, 8);
+
+    do {
+        uint32_t alpha = b[3];
+        if (alpha != 0) { alpha += 1; }
+        for (unsigned c = 0; c < 4; ++c) {
+            uint32_t value = wide_value(w[c], a[c]);
+            value = (value * (256 - alpha) + (uint32_t)b[c] * 257 * alpha) / 256;
+            w[c] = (uint16_t)value;
+            a[c] = (uint8_t)(value >> 8);
+        }
+        w += 4;
+        a += 4;
+        b += 4;
+    } while (--length > 0);
+}
+
+KEYLEDSD_EXPORT void multiply_wide_plain(uint16_t * restrict w, uint8_t * restrict a,
+                                         const uint8_t * restrict b, size_t length)
+{
+    assert((uintptr_t)w % 8 == 0);    // Not a requirement, but lets compiler optimize stuff
+    assert((uintptr_t)a % 8 == 0);    // Not a requirement, but lets compiler optimize stuff
+    assert((uintptr_t)b % 8 == 0);    // Not a requirement, but lets compiler optimize stuff
+    assert(length != 0);              // allows inverting loop condition
+
+    w = (uint16_t * restrict)__builtin_assume_aligned(w, 8);
+    a = (uint8_t * restrict)__builtin_assume_aligned(a, 8);
+    b = (const uint8_t * restrict)__builtin_assume_aligned(b, 8);
+
+    do {
+        for (unsigned c = 0; c < 4; ++c) {
+            uint32_t value = wide_value(w[c], a[c]);
+            value = (value * ((uint32_t)b[c] + 1)) / 256;
+            w[c] = (uint16_t)value;
+            a[c] = (uint8_t)(value >> 8);
+        }
+        w += 4;
+        a += 4;
+        b += 4;
+    } while (--length > 0);
+}
+
+KEYLEDSD_EXPORT void blend_color_plain(uint8_t * restrict a, const uint8_t * restrict color,
+                                       size_t length)
+{
+    assert((uintptr_t)a % 8 == 0);    // Not a requirement, but lets compiler optimize stuff
+    assert(length != 0);              // allows inverting loop condition
+
+    a = (uint8_t * restrict)__builtin_assume_aligned(a, 8);
+
+    uint16_t alpha = color[3];
+    if (alpha != 0) { alpha += 1; }
+    const uint16_t weight = (uint16_t)256 - alpha;
+    const uint16_t src[4] = {
+        (uint16_t)(color[0] * alpha), (uint16_t)(color[1] * alpha),
+        (uint16_t)(color[2] * alpha), (uint16_t)(color[3] * alpha)
+    };
+
+    do {
+        a[0] = (uint8_t)(((uint16_t)a[0] * weight + src[0]) / 256);
+        a[1] = (uint8_t)(((uint16_t)a[1] * weight + src[1]) / 256);
+        a[2] = (uint8_t)(((uint16_t)a[2] * weight + src[2]) / 256);
+        a[3] = (uint8_t)(((uint16_t)a[3] * weight + src[3]) / 256);
+        a += 4;
+    } while (--length > 0);
+}
+
+KEYLEDSD_EXPORT void blend_color_wide_plain(uint16_t * restrict w, uint8_t * restrict a,
+                                            const uint8_t * restrict color, size_t length)
+{
+    assert((uintptr_t)w % 8 == 0);    // Not a requirement, but lets compiler optimize stuff
+    assert((uintptr_t)a % 8 == 0);    // Not a requirement, but lets compiler optimize stuff
+    assert(length != 0);              // allows inverting loop condition
+
+    w = (uint16_t * restrict)__builtin_assume_aligned(w, 8);
+    a = (uint8_t * restrict)__builtin_assume_aligned(a, 8);
+
+    uint32_t alpha = color[3];
+    if (alpha != 0) { alpha += 1; }
+    const uint32_t weight = 256 - alpha;
+    const uint32_t src[4] = {
+        (uint32_t)color[0] * 257 * alpha, (uint32_t)color[1] * 257 * alpha,
+        (uint32_t)color[2] * 257 * alpha, (uint32_t)color[3] * 257 * alpha
+    };
+
+    do {
+        for (unsigned c = 0; c < 4; ++c) {
+            uint32_t value = wide_value(w[c], a[c]);
+            value = (value * weight + src[c]) / 256;
+            w[c] = (uint16_t)value;
+            a[c] = (uint8_t)(value >> 8);
+        }
+        w += 4;
+        a += 4;
+    } while (--length > 0);
+}
+
+KEYLEDSD_EXPORT void blend_indexed(uint8_t * restrict a, const uint8_t * restrict b,
+                                   const uint32_t * restrict indices, size_t length)
+{
+    for (; length > 0; --length) {
+        uint8_t * restrict dst = a + 4 * (size_t)*indices;
+        uint16_t alpha = b[3];
+        if (alpha != 0) { alpha += 1; }
+        dst[0] = (uint8_t)(((uint16_t)dst[0] * ((uint16_t)256 - alpha) + (uint16_t)b[0] * alpha) / 256);
+        dst[1] = (uint8_t)(((uint16_t)dst[1] * ((uint16_t)256 - alpha) + (uint16_t)b[1] * alpha) / 256);
+        dst[2] = (uint8_t)(((uint16_t)dst[2] * ((uint16_t)256 - alpha) + (uint16_t)b[2] * alpha) / 256);
+        dst[3] = (uint8_t)(((uint16_t)dst[3] * ((uint16_t)256 - alpha) + (uint16_t)b[3] * alpha) / 256);
+        b += 4;
+        indices += 1;
+    }
+}
+
+KEYLEDSD_EXPORT void blend_indexed_wide(uint16_t * restrict w, uint8_t * restrict a,
+                                        const uint8_t * restrict b,
+                                        const uint32_t * restrict indices, size_t length)
+{
+    for (; length > 0; --length) {
+        uint16_t * restrict wdst = w + 4 * (size_t)*indices;
+        uint8_t * restrict dst = a + 4 * (size_t)*indices;
+        uint32_t alpha = b[3];
+        if (alpha != 0) { alpha += 1; }
+        for (unsigned c = 0; c < 4; ++c) {
+            uint32_t value = wide_value(wdst[c], dst[c]);
+            value = (value * (256 - alpha) + (uint32_t)b[c] * 257 * alpha) / 256;
+            wdst[c] = (uint16_t)value;
+            dst[c] = (uint8_t)(value >> 8);
+        }
+        b += 4;
+        indices += 1;
+    }
+}
+
+KEYLEDSD_EXPORT void sample_table_plain(uint8_t * restrict a, const uint8_t * restrict table,
+                                        const uint32_t * restrict phases,
+                                        uint32_t offset, uint32_t mask, size_t length)
+{
+    assert((uintptr_t)a % 8 == 0);    // Not a requirement, but lets compiler optimize stuff
+    assert(length != 0);              // allows inverting loop condition
+
+    a = (uint8_t * restrict)__builtin_assume_aligned(a, 8);
+
+    do {
+        memcpy(a, table + 4 * (size_t)((offset - *phases) & mask), 4);
+        a += 4;
+        phases += 1;
+    } while (--length > 0);
+}
+
+KEYLEDSD_EXPORT void accumulate_plain(uint16_t * restrict sums, const uint8_t * restrict a,
+                                      size_t length)
+{
+    for (; length > 0; --length) {
+        *sums = (uint16_t)(*sums + *a);
+        sums += 1;
+        a += 1;
+    }
+}
+
+KEYLEDSD_EXPORT void integrate_plain(float * restrict position, float * restrict velocity,
+                                     float acceleration, float dt, size_t length)
+{
+    const float offset = acceleration * dt * dt / 2.0f;
+    const float boost = acceleration * dt;
+
+    for (; length > 0; --length) {
+        *position = *position + *velocity * dt + offset;
+        *velocity = *velocity + boost;
+        position += 1;
+        velocity += 1;
+    }
+}
@@ -16,6 +16,7 @@
  */
 #include <assert.h>
 #include <stdint.h>
+#include <string.h>
 #include <emmintrin.h>
 #include "keyledsd/tools/accelerated.h"
 #include "config.h"
@@ -105,3 +106,273 @@ KEYLEDSD_EXPORT void multiply_sse2(uint8_t * restrict dst, const uint8_t * restr
         dstv += 1;
     } while (--length > 0);
 }
+
+/****************************************************************************/
+/* Wide variants: accumulate into 16-bit channels, narrow copy kept updated */
+
+/** Reset wide channels whose narrow value was written directly
+ * @param wide Eight 16-bit channels.
+ * @param narrow Same eight channels, as 8-bit values zero-extended to 16 bits.
+ * @param expanded Same eight channels, as 8-bit values expanded to 16 bits (x * 257).
+ */
+static inline __m128i resync_wide(__m128i wide, __m128i narrow, __m128i expanded)
+{
+    __m128i mask = _mm_cmpeq_epi16(_mm_srli_epi16(wide, 8), narrow);
+    return _mm_or_si128(_mm_and_si128(mask, wide), _mm_andnot_si128(mask, expanded));
+}
+
+/** Compute (a * wa + b * wb) / 256 on unsigned 16-bit lanes
+ * Products are computed on 32 bits, so weights up to 256 can be used.
+ */
+static inline __m128i weighted_sum_wide(__m128i a, __m128i wa, __m128i b, __m128i wb)
+{
+    const __m128i bias = _mm_set1_epi32(32768);
+    const __m128i sign = _mm_set1_epi16((short)0x8000);
+
+    __m128i alo = _mm_mullo_epi16(a, wa), ahi = _mm_mulhi_epu16(a, wa);
+    __m128i blo = _mm_mullo_epi16(b, wb), bhi = _mm_mulhi_epu16(b, wb);
+
+    __m128i sum0 = _mm_add_epi32(_mm_unpacklo_epi16(alo, ahi), _mm_unpacklo_epi16(blo, bhi));
+    __m128i sum1 = _mm_add_epi32(_mm_unpackhi_epi16(alo, ahi), _mm_unpackhi_epi16(blo, bhi));
+
+    /* SSE2 can only pack with signed saturation, so shift range around zero and back */
+    sum0 = _mm_sub_epi32(_mm_srli_epi32(sum0, 8), bias);
+    sum1 = _mm_sub_epi32(_mm_srli_epi32(sum1, 8), bias);
+    return _mm_xor_si128(_mm_packs_epi32(sum0, sum1), sign);
+}
+
+KEYLEDSD_EXPORT void blend_wide_sse2(uint16_t * restrict wide, uint8_t * restrict dst,
+                                     const uint8_t * restrict src, size_t length)
+{
+    assert((uintptr_t)wide % 16 == 0);  // SSE2 requires 16-bytes aligned data
+    assert((uintptr_t)dst % 16 == 0);   // SSE2 requires 16-bytes aligned data
+    assert((uintptr_t)src % 16 == 0);   // SSE2 requires 16-bytes aligned data
+    assert(length != 0);                // allows inverting loop condition
+    assert(length % 4 == 0);            // we'll process entries 4 by 4
+
+    __m128i * restrict widev = (__m128i *)__builtin_assume_aligned(wide, 16);
+    __m128i * restrict dstv = (__m128i *)__builtin_assume_aligned(dst, 16);
+    const __m128i * restrict srcv = (const __m128i *)__builtin_assume_aligned(src, 16);
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i max = _mm_set1_epi16(256);
+
+    length /= 4;
+
+    do {
+        __m128i packed_dst = _mm_load_si128(dstv);
+        __m128i packed_src = _mm_load_si128(srcv);
+
+        __m128i wide0 = resync_wide(_mm_load_si128(widev),
+                                    _mm_unpacklo_epi8(packed_dst, zero),
+                                    _mm_unpacklo_epi8(packed_dst, packed_dst));
+        __m128i wide1 = resync_wide(_mm_load_si128(widev + 1),
+                                    _mm_unpackhi_epi8(packed_dst, zero),
+                                    _mm_unpackhi_epi8(packed_dst, packed_dst));
+
+        __m128i src0 = _mm_unpacklo_epi8(packed_src, zero); /* A1B1G1R1A0B0G0R0 */
+        __m128i src1 = _mm_unpackhi_epi8(packed_src, zero); /* A3B3G3R3A2B2G2R2 */
+
+        __m128i alpha0 = _mm_shufflelo_epi16(_mm_shufflehi_epi16(src0, 0xff), 0xff);
+        alpha0 = _mm_add_epi16(alpha0, _mm_add_epi16(_mm_cmpeq_epi16(alpha0, zero), one));
+        __m128i alpha1 = _mm_shufflelo_epi16(_mm_shufflehi_epi16(src1, 0xff), 0xff);
+        alpha1 = _mm_add_epi16(alpha1, _mm_add_epi16(_mm_cmpeq_epi16(alpha1, zero), one));
+
+        wide0 = weighted_sum_wide(wide0, _mm_sub_epi16(max, alpha0),
+                                  _mm_unpacklo_epi8(packed_src, packed_src), alpha0);
+        wide1 = weighted_sum_wide(wide1, _mm_sub_epi16(max, alpha1),
+                                  _mm_unpackhi_epi8(packed_src, packed_src), alpha1);
+
+        _mm_store_si128(widev, wide0);
+        _mm_store_si128(widev + 1, wide1);
+        _mm_store_si128(dstv, _mm_packus_epi16(_mm_srli_epi16(wide0, 8), _mm_srli_epi16(wide1, 8)));
+        widev += 2;
+        srcv += 1;
+        dstv += 1;
+    } while (--length > 0);
+}
+
+KEYLEDSD_EXPORT void multiply_wide_sse2(uint16_t * restrict wide, uint8_t * restrict dst,
+                                        const uint8_t * restrict src, size_t length)
+{
+    assert((uintptr_t)wide % 16 == 0);  // SSE2 requires 16-bytes aligned data
+    assert((uintptr_t)dst % 16 == 0);   // SSE2 requires 16-bytes aligned data
+    assert((uintptr_t)src % 16 == 0);   // SSE2 requires 16-bytes aligned data
+    assert(length != 0);                // allows inverting loop condition
+    assert(length % 4 == 0);            // we'll process entries 4 by 4
+
+    __m128i * restrict widev = (__m128i *)__builtin_assume_aligned(wide, 16);
+    __m128i * restrict dstv = (__m128i *)__builtin_assume_aligned(dst, 16);
+    const __m128i * restrict srcv = (const __m128i *)__builtin_assume_aligned(src, 16);
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(1);
+
+    length /= 4;
+
+    do {
+        __m128i packed_dst = _mm_load_si128(dstv);
+        __m128i packed_src = _mm_load_si128(srcv);
+
+        __m128i wide0 = resync_wide(_mm_load_si128(widev),
+                                    _mm_unpacklo_epi8(packed_dst, zero),
+                                    _mm_unpacklo_epi8(packed_dst, packed_dst));
+        __m128i wide1 = resync_wide(_mm_load_si128(widev + 1),
+                                    _mm_unpackhi_epi8(packed_dst, zero),
+                                    _mm_unpackhi_epi8(packed_dst, packed_dst));
+
+        __m128i src0 = _mm_add_epi16(_mm_unpacklo_epi8(packed_src, zero), one);
+        __m128i src1 = _mm_add_epi16(_mm_unpackhi_epi8(packed_src, zero), one);
+
+        wide0 = weighted_sum_wide(wide0, src0, zero, zero);
+        wide1 = weighted_sum_wide(wide1, src1, zero, zero);
+
+        _mm_store_si128(widev, wide0);
+        _mm_store_si128(widev + 1, wide1);
+        _mm_store_si128(dstv, _mm_packus_epi16(_mm_srli_epi16(wide0, 8), _mm_srli_epi16(wide1, 8)));
+        widev += 2;
+        srcv += 1;
+        dstv += 1;
+    } while (--length > 0);
+}
+
+/****************************************************************************/
+/* Constant color variants: source weights are computed once */
+
+/// Load a single color, repeated in all four entries
+static inline __m128i broadcast_color(const uint8_t * color)
+{
+    int32_t packed;
+    memcpy(&packed, color, sizeof(packed));
+    return _mm_set1_epi32(packed);
+}
+
+KEYLEDSD_EXPORT void blend_color_sse2(uint8_t * restrict dst, const uint8_t * restrict color,
+                                      size_t length)
+{
+    assert((uintptr_t)dst % 16 == 0);   // SSE2 requires 16-bytes aligned data
+    assert(length != 0);                // allows inverting loop condition
+    assert(length % 4 == 0);            // we'll process entries 4 by 4
+
+    __m128i * restrict dstv = (__m128i *)__builtin_assume_aligned(dst, 16);
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i max = _mm_set1_epi16(256);
+
+    const __m128i src = _mm_unpacklo_epi8(broadcast_color(color), zero);
+    __m128i alpha = _mm_shufflelo_epi16(_mm_shufflehi_epi16(src, 0xff), 0xff);
+    alpha = _mm_add_epi16(alpha, _mm_add_epi16(_mm_cmpeq_epi16(alpha, zero), one));
+    const __m128i weight = _mm_sub_epi16(max, alpha);
+    const __m128i weighted_src = _mm_mullo_epi16(src, alpha);
+
+    length /= 4;
+
+    do {
+        __m128i packed_dst = _mm_load_si128(dstv);
+
+        __m128i dst0 = _mm_unpacklo_epi8(packed_dst, zero); /* A1B1G1R1A0B0G0R0 */
+        __m128i dst1 = _mm_unpackhi_epi8(packed_dst, zero); /* A3B3G3R3A2B2G2R2 */
+
+        dst0 = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(dst0, weight), weighted_src), 8);
+        dst1 = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(dst1, weight), weighted_src), 8);
+
+        _mm_store_si128(dstv, _mm_packus_epi16(dst0, dst1));
+        dstv += 1;
+    } while (--length > 0);
+}
+
+KEYLEDSD_EXPORT void blend_color_wide_sse2(uint16_t * restrict wide, uint8_t * restrict dst,
+                                           const uint8_t * restrict color, size_t length)
+{
+    assert((uintptr_t)wide % 16 == 0);  // SSE2 requires 16-bytes aligned data
+    assert((uintptr_t)dst % 16 == 0);   // SSE2 requires 16-bytes aligned data
+    assert(length != 0);                // allows inverting loop condition
+    assert(length % 4 == 0);            // we'll process entries 4 by 4
+
+    __m128i * restrict widev = (__m128i *)__builtin_assume_aligned(wide, 16);
+    __m128i * restrict dstv = (__m128i *)__builtin_assume_aligned(dst, 16);
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i max = _mm_set1_epi16(256);
+
+    const __m128i packed_src = broadcast_color(color);
+    const __m128i src = _mm_unpacklo_epi8(packed_src, packed_src);
+    __m128i alpha = _mm_shufflelo_epi16(_mm_shufflehi_epi16(_mm_unpacklo_epi8(packed_src, zero),
+                                                            0xff), 0xff);
+    alpha = _mm_add_epi16(alpha, _mm_add_epi16(_mm_cmpeq_epi16(alpha, zero), one));
+    const __m128i weight = _mm_sub_epi16(max, alpha);
+
+    length /= 4;
+
+    do {
+        __m128i packed_dst = _mm_load_si128(dstv);
+
+        __m128i wide0 = resync_wide(_mm_load_si128(widev),
+                                    _mm_unpacklo_epi8(packed_dst, zero),
+                                    _mm_unpacklo_epi8(packed_dst, packed_dst));
+        __m128i wide1 = resync_wide(_mm_load_si128(widev + 1),
+                                    _mm_unpackhi_epi8(packed_dst, zero),
+                                    _mm_unpackhi_epi8(packed_dst, packed_dst));
+
+        wide0 = weighted_sum_wide(wide0, weight, src, alpha);
+        wide1 = weighted_sum_wide(wide1, weight, src, alpha);
+
+        _mm_store_si128(widev, wide0);
+        _mm_store_si128(widev + 1, wide1);
+        _mm_store_si128(dstv, _mm_packus_epi16(_mm_srli_epi16(wide0, 8), _mm_srli_epi16(wide1, 8)));
+        widev += 2;
+        dstv += 1;
+    } while (--length > 0);
+}
+
+/****************************************************************************/
+/* Box filter accumulation */
+
+KEYLEDSD_EXPORT void accumulate_sse2(uint16_t * restrict sums, const uint8_t * restrict src,
+                                     size_t length)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; length >= 16; length -= 16) {
+        __m128i packed = _mm_loadu_si128((const __m128i *)src);
+        __m128i sum0 = _mm_loadu_si128((const __m128i *)sums);
+        __m128i sum1 = _mm_loadu_si128((const __m128i *)(sums + 8));
+
+        sum0 = _mm_add_epi16(sum0, _mm_unpacklo_epi8(packed, zero));
+        sum1 = _mm_add_epi16(sum1, _mm_unpackhi_epi8(packed, zero));
+
+        _mm_storeu_si128((__m128i *)sums, sum0);
+        _mm_storeu_si128((__m128i *)(sums + 8), sum1);
+        sums += 16;
+        src += 16;
+    }
+    if (length > 0) { accumulate_plain(sums, src, length); }
+}
+
+/****************************************************************************/
+/* Particle motion */
+
+KEYLEDSD_EXPORT void integrate_sse2(float * restrict position, float * restrict velocity,
+                                    float acceleration, float dt, size_t length)
+{
+    const __m128 dtv = _mm_set1_ps(dt);
+    const __m128 offset = _mm_set1_ps(acceleration * dt * dt / 2.0f);
+    const __m128 boost = _mm_set1_ps(acceleration * dt);
+
+    for (; length >= 4; length -= 4) {
+        __m128 pos = _mm_loadu_ps(position);
+        __m128 vel = _mm_loadu_ps(velocity);
+
+        pos = _mm_add_ps(_mm_add_ps(pos, _mm_mul_ps(vel, dtv)), offset);
+        vel = _mm_add_ps(vel, boost);
+
+        _mm_storeu_ps(position, pos);
+        _mm_storeu_ps(velocity, vel);
+        position += 4;
+        velocity += 4;
+    }
+    if (length > 0) { integrate_plain(position, velocity, acceleration, dt, length); }
+}
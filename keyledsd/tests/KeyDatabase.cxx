@@ -121,6 +121,17 @@ TEST_F(KeyDatabaseTest, angle) {
     EXPECT_DOUBLE_EQ(std::atan(-4.0/3.0), m_db.angle(m_db[0], m_db[4]));
 }
 
+TEST_F(KeyDatabaseTest, center) {
+    EXPECT_FLOAT_EQ(0.0625f, m_db.center(m_db[0]).x);
+    EXPECT_FLOAT_EQ(0.0625f, m_db.center(m_db[0]).y);
+    EXPECT_FLOAT_EQ(0.9375f, m_db.center(m_db[1]).x);
+    EXPECT_FLOAT_EQ(0.9375f, m_db.center(m_db[1]).y);
+    EXPECT_FLOAT_EQ(0.9375f, m_db.center(m_db[2]).x);
+    EXPECT_FLOAT_EQ(0.0625f, m_db.center(m_db[2]).y);
+    EXPECT_FLOAT_EQ(0.4375f, m_db.center(m_db[4]).x);
+    EXPECT_FLOAT_EQ(0.5625f, m_db.center(m_db[4]).y);
+}
+
 
 class KeyGroupTest : public KeyDatabaseTest {
 protected:
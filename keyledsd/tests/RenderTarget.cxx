@@ -19,10 +19,12 @@
 #include "keyledsd/tools/accelerated.h"
 #include <gtest/gtest.h>
 #include <type_traits>
+#include <vector>
 
 using keyleds::RenderTarget;
 using keyleds::RGBColor;
 using keyleds::RGBAColor;
+using keyleds::RGBA64Color;
 namespace architecture = keyleds::tools::architecture;
 
 
@@ -122,6 +124,27 @@ TEST(RenderTargetTest, iterator) {
     EXPECT_EQ(7, std::count(target.begin(), target.end(), RGBAColor{0x22, 0x33, 0x44, 0x55}));
 }
 
+TEST(RenderTargetTest, highPrecision) {
+    auto target = RenderTarget(7);
+    EXPECT_FALSE(target.highPrecision());
+    EXPECT_EQ(nullptr, target.wideData());
+
+    target = RenderTarget(7, RenderTarget::Precision::High);
+    ASSERT_TRUE(target.highPrecision());
+    ASSERT_NE(nullptr, target.wideData());
+    target[0] = RGBAColor{0x11, 0x22, 0x33, 0x44};
+    target.wideData()[1] = RGBA64Color{0x2280, 0x3380, 0x4480, 0x5580};
+    target[1] = RGBAColor{0x22, 0x33, 0x44, 0x55};
+    target.syncWide();
+    EXPECT_EQ(RGBA64Color(RGBAColor{0x11, 0x22, 0x33, 0x44}), target.wideData()[0]);
+    EXPECT_EQ(RGBA64Color(0x2280, 0x3380, 0x4480, 0x5580), target.wideData()[1]);
+
+    auto other = std::move(target);
+    EXPECT_FALSE(target.highPrecision());
+    ASSERT_TRUE(other.highPrecision());
+    EXPECT_EQ(RGBA64Color(0x2280, 0x3380, 0x4480, 0x5580), other.wideData()[1]);
+}
+
 
 template <typename T>
 class RenderTargetAccelerationTest : public ::testing::Test {
@@ -177,3 +200,177 @@ TYPED_TEST(RenderTargetAccelerationTest, multiply) {
     EXPECT_TRUE(std::all_of(target.begin(), target.end(),
                 [](auto item) { return item == RGBAColor{0xff, 0x80, 0x00, 0x3f}; }));
 }
+
+TYPED_TEST(RenderTargetAccelerationTest, blendWide) {
+    auto target = RenderTarget(TestFixture::size, RenderTarget::Precision::High);
+    std::fill(target.begin(), target.end(), TestFixture::black);
+    keyleds::blend<typename TestFixture::architecture>(target, TestFixture::translucentWhite);
+    EXPECT_EQ(RGBAColor(0x7f, 0x7f, 0x7f, 0xbf), target[0]);
+    EXPECT_EQ(RGBA64Color(0x7fff, 0x7fff, 0x7fff, 0xbfbf), target.wideData()[0]);
+    EXPECT_TRUE(std::all_of(target.begin(), target.end(),
+                [](auto item) { return item == RGBAColor{0x7f, 0x7f, 0x7f, 0xbf}; }));
+    EXPECT_TRUE(std::all_of(target.wideData(), target.wideData() + target.size(),
+                [](auto item) { return item == RGBA64Color{0x7fff, 0x7fff, 0x7fff, 0xbfbf}; }));
+
+    target[3] = RGBAColor{0x10, 0x20, 0x30, 0xff};  // direct write is picked up
+    keyleds::blend<typename TestFixture::architecture>(target, TestFixture::opaqueWhite);
+    EXPECT_EQ(RGBAColor(0xff, 0xff, 0xff, 0xff), target[3]);
+    EXPECT_TRUE(std::all_of(target.begin(), target.end(),
+                [](auto item) { return item == RGBAColor{0xff, 0xff, 0xff, 0xff}; }));
+    EXPECT_TRUE(std::all_of(target.wideData(), target.wideData() + target.size(),
+                [](auto item) { return item == RGBA64Color{0xffff, 0xffff, 0xffff, 0xffff}; }));
+}
+
+TYPED_TEST(RenderTargetAccelerationTest, blendWideAccumulates) {
+    // Faint layers stacked on black: each one is below 8-bit resolution, yet they add up
+    auto faintWhite = RenderTarget(TestFixture::size);
+    std::fill(faintWhite.begin(), faintWhite.end(), RGBAColor{0xff, 0xff, 0xff, 0x01});
+
+    auto narrow = RenderTarget(TestFixture::size);
+    auto target = RenderTarget(TestFixture::size, RenderTarget::Precision::High);
+    std::fill(narrow.begin(), narrow.end(), TestFixture::black);
+    std::fill(target.begin(), target.end(), TestFixture::black);
+    for (int i = 0; i < 64; ++i) {
+        keyleds::blend<typename TestFixture::architecture>(narrow, faintWhite);
+        keyleds::blend<typename TestFixture::architecture>(target, faintWhite);
+    }
+    EXPECT_GT(target[0].red, narrow[0].red);
+    EXPECT_NEAR(100, target[0].red, 1);    // 255 * (1 - (254 / 256) ^ 64)
+
+    auto transparent = RenderTarget(TestFixture::size);
+    std::fill(transparent.begin(), transparent.end(), RGBAColor{0xff, 0xff, 0xff, 0x00});
+    const auto before = target.wideData()[0];
+    for (int i = 0; i < 64; ++i) {
+        keyleds::blend<typename TestFixture::architecture>(target, transparent);
+    }
+    EXPECT_EQ(before, target.wideData()[0]);
+}
+
+TYPED_TEST(RenderTargetAccelerationTest, multiplyWide) {
+    auto target = RenderTarget(TestFixture::size, RenderTarget::Precision::High);
+    std::fill(target.begin(), target.end(), RGBAColor{0xff, 0x80, 0x00, 0x7f});
+    keyleds::multiply<typename TestFixture::architecture>(target, TestFixture::translucentWhite);
+    EXPECT_EQ(RGBAColor(0xff, 0x80, 0x00, 0x3f), target[0]);
+    EXPECT_EQ(RGBA64Color(0xffff, 0x8080, 0x0000, 0x3fbf), target.wideData()[0]);
+    EXPECT_TRUE(std::all_of(target.begin(), target.end(),
+                [](auto item) { return item == RGBAColor{0xff, 0x80, 0x00, 0x3f}; }));
+}
+
+TYPED_TEST(RenderTargetAccelerationTest, blendColor) {
+    auto target = RenderTarget(TestFixture::size);
+    auto expected = RenderTarget(TestFixture::size);
+    for (std::size_t idx = 0; idx < target.size(); ++idx) {
+        auto value = static_cast<uint8_t>(idx * 7);
+        target[idx] = expected[idx] = RGBAColor{value, uint8_t(255 - value), 0x40, 0xff};
+    }
+    keyleds::blend<typename TestFixture::architecture>(expected, TestFixture::translucentWhite);
+    keyleds::blend<typename TestFixture::architecture>(target, RGBAColor{0xff, 0xff, 0xff, 0x7f});
+    EXPECT_TRUE(std::equal(target.begin(), target.end(), expected.begin()));
+
+    keyleds::blend<typename TestFixture::architecture>(target, RGBAColor{0x10, 0x20, 0x30, 0x00});
+    EXPECT_TRUE(std::equal(target.begin(), target.end(), expected.begin()));
+    keyleds::blend<typename TestFixture::architecture>(target, RGBAColor{0x10, 0x20, 0x30, 0xff});
+    EXPECT_TRUE(std::all_of(target.begin(), target.end(),
+                [](auto item) { return item == RGBAColor{0x10, 0x20, 0x30, 0xff}; }));
+}
+
+TYPED_TEST(RenderTargetAccelerationTest, blendColorWide) {
+    auto target = RenderTarget(TestFixture::size, RenderTarget::Precision::High);
+    auto expected = RenderTarget(TestFixture::size, RenderTarget::Precision::High);
+    for (std::size_t idx = 0; idx < target.size(); ++idx) {
+        auto value = static_cast<uint8_t>(idx * 7);
+        target[idx] = expected[idx] = RGBAColor{value, uint8_t(255 - value), 0x40, 0xff};
+    }
+    target.syncWide();
+    expected.syncWide();
+    keyleds::blend<typename TestFixture::architecture>(expected, TestFixture::translucentWhite);
+    keyleds::blend<typename TestFixture::architecture>(target, RGBAColor{0xff, 0xff, 0xff, 0x7f});
+    EXPECT_TRUE(std::equal(target.begin(), target.end(), expected.begin()));
+    EXPECT_TRUE(std::equal(target.wideData(), target.wideData() + target.size(),
+                           expected.wideData()));
+
+    target[3] = RGBAColor{0x10, 0x20, 0x30, 0xff};  // direct write is picked up
+    keyleds::blend<typename TestFixture::architecture>(target, RGBAColor{0xff, 0xff, 0xff, 0xff});
+    EXPECT_TRUE(std::all_of(target.wideData(), target.wideData() + target.size(),
+                [](auto item) { return item == RGBA64Color{0xffff, 0xffff, 0xffff, 0xffff}; }));
+}
+
+TYPED_TEST(RenderTargetAccelerationTest, sampleTable) {
+    constexpr uint32_t tableSize = 16;
+    auto table = std::vector<RGBAColor>(tableSize);
+    for (uint32_t idx = 0; idx < tableSize; ++idx) { table[idx] = RGBAColor{uint8_t(idx), 0, 0, 0xff}; }
+
+    auto target = RenderTarget(TestFixture::size);
+    auto phases = std::vector<uint32_t>(target.capacity());
+    for (std::size_t idx = 0; idx < phases.size(); ++idx) { phases[idx] = uint32_t(idx * 3) % tableSize; }
+
+    TestFixture::architecture::sample_table(reinterpret_cast<uint8_t *>(target.data()),
+                                            reinterpret_cast<const uint8_t *>(table.data()),
+                                            phases.data(), 5, tableSize - 1, target.capacity());
+    for (std::size_t idx = 0; idx < target.size(); ++idx) {
+        EXPECT_EQ(RGBAColor(uint8_t((5 + tableSize - phases[idx]) % tableSize), 0, 0, 0xff), target[idx]);
+    }
+}
+
+TYPED_TEST(RenderTargetAccelerationTest, accumulate) {
+    constexpr std::size_t length = 77;          // not a multiple of vector size, to check tails
+    auto bytes = std::vector<uint8_t>(length + 1);
+    for (std::size_t idx = 0; idx < bytes.size(); ++idx) { bytes[idx] = uint8_t(idx * 13); }
+    auto sums = std::vector<uint16_t>(length + 1, 1000);
+
+    for (int row = 0; row < 3; ++row) {         // unaligned pointers are accepted
+        TestFixture::architecture::accumulate(sums.data() + 1, bytes.data() + 1, length);
+    }
+    EXPECT_EQ(1000, sums[0]);
+    for (std::size_t idx = 1; idx <= length; ++idx) {
+        EXPECT_EQ(1000 + 3 * bytes[idx], sums[idx]);
+    }
+
+    auto full = std::vector<uint16_t>(length, 0);
+    auto saturated = std::vector<uint8_t>(length, 0xff);
+    for (int row = 0; row < 257; ++row) {
+        TestFixture::architecture::accumulate(full.data(), saturated.data(), length);
+    }
+    EXPECT_TRUE(std::all_of(full.begin(), full.end(), [](auto item) { return item == 0xffff; }));
+}
+
+TYPED_TEST(RenderTargetAccelerationTest, integrate) {
+    constexpr std::size_t length = 19;          // not a multiple of vector size, to check tails
+    auto position = std::vector<float>(length + 1, 5.0f);
+    auto velocity = std::vector<float>(length + 1);
+    for (std::size_t idx = 0; idx < velocity.size(); ++idx) { velocity[idx] = float(idx); }
+
+    for (int step = 0; step < 4; ++step) {      // unaligned pointers are accepted
+        TestFixture::architecture::integrate(position.data() + 1, velocity.data() + 1,
+                                             2.0f, 0.5f, length);
+    }
+    EXPECT_EQ(5.0f, position[0]);
+    EXPECT_EQ(0.0f, velocity[0]);
+    for (std::size_t idx = 1; idx <= length; ++idx) {
+        // After 2 units of time: p = p0 + 2 v0 + a 2^2 / 2, v = v0 + 2 a
+        EXPECT_FLOAT_EQ(5.0f + 2.0f * float(idx) + 4.0f, position[idx]);
+        EXPECT_FLOAT_EQ(float(idx) + 4.0f, velocity[idx]);
+    }
+}
+
+TEST(RenderTargetTest, blendIndexed) {
+    auto source = RenderTarget(3);
+    source[0] = RGBAColor{0xff, 0xff, 0xff, 0xff};
+    source[1] = RGBAColor{0xff, 0xff, 0xff, 0x7f};
+    source[2] = RGBAColor{0xff, 0xff, 0xff, 0x00};
+    const uint32_t indices[] = { 7, 2, 4 };
+
+    for (auto precision : { RenderTarget::Precision::Normal, RenderTarget::Precision::High }) {
+        auto target = RenderTarget(10, precision);
+        std::fill(target.begin(), target.end(), RGBAColor{0, 0, 0, 0xff});
+        target.syncWide();
+        keyleds::blend(target, source, indices, 3);
+        EXPECT_EQ(RGBAColor(0xff, 0xff, 0xff, 0xff), target[7]);
+        EXPECT_EQ(RGBAColor(0x7f, 0x7f, 0x7f, 0xbf), target[2]);
+        EXPECT_EQ(RGBAColor(0, 0, 0, 0xff), target[4]);
+        EXPECT_EQ(RGBAColor(0, 0, 0, 0xff), target[0]);
+        if (precision == RenderTarget::Precision::High) {
+            EXPECT_EQ(RGBA64Color(0xffff, 0xffff, 0xffff, 0xffff), target.wideData()[7]);
+        }
+    }
+}
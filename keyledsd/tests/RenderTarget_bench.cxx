@@ -18,6 +18,7 @@
 
 #include "keyledsd/tools/accelerated.h"
 #include <benchmark/benchmark.h>
+#include <vector>
 
 using keyleds::RenderTarget;
 using keyleds::RGBColor;
@@ -55,4 +56,65 @@ BENCHMARK_TEMPLATE(BM_multiply, architecture::plain)->RangeMultiplier(2)->Range(
 BENCHMARK_TEMPLATE(BM_multiply, architecture::sse2)->RangeMultiplier(2)->Range(32, 2<<16);
 BENCHMARK_TEMPLATE(BM_multiply, architecture::avx2)->RangeMultiplier(2)->Range(32, 2<<16);
 
+template <typename Architecture> static void BM_blend_wide(benchmark::State & state)
+{
+    auto target = RenderTarget(RenderTarget::size_type(state.range(0)), RenderTarget::Precision::High);
+    auto source = RenderTarget(RenderTarget::size_type(state.range(0)));
+    std::fill(target.begin(), target.end(), RGBAColor{0, 0, 0, 255});
+    std::fill(source.begin(), source.end(), RGBAColor{255, 255, 255, 32});
+    target.syncWide();
+
+    for (auto _ : state) {
+        keyleds::blend<Architecture>(target, source);
+    }
+}
+BENCHMARK_TEMPLATE(BM_blend_wide, architecture::plain)->RangeMultiplier(2)->Range(32, 2<<16);
+BENCHMARK_TEMPLATE(BM_blend_wide, architecture::sse2)->RangeMultiplier(2)->Range(32, 2<<16);
+BENCHMARK_TEMPLATE(BM_blend_wide, architecture::avx2)->RangeMultiplier(2)->Range(32, 2<<16);
+
+template <typename Architecture> static void BM_multiply_wide(benchmark::State & state)
+{
+    auto target = RenderTarget(RenderTarget::size_type(state.range(0)), RenderTarget::Precision::High);
+    auto source = RenderTarget(RenderTarget::size_type(state.range(0)));
+    std::fill(target.begin(), target.end(), RGBAColor{0, 0, 0, 255});
+    std::fill(source.begin(), source.end(), RGBAColor{255, 255, 255, 32});
+    target.syncWide();
+
+    for (auto _ : state) {
+        keyleds::multiply<Architecture>(target, source);
+    }
+}
+BENCHMARK_TEMPLATE(BM_multiply_wide, architecture::plain)->RangeMultiplier(2)->Range(32, 2<<16);
+BENCHMARK_TEMPLATE(BM_multiply_wide, architecture::sse2)->RangeMultiplier(2)->Range(32, 2<<16);
+BENCHMARK_TEMPLATE(BM_multiply_wide, architecture::avx2)->RangeMultiplier(2)->Range(32, 2<<16);
+
+template <typename Architecture> static void BM_blend_color(benchmark::State & state)
+{
+    auto target = RenderTarget(RenderTarget::size_type(state.range(0)));
+    std::fill(target.begin(), target.end(), RGBAColor{0, 0, 0, 255});
+
+    for (auto _ : state) {
+        keyleds::blend<Architecture>(target, RGBAColor{255, 255, 255, 32});
+    }
+}
+BENCHMARK_TEMPLATE(BM_blend_color, architecture::plain)->RangeMultiplier(2)->Range(32, 2<<16);
+BENCHMARK_TEMPLATE(BM_blend_color, architecture::sse2)->RangeMultiplier(2)->Range(32, 2<<16);
+BENCHMARK_TEMPLATE(BM_blend_color, architecture::avx2)->RangeMultiplier(2)->Range(32, 2<<16);
+
+template <typename Architecture> static void BM_sample_table(benchmark::State & state)
+{
+    auto target = RenderTarget(RenderTarget::size_type(state.range(0)));
+    auto table = std::vector<RGBAColor>(1024, RGBAColor{255, 255, 255, 32});
+    auto phases = std::vector<uint32_t>(target.capacity());
+    for (std::size_t idx = 0; idx < phases.size(); ++idx) { phases[idx] = uint32_t(idx * 37); }
+
+    for (auto _ : state) {
+        Architecture::sample_table(reinterpret_cast<uint8_t *>(target.data()),
+                                   reinterpret_cast<const uint8_t *>(table.data()),
+                                   phases.data(), 100, 1023, target.capacity());
+    }
+}
+BENCHMARK_TEMPLATE(BM_sample_table, architecture::plain)->RangeMultiplier(2)->Range(32, 2<<16);
+BENCHMARK_TEMPLATE(BM_sample_table, architecture::avx2)->RangeMultiplier(2)->Range(32, 2<<16);
+
 BENCHMARK_MAIN();
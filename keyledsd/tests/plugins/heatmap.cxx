@@ -0,0 +1,128 @@
+/* Keyleds -- Gaming keyboard tool
+ * Copyright (C) 2017 Julien Hartmann, juli1.hartmann@gmail.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "keyledsd/plugin/interfaces.h"
+#include "keyledsd/plugin/module.h"
+#include "keyledsd/KeyDatabase.h"
+#include "keyledsd/RenderTarget.h"
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+using keyleds::KeyDatabase;
+using keyleds::RGBAColor;
+using keyleds::RenderTarget;
+using keyleds::plugin::EffectService;
+using namespace std::literals::chrono_literals;
+using namespace std::literals::string_literals;
+
+namespace keyleds::plugin {
+extern "C" const module_definition keyledsd_module;
+}
+
+static void onError(const char *) {}
+static const keyleds::plugin::host_definition host = { 1, 0, onError };
+
+
+class HeatmapService final : public EffectService
+{
+public:
+    HeatmapService(const KeyDatabase & db, config_map config) : m_db(db), m_config(std::move(config)) {}
+
+    const std::string & deviceName() const override { return m_name; }
+    const std::string & deviceModel() const override { return m_name; }
+    const std::string & deviceSerial() const override { return m_name; }
+    const KeyDatabase & keyDB() const override { return m_db; }
+    const std::vector<KeyDatabase::KeyGroup> & keyGroups() const override { return m_groups; }
+    const color_map & colors() const override { return m_colors; }
+    const config_map & configuration() const override { return m_config; }
+    RenderTarget * createRenderTarget() override { return nullptr; }
+    void destroyRenderTarget(RenderTarget *) override {}
+    const std::string & getFile(const std::string &) override { return m_name; }
+    void log(keyleds::logging::level_t, const char *) override {}
+
+private:
+    const KeyDatabase &                 m_db;
+    const std::string                   m_name;
+    const std::vector<KeyDatabase::KeyGroup> m_groups;
+    const color_map                     m_colors;
+    const config_map                    m_config;
+};
+
+
+class HeatmapTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        const auto & module = keyleds::plugin::keyledsd_module;
+        m_plugin = static_cast<keyleds::plugin::Plugin *>((*module.initialize)(&host));
+        ASSERT_NE(nullptr, m_plugin);
+        m_effect = m_plugin->createEffect("heatmap", m_service);
+        ASSERT_NE(nullptr, m_effect);
+    }
+
+    void TearDown() override
+    {
+        if (m_effect) { m_plugin->destroyEffect(m_effect, m_service); }
+        if (m_plugin) { (*keyleds::plugin::keyledsd_module.shutdown)(&host, m_plugin); }
+    }
+
+    RGBAColor render(std::chrono::milliseconds elapsed)
+    {
+        std::fill(m_target.begin(), m_target.end(), RGBAColor(0, 0, 0, 255));
+        m_effect->render(elapsed, m_target);
+        return m_target[0];
+    }
+
+    const KeyDatabase m_db = KeyDatabase({
+        {0, 10, "A"s, {10, 10, 20, 20}},
+        {1, 11, "B"s, {30, 10, 40, 20}}
+    });
+    HeatmapService                  m_service{m_db, {{"decay", "16000"s}}};
+    RenderTarget                    m_target{m_db.size()};
+    keyleds::plugin::Plugin *       m_plugin = nullptr;
+    keyleds::plugin::Effect *       m_effect = nullptr;
+};
+
+
+TEST_F(HeatmapTest, hotKeyCoolsDown) {
+    for (int i = 0; i < 4; ++i) { m_effect->handleKeyEvent(m_db[0], true); }
+    auto color = render(0ms);
+    EXPECT_EQ(RGBAColor(255, 0, 0, 255), color);
+
+    // Decay is 16s per half-life, in 16 steps of 1s
+    for (int period = 0; period < 4; ++period) {
+        for (int step = 0; step < 16; ++step) { render(1000ms); }
+        auto cooler = m_target[0];
+        EXPECT_LT(cooler.red, color.red) << "after " << (period + 1) << " half-lives";
+        EXPECT_GT(cooler.blue, color.blue) << "after " << (period + 1) << " half-lives";
+        color = cooler;
+    }
+}
+
+TEST_F(HeatmapTest, pressWarmsKeyUp) {
+    m_effect->handleKeyEvent(m_db[0], true);
+    for (int step = 0; step < 32; ++step) { render(1000ms); }
+    auto cooled = m_target[0];
+    EXPECT_LT(cooled.red, 255);
+
+    m_effect->handleKeyEvent(m_db[0], true);
+    EXPECT_GT(render(0ms).red, cooled.red);
+}
@@ -169,7 +169,7 @@ struct keyleds_keyblocks_info {
     }           blocks[];
 };
 
-struct keyleds_key_color {
+struct keyleds_key_color {     /* layout matches LED reports, do not reorder */
     uint8_t     id;             /* as reported by keyboard */
     uint8_t     red;
     uint8_t     green;
@@ -43,6 +43,9 @@ struct keyleds_device {
 
     struct keyleds_device_reports * reports;    /* list of device-supported hid reports */
     unsigned    max_report_size;                /* maximum number of bytes in a report */
+    uint8_t *   report;                         /* outbound report buffer, 1 + max_report_size */
+    size_t      report_size;                    /* size of prepared report, including id */
+    unsigned    report_seq;                     /* incremented every time a report is prepared */
 
     struct keyleds_device_feature * features;   /* feature index cache */
 
@@ -54,6 +57,9 @@ struct keyleds_device {
 /****************************************************************************/
 /* Core functions */
 
+uint8_t * keyleds_prepare_report(Keyleds * device, uint8_t target_id, uint8_t feature_idx,
+                                 uint8_t function, size_t length);
+bool keyleds_send_report(Keyleds * device);
 bool keyleds_send(Keyleds * device, uint8_t target_id, uint8_t feature_idx,
                   uint8_t function, size_t length, const uint8_t * data);
 bool keyleds_receive(Keyleds * device, uint8_t target_id, uint8_t feature_idx,
@@ -58,6 +58,7 @@ KEYLEDS_EXPORT Keyleds * keyleds_open(const char * path, uint8_t app_id)
     dev->timeout = KEYLEDS_CALL_TIMEOUT_US;
     dev->gkeys_cb = NULL;
     dev->userdata = NULL;
+    dev->report = NULL;
 
     /* Open device */
     KEYLEDS_LOG(DEBUG, "Opening device %s", path);
@@ -88,6 +89,9 @@ KEYLEDS_EXPORT Keyleds * keyleds_open(const char * path, uint8_t app_id)
         keyleds_set_error(KEYLEDS_ERROR_HIDNOPP);
         goto error_free_reports;
     }
+    dev->report = malloc(1 + dev->max_report_size);
+    dev->report_size = 0;
+    dev->report_seq = 0;
 
     /* Check device's protocol version */
     if (!keyleds_get_protocol(dev, KEYLEDS_TARGET_DEFAULT, &version, NULL)) {
@@ -112,6 +116,7 @@ KEYLEDS_EXPORT Keyleds * keyleds_open(const char * path, uint8_t app_id)
     return dev;
 
 error_free_reports:
+    free(dev->report);
     free(dev->reports);
 error_close_fd:
     close(dev->fd);
@@ -128,6 +133,7 @@ KEYLEDS_EXPORT void keyleds_close(Keyleds * device)
 {
     assert(device != NULL);
     close(device->fd);
+    free(device->report);
     free(device->reports);
     free(device->features);
     free(device);
@@ -189,56 +195,70 @@ static void format_buffer(const uint8_t * data, size_t size, char * buffer)
 #endif
 
 
-/** Send a report to the device, running an on-device function.
- * May block if the outgoing queue is full.
+/** Prepare a report in the device's outbound buffer.
+ * Picks the smallest report type that fits the payload, fills in its header and
+ * clears the payload area. The caller then writes the payload in place and sends
+ * the report with keyleds_send_report(). Until another report is prepared, which
+ * `report_seq` tracks, the buffer can be sent again after rewriting the payload.
  * @param device Open device as returned by keyleds_open().
  * @param target_id Device's target identifier, for devices behind a unifying receiver.
  *                  for the receiver itself, or for directly attached devices, use
  *                  KEYLEDS_TARGET_DEFAULT.
  * @param feature_idx Address of the target feature.
  * @param function Code of the function. Meaning depends on specific feature.
- * @param length Size, in bytes of the payload.
- * @param data Pointer to the payload. Unused if length is 0.
- * @return `true` on success, `false` on failure.
+ * @param length Size, in bytes, of the payload.
+ * @return Pointer to the payload area, valid until the device is closed.
  */
-bool keyleds_send(Keyleds * device, uint8_t target_id, uint8_t feature_idx,
-                  uint8_t function, size_t length, const uint8_t * data)
+uint8_t * keyleds_prepare_report(Keyleds * device, uint8_t target_id, uint8_t feature_idx,
+                                 uint8_t function, size_t length)
 {
     assert(device != NULL);
     assert(function <= 0xf);
     assert(length + 3 <= device->max_report_size);
-    assert(length == 0 || data != NULL);
 
     /* Find the smallest report type that fits the payload */
     unsigned idx = 0;
     while (device->reports[idx].size < 3 + length) { idx += 1; }
 
-    /* Fill the report */
-    size_t report_size = device->reports[idx].size;
-    uint8_t buffer[1 + report_size];
-
+    /* Fill the header */
+    uint8_t * buffer = device->report;
+    device->report_size = 1 + (size_t)device->reports[idx].size;
     buffer[0] = device->reports[idx].id;
     buffer[1] = target_id;
     buffer[2] = feature_idx;
     buffer[3] = (uint8_t)(function << 4 | device->app_id);
-    if (length > 0) { memcpy(&buffer[4], data, length); }
-    memset(&buffer[4 + length], 0, report_size - 3 - length);
+    memset(&buffer[4], 0, device->report_size - 4);
+    device->report_seq += 1;
+    return &buffer[4];
+}
+
+/** Send the prepared report to the device.
+ * May block if the outgoing queue is full. The report is written in a single call,
+ * as hidraw maps each write to exactly one report.
+ * @param device Open device as returned by keyleds_open().
+ * @return `true` on success, `false` on failure.
+ * @sa keyleds_prepare_report
+ */
+bool keyleds_send_report(Keyleds * device)
+{
+    assert(device != NULL);
+    assert(device->report_size > 0);
 
 #ifndef NDEBUG
     if (g_keyleds_debug_level >= KEYLEDS_LOG_DEBUG) {
-        char debug_buffer[3 * (1 + report_size) + 1];
-        format_buffer(buffer, (1 + report_size), debug_buffer);
+        char debug_buffer[3 * device->report_size + 1];
+        format_buffer(device->report, device->report_size, debug_buffer);
         KEYLEDS_LOG(DEBUG, "Send [%s]", debug_buffer);
     }
 #endif
 
     /* Send the report to the device */
-    ssize_t nwritten = write(device->fd, buffer, 1 + report_size);
+    ssize_t nwritten = write(device->fd, device->report, device->report_size);
     if (nwritten < 0) {
         keyleds_set_error_errno();
         return false;
     }
-    if ((size_t)nwritten != 1 + report_size) {
+    if ((size_t)nwritten != device->report_size) {
         KEYLEDS_LOG(DEBUG, "Unexpected write size %zd on fd %d", nwritten, device->fd);
         keyleds_set_error(KEYLEDS_ERROR_IO_LENGTH);
         return false;
@@ -246,6 +266,28 @@ bool keyleds_send(Keyleds * device, uint8_t target_id, uint8_t feature_idx,
     return true;
 }
 
+/** Send a report to the device, running an on-device function.
+ * May block if the outgoing queue is full.
+ * @param device Open device as returned by keyleds_open().
+ * @param target_id Device's target identifier, for devices behind a unifying receiver.
+ *                  for the receiver itself, or for directly attached devices, use
+ *                  KEYLEDS_TARGET_DEFAULT.
+ * @param feature_idx Address of the target feature.
+ * @param function Code of the function. Meaning depends on specific feature.
+ * @param length Size, in bytes of the payload.
+ * @param data Pointer to the payload. Unused if length is 0.
+ * @return `true` on success, `false` on failure.
+ */
+bool keyleds_send(Keyleds * device, uint8_t target_id, uint8_t feature_idx,
+                  uint8_t function, size_t length, const uint8_t * data)
+{
+    assert(length == 0 || data != NULL);
+
+    uint8_t * payload = keyleds_prepare_report(device, target_id, feature_idx, function, length);
+    if (length > 0) { memcpy(payload, data, length); }
+    return keyleds_send_report(device);
+}
+
 /** Receive a single report from the device.
  * Wait for incoming reports, filtering out irrelevant ones until either the expected
  * report is received or timeout occurs (see keyleds_set_timeout()).
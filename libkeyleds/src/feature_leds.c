@@ -17,6 +17,7 @@
 #include <assert.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "config.h"
 #include "keyleds.h"
@@ -174,29 +175,35 @@ KEYLEDS_EXPORT bool keyleds_set_leds(Keyleds * device, uint8_t target_id,
     assert((unsigned)block_id <= UINT16_MAX);
     assert(keys != NULL);
     assert(keys_nb <= UINT16_MAX);
+    assert(sizeof(*keys) == 4);     /* keys are copied as is into reports */
 
     unsigned per_call = (device->max_report_size - 3 - 4) / 4;  /* 4 bytes per key, mins headers */
-    unsigned offset, idx;
+    unsigned offset, prepared = 0, seq = 0;
+    uint8_t * data = NULL;
+    uint8_t reply[1 + device->max_report_size];
 
-    uint8_t data[4 + per_call * 4];
-    data[0] = (uint8_t)(block_id >> 8);
-    data[1] = (uint8_t)(block_id >> 0);
+    uint8_t feature_idx = keyleds_get_feature_index(device, target_id, KEYLEDS_FEATURE_LEDS);
+    if (feature_idx == 0) { return false; }
 
-    /* Send keys in chunks */
+    /* Send keys in chunks, writing them straight into the report buffer.
+     * All chunks but the last have the same size, so the header is only
+     * filled once for them, unless a gkeys callback used the device meanwhile. */
     for (offset = 0; offset < keys_nb; offset += per_call) {
         unsigned batch_length = offset + per_call > keys_nb ? keys_nb - offset : per_call;
-        data[2] = (uint8_t)(batch_length >> 8);
-        data[3] = (uint8_t)(batch_length >> 0);
-        for (idx = 0; idx < batch_length; idx += 1) {
-            data[4 + idx * 4 + 0] = keys[offset + idx].id;
-            data[4 + idx * 4 + 1] = keys[offset + idx].red;
-            data[4 + idx * 4 + 2] = keys[offset + idx].green;
-            data[4 + idx * 4 + 3] = keys[offset + idx].blue;
+        if (batch_length != prepared || device->report_seq != seq) {
+            data = keyleds_prepare_report(device, target_id, feature_idx, F_SET_LEDS,
+                                          4 + batch_length * 4);
+            data[0] = (uint8_t)(block_id >> 8);
+            data[1] = (uint8_t)(block_id >> 0);
+            data[2] = (uint8_t)(batch_length >> 8);
+            data[3] = (uint8_t)(batch_length >> 0);
+            prepared = batch_length;
+            seq = device->report_seq;
         }
+        memcpy(&data[4], &keys[offset], batch_length * sizeof(*keys));
 
-        if (keyleds_call(device, NULL, 0,
-                         target_id, KEYLEDS_FEATURE_LEDS, F_SET_LEDS,
-                         4 + batch_length * 4, data) < 0) {
+        if (!keyleds_send_report(device) ||
+            !keyleds_receive(device, target_id, feature_idx, reply, NULL)) {
             return false;
         }
     }